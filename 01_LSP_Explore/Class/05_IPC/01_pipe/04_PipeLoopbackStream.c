@@ -0,0 +1,182 @@
+/*
+🔧 4. Pipe Loopback Service: streaming case conversion
+==========================================================
+Scenario:
+PipeLoopbak_UpperLower.c sends one scanf word (max 20 bytes) to a child
+that upper-cases it byte by byte and sends it back.  Here the child is a
+service: it converts whatever arrives on pipe 'p', of any length, and
+streams it back on pipe 'q' until the parent closes 'p'.
+
+    stdin --> parent --p--> child (case_upper / case_lower) --q--> parent --> stdout
+
+The parent must write to 'p' and read from 'q' at the same time: if it only
+wrote, the child would block on a full 'q' while the parent blocks on a
+full 'p' (deadlock).  So the parent uses poll() on stdin, p[1] and q[0].
+
+Build: gcc -O2 04_PipeLoopbackStream.c caseconv.c -o loopback
+Run:   ./loopback [-l] < bigfile > out      (-l converts to lower case)
+       echo hello world | ./loopback
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "caseconv.h"
+
+#define BUFSZ (64 * 1024)
+
+static int write_all(int fd, const char *p, size_t n)
+{
+    ssize_t r;
+
+    while (n)
+    {
+        r = write(fd, p, n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0)
+            return -1;
+        p += r;
+        n -= r;
+    }
+    return 0;
+}
+
+// Child: read a chunk, convert it in place, send it back.
+static int child(int in, int out, int lower)
+{
+    static char b[BUFSZ];
+    ssize_t n;
+
+    while ((n = read(in, b, sizeof(b))) != 0)
+    {
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (lower)
+            case_lower(b, b, n);
+        else
+            case_upper(b, b, n);
+        if (write_all(out, b, n) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+// Parent: pump stdin -> p[1] and q[0] -> stdout until both are done.
+static int parent(int to, int from)
+{
+    static char in[BUFSZ], back[BUFSZ];
+    struct pollfd pf[3];
+    size_t len = 0, off = 0;
+    int eof = 0;
+    ssize_t n;
+
+    fcntl(to, F_SETFL, O_NONBLOCK);
+    while (from >= 0)
+    {
+        // stdin only when the pending chunk has gone into the pipe
+        pf[0].fd = (!eof && len == 0) ? 0 : -1;
+        pf[0].events = POLLIN;
+        pf[1].fd = len ? to : -1;
+        pf[1].events = POLLOUT;
+        pf[2].fd = from;
+        pf[2].events = POLLIN;
+        if (poll(pf, 3, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return -1;
+        }
+
+        if (pf[0].revents)
+        {
+            n = read(0, in, sizeof(in));
+            if (n <= 0)
+            {
+                // end of input: closing 'p' tells the child to finish
+                eof = 1;
+                close(to);
+            }
+            else
+            {
+                len = n;
+                off = 0;
+            }
+        }
+        if (len && pf[1].revents)
+        {
+            n = write(to, in + off, len);
+            if (n < 0 && errno != EAGAIN)
+            {
+                perror("write p");
+                return -1;
+            }
+            if (n > 0)
+            {
+                off += n;
+                len -= n;
+            }
+        }
+        if (pf[2].revents)
+        {
+            n = read(from, back, sizeof(back));
+            if (n <= 0)
+            {
+                // child closed 'q': everything has come back
+                close(from);
+                from = -1;
+            }
+            else if (write_all(1, back, n) < 0)
+            {
+                perror("stdout");
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int p[2], q[2], lower = 0, st, r;
+
+    if (argc == 2 && strcmp(argv[1], "-l") == 0)
+        lower = 1;
+    else if (argc != 1)
+    {
+        printf("usage:./a.out [-l] < input\n");
+        return 1;
+    }
+
+    // p: parent to child, q: child to parent
+    if (pipe(p) < 0 || pipe(q) < 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+
+    if (fork() == 0)
+    {
+        close(p[1]);
+        close(q[0]);
+        r = child(p[0], q[1], lower);
+        if (r < 0)
+            perror("child");
+        _exit(r < 0);
+    }
+
+    close(p[0]);
+    close(q[1]);
+    fprintf(stderr, "loopback child uses the %s kernel\n", case_impl());
+    r = parent(p[1], q[0]);
+    wait(&st);
+    return r < 0 || !WIFEXITED(st) || WEXITSTATUS(st);
+}
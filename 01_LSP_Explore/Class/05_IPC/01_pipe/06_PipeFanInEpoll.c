@@ -0,0 +1,284 @@
+/*
+🔧 6. Fan-in Multiplexer: many producers, one epoll, no SIGPIPE
+==========================================================
+Scenario:
+03_BrokenPipeSIGPIPE.c shows a writer killed by SIGPIPE.  Here hundreds of
+producer children each write into their own pipe and one multiplexer owns
+all the read ends.  Nobody dies of SIGPIPE: both sides ignore it, so a
+write to a pipe without a reader just fails with EPIPE, and that is
+handled like any other event.
+
+Multiplexer:
+  - every read end is O_NONBLOCK and registered with EPOLLIN|EPOLLRDHUP|EPOLLET
+  - edge triggered means "tell me once", so a ready source goes on a ready
+    list and is read one chunk per turn, round robin, until EAGAIN; one
+    busy producer cannot starve the others
+  - EOF (read returns 0) closes the source
+  - every chunk goes to stdout as a frame: { source, seq, len } + data,
+    so a consumer can split the merged stream back per source and spot
+    anything missing from the sequence numbers
+  - EPIPE on stdout means the consumer is gone: stop cleanly
+
+Producer: writes -b MB in -c byte chunks; EPIPE (the multiplexer closed
+its read end, see -k) ends it with exit status 3.
+
+Build: gcc -O2 06_PipeFanInEpoll.c -o fanin
+Run:   ./fanin [-p producers] [-b MB each] [-c chunk] [-k N] > /dev/null
+       -k N: close every Nth source after its first chunk (EPIPE demo)
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#define OUTSZ   (1024 * 1024)
+#define READSZ  (64 * 1024)
+
+struct frame {
+    uint32_t src;
+    uint32_t seq;
+    uint32_t len;
+};
+
+struct source {
+    int fd;             // -1 once closed
+    int ready;          // on the ready list
+    uint32_t seq;
+    uint64_t bytes;
+};
+
+static struct source *src;
+static int *ready, nready;     // round robin list of sources with data
+static char out[OUTSZ];
+static size_t outlen;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Producer child: write until done or until the reader goes away.
+static void producer(int fd, long total, int chunk, int id)
+{
+    char *b = malloc(chunk);
+    long left = total;
+    ssize_t n;
+
+    memset(b, 'a' + id % 26, chunk);
+    while (left > 0)
+    {
+        n = write(fd, b, left < chunk ? left : chunk);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EPIPE)
+            _exit(3);   // no SIGPIPE: just an error code
+        if (n < 0)
+            _exit(1);
+        left -= n;
+    }
+    _exit(0);
+}
+
+// Write the whole output buffer; -1 when stdout is gone (EPIPE).
+static int flush_out(void)
+{
+    size_t off = 0;
+    ssize_t n;
+
+    while (off < outlen)
+    {
+        n = write(1, out + off, outlen - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        off += n;
+    }
+    outlen = 0;
+    return 0;
+}
+
+static void drop(int ep, int i)
+{
+    epoll_ctl(ep, EPOLL_CTL_DEL, src[i].fd, 0);
+    close(src[i].fd);
+    src[i].fd = -1;
+}
+
+int main(int argc, char **argv)
+{
+    struct epoll_event ev, evs[256];
+    struct rlimit rl;
+    struct frame f;
+    int np = 500, chunk = 64 * 1024, kill_every = 0, opt, ep, i, j, k, p[2], st;
+    int open_src, waits = 0, eof = 0, dropped = 0, epipe = 0, gone = 0;
+    long total = 1 << 20;
+    uint64_t sum = 0, lo = ~0ull, hi = 0;
+    ssize_t n;
+    double t;
+
+    while ((opt = getopt(argc, argv, "p:b:c:k:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'p': np = atoi(optarg); break;
+        case 'b': total = atol(optarg) << 20; break;
+        case 'c': chunk = atoi(optarg); break;
+        case 'k': kill_every = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage:./a.out [-p producers] [-b MB] [-c chunk] [-k N] > out\n");
+            return 1;
+        }
+    }
+    if (np < 1 || chunk < 1 || total < 1)
+        return 1;
+
+    // two fds per producer while forking
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    // The key line: a write to a reader-less pipe returns EPIPE instead.
+    signal(SIGPIPE, SIG_IGN);
+
+    src = calloc(np, sizeof(*src));
+    ready = calloc(np, sizeof(*ready));
+    ep = epoll_create1(0);
+
+    for (i = 0; i < np; i++)
+    {
+        if (pipe2(p, O_CLOEXEC) < 0)
+        {
+            perror("pipe");
+            return 1;
+        }
+        if (fork() == 0)
+        {
+            // only our own write end: close every read end we inherited
+            for (j = 0; j < i; j++)
+                close(src[j].fd);
+            close(p[0]);
+            producer(p[1], total, chunk, i);
+        }
+        close(p[1]);
+        fcntl(p[0], F_SETFL, O_NONBLOCK);
+        src[i].fd = p[0];
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        ev.data.u32 = i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, p[0], &ev);
+    }
+
+    t = now();
+    open_src = np;
+    while (open_src && !gone)
+    {
+        // block only when nothing is known to be readable
+        n = epoll_wait(ep, evs, 256, nready ? 0 : -1);
+        waits++;
+        if (n < 0 && errno != EINTR)
+        {
+            perror("epoll_wait");
+            break;
+        }
+        for (k = 0; k < n; k++)
+        {
+            i = evs[k].data.u32;
+            if (!src[i].ready && src[i].fd >= 0)
+            {
+                src[i].ready = 1;
+                ready[nready++] = i;
+            }
+        }
+
+        // one chunk from every ready source per pass
+        for (k = 0; k < nready && !gone; )
+        {
+            i = ready[k];
+            if (OUTSZ - outlen < sizeof(f) + READSZ && flush_out() < 0)
+            {
+                gone = 1;
+                break;
+            }
+            n = read(src[i].fd, out + outlen + sizeof(f), READSZ);
+            if (n > 0)
+            {
+                f.src = i;
+                f.seq = src[i].seq++;
+                f.len = n;
+                memcpy(out + outlen, &f, sizeof(f));
+                outlen += sizeof(f) + n;
+                src[i].bytes += n;
+                if (kill_every && i % kill_every == 0)
+                {
+                    // the producer will see EPIPE on its next write
+                    drop(ep, i);
+                    dropped++;
+                    open_src--;
+                }
+                else
+                {
+                    k++;
+                    continue;
+                }
+            }
+            else if (n == 0)
+            {
+                drop(ep, i);
+                eof++;
+                open_src--;
+            }
+            else if (errno == EAGAIN)
+                ;               // drained: wait for the next edge
+            else if (errno == EINTR)
+                continue;
+            else
+            {
+                perror("read");
+                drop(ep, i);
+                open_src--;
+            }
+            // off the ready list: swap in the last one
+            src[i].ready = 0;
+            ready[k] = ready[--nready];
+        }
+    }
+    if (!gone && flush_out() < 0)
+        gone = 1;
+    t = now() - t;
+
+    // anything still open goes now, so the remaining producers see EPIPE
+    for (i = 0; i < np; i++)
+        if (src[i].fd >= 0)
+            close(src[i].fd);
+    while (wait(&st) > 0)
+        if (WIFEXITED(st) && WEXITSTATUS(st) == 3)
+            epipe++;
+
+    for (i = 0; i < np; i++)
+    {
+        sum += src[i].bytes;
+        if (src[i].bytes < lo)
+            lo = src[i].bytes;
+        if (src[i].bytes > hi)
+            hi = src[i].bytes;
+    }
+    fprintf(stderr, "%d producers: %.1f MB in %.3f s = %.2f GB/s, %d epoll_wait calls\n",
+            np, sum / 1e6, t, sum / t / 1e9, waits);
+    fprintf(stderr, "per source %llu..%llu bytes, %d EOF, %d closed by us, %d producers saw EPIPE%s\n",
+            (unsigned long long)lo, (unsigned long long)hi, eof, dropped, epipe,
+            gone ? ", stdout went away (EPIPE)" : "");
+    return 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * ASCII case conversion: scalar, SSE2, AVX2 and AVX-512BW variants.
+ * Build: gcc -O2 -c caseconv.c   (the wide variants use target attributes,
+ * no -mavx2 needed; the CPU is checked before they are ever called)
+ *
+ * The vector trick: for upper case, subtract 'a' so the letters become
+ * 0..25, one unsigned compare gives a mask of the lower case bytes, and
+ * flipping bit 0x20 under that mask converts them.  SSE2/AVX2 only have
+ * signed byte compares, so the bytes are biased by 128 first.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "caseconv.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CASE_X86 1
+#endif
+
+// ---------------------------------------------------------------- scalar
+static void conv_scalar(char *dst, const char *src, size_t n, char first)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        unsigned char c = src[i];
+
+        // one compare: c - first wraps to a large value below first
+        dst[i] = (unsigned char)(c - first) < 26 ? c ^ 0x20 : c;
+    }
+}
+
+static void upper_scalar(char *dst, const char *src, size_t n)
+{
+    conv_scalar(dst, src, n, 'a');
+}
+
+static void lower_scalar(char *dst, const char *src, size_t n)
+{
+    conv_scalar(dst, src, n, 'A');
+}
+
+#ifdef CASE_X86
+// ---------------------------------------------------------------- SSE2
+__attribute__((target("sse2")))
+static void conv_sse2(char *dst, const char *src, size_t n, char first)
+{
+    const __m128i bias = _mm_set1_epi8((char)(128 - first));
+    const __m128i limit = _mm_set1_epi8((char)(-128 + 26));
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i m = _mm_cmplt_epi8(_mm_add_epi8(v, bias), limit);
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(v, _mm_and_si128(m, flip)));
+    }
+    conv_scalar(dst + i, src + i, n - i, first);
+}
+
+static void upper_sse2(char *dst, const char *src, size_t n)
+{
+    conv_sse2(dst, src, n, 'a');
+}
+
+static void lower_sse2(char *dst, const char *src, size_t n)
+{
+    conv_sse2(dst, src, n, 'A');
+}
+
+// ---------------------------------------------------------------- AVX2
+__attribute__((target("avx2")))
+static void conv_avx2(char *dst, const char *src, size_t n, char first)
+{
+    const __m256i bias = _mm256_set1_epi8((char)(128 - first));
+    const __m256i limit = _mm256_set1_epi8((char)(-128 + 26));
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 64 <= n; i += 64)
+    {
+        // two vectors per iteration to keep both load ports busy
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+        __m256i ma = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(a, bias));
+        __m256i mb = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(b, bias));
+
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(a, _mm256_and_si256(ma, flip)));
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), _mm256_xor_si256(b, _mm256_and_si256(mb, flip)));
+    }
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i ma = _mm256_cmpgt_epi8(limit, _mm256_add_epi8(a, bias));
+
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(a, _mm256_and_si256(ma, flip)));
+    }
+    // 16 byte steps here, not conv_sse2(): its legacy SSE encoding right
+    // after 256 bit code costs a state transition that dwarfs a short tail
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i m = _mm_cmplt_epi8(_mm_add_epi8(v, _mm256_castsi256_si128(bias)),
+                                   _mm256_castsi256_si128(limit));
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(v, _mm_and_si128(m, _mm256_castsi256_si128(flip))));
+    }
+    conv_scalar(dst + i, src + i, n - i, first);
+}
+
+static void upper_avx2(char *dst, const char *src, size_t n)
+{
+    conv_avx2(dst, src, n, 'a');
+}
+
+static void lower_avx2(char *dst, const char *src, size_t n)
+{
+    conv_avx2(dst, src, n, 'A');
+}
+
+// ---------------------------------------------------------------- AVX-512BW
+__attribute__((target("avx512f,avx512bw")))
+static void conv_avx512(char *dst, const char *src, size_t n, char first)
+{
+    const __m512i base = _mm512_set1_epi8(first);
+    const __m512i span = _mm512_set1_epi8(26);
+    const __m512i flip = _mm512_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 64 <= n; i += 64)
+    {
+        __m512i v = _mm512_loadu_si512((const void *)(src + i));
+        __mmask64 m = _mm512_cmplt_epu8_mask(_mm512_sub_epi8(v, base), span);
+
+        _mm512_storeu_si512((void *)(dst + i), _mm512_mask_blend_epi8(m, v, _mm512_xor_si512(v, flip)));
+    }
+    if (i < n)
+    {
+        // masked load/store for the tail, no scalar loop
+        __mmask64 k = (1ULL << (n - i)) - 1;
+        __m512i v = _mm512_maskz_loadu_epi8(k, src + i);
+        __mmask64 m = _mm512_cmplt_epu8_mask(_mm512_sub_epi8(v, base), span);
+
+        _mm512_mask_storeu_epi8(dst + i, k, _mm512_mask_blend_epi8(m, v, _mm512_xor_si512(v, flip)));
+    }
+}
+
+static void upper_avx512(char *dst, const char *src, size_t n)
+{
+    conv_avx512(dst, src, n, 'a');
+}
+
+static void lower_avx512(char *dst, const char *src, size_t n)
+{
+    conv_avx512(dst, src, n, 'A');
+}
+#endif
+
+// ---------------------------------------------------------------- dispatch
+static const struct case_kernel kernels[] = {
+#ifdef CASE_X86
+    { "avx512bw", upper_avx512, lower_avx512 },
+    { "avx2", upper_avx2, lower_avx2 },
+    { "sse2", upper_sse2, lower_sse2 },
+#endif
+    { "scalar", upper_scalar, lower_scalar },
+};
+
+static int usable(const struct case_kernel *k)
+{
+#ifdef CASE_X86
+    __builtin_cpu_init();
+    if (k->upper == upper_avx512)
+        return __builtin_cpu_supports("avx512bw");
+    if (k->upper == upper_avx2)
+        return __builtin_cpu_supports("avx2");
+    if (k->upper == upper_sse2)
+        return __builtin_cpu_supports("sse2");
+#endif
+    (void)k;
+    return 1;
+}
+
+static const struct case_kernel *chosen;
+
+static const struct case_kernel *pick(void)
+{
+    const struct case_kernel *k = __atomic_load_n(&chosen, __ATOMIC_ACQUIRE);
+    size_t i;
+
+    if (k)
+        return k;
+    for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+        if (usable(&kernels[i]))
+            break;
+    // every thread that races here picks the same entry
+    __atomic_store_n(&chosen, &kernels[i], __ATOMIC_RELEASE);
+    return &kernels[i];
+}
+
+void case_upper(char *dst, const char *src, size_t n)
+{
+    pick()->upper(dst, src, n);
+}
+
+void case_lower(char *dst, const char *src, size_t n)
+{
+    pick()->lower(dst, src, n);
+}
+
+const char *case_impl(void)
+{
+    return pick()->name;
+}
+
+int case_kernels(const struct case_kernel **list, int max)
+{
+    size_t i;
+    int n = 0;
+
+    for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]) && n < max; i++)
+        if (usable(&kernels[i]))
+            list[n++] = &kernels[i];
+    return n;
+}
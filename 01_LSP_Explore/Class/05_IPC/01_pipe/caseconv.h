@@ -0,0 +1,32 @@
+/*
+ * ASCII case conversion kernel shared by the pipe demos.
+ *
+ * case_upper()/case_lower() convert n bytes from src to dst (src == dst is
+ * fine).  Only 'a'..'z' / 'A'..'Z' change; every other byte, including
+ * UTF-8 and NUL, passes through untouched.
+ *
+ * The first call picks the widest variant the CPU supports (CPUID):
+ * AVX-512BW, AVX2, SSE2, else scalar.  case_kernels() lists the variants
+ * usable on this CPU so the benchmark can time each one.
+ */
+#ifndef CASECONV_H
+#define CASECONV_H
+
+#include <stddef.h>
+
+struct case_kernel {
+    const char *name;
+    void (*upper)(char *dst, const char *src, size_t n);
+    void (*lower)(char *dst, const char *src, size_t n);
+};
+
+void case_upper(char *dst, const char *src, size_t n);
+void case_lower(char *dst, const char *src, size_t n);
+
+/* name of the variant case_upper()/case_lower() use */
+const char *case_impl(void);
+
+/* fills list with up to max usable variants, widest first; returns count */
+int case_kernels(const struct case_kernel **list, int max);
+
+#endif
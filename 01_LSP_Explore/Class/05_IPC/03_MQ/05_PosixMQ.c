@@ -0,0 +1,204 @@
+/*
+🔧 5. POSIX Message Queue: epoll or mq_notify, priorities, batched drain
+==========================================================
+Scenario:
+03_ReceiveMQ.c asks for one message with IPC_NOWAIT and gives up if
+there is none; to wait for messages it would have to poll in a loop.
+A POSIX queue descriptor is a file descriptor, so the receiver here
+sleeps until the kernel says there is something, then takes everything
+queued in one msgq_drain() call (msgq.h):
+
+  -m epoll   the queue fd sits in an epoll set (next to anything else
+             the program waits for), EPOLLIN wakes us
+  -m notify  mq_notify() runs a callback on its own thread when a
+             message lands in an empty queue
+  -c         with -m notify: the callback that takes the last message
+             unlinks and closes the queue itself, from inside the
+             callback, instead of main doing it
+
+A forked producer sends bursts of -b messages with priorities 0..3.
+The first few drains are printed: within a drain the highest priority
+comes out first, whatever order it was sent in.
+
+Build: gcc -O2 05_PosixMQ.c msgq.c -o pmq -lrt -lpthread
+Run:   ./pmq [-m epoll|notify] [-c] [-n messages] [-b burst]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include "msgq.h"
+
+#define MAXBATCH  64
+
+// with -m notify two callbacks can drain at the same time (msgq.h):
+// counters are atomic and every drain has its own buffer
+static atomic_long got, wakeups;
+static atomic_int posted;
+static long expected;
+static int close_in_fn;
+static sem_t all_done;
+
+static void drain(struct msgq *q)
+{
+    struct msgq_msg m[MAXBATCH];
+    size_t cap = MAXBATCH * msgq_msgsize(q);
+    char *buf = malloc(cap);
+    long w = atomic_fetch_add(&wakeups, 1) + 1;
+    int n, i;
+
+    while ((n = msgq_drain(q, buf, cap, m, MAXBATCH)) > 0)
+    {
+        if (w <= 3)
+        {
+            printf("wakeup %ld: %d messages, prio", w, n);
+            for (i = 0; i < n; i++)
+                printf(" %u", m[i].prio);
+            printf("\n");
+        }
+        atomic_fetch_add(&got, n);
+    }
+    free(buf);
+}
+
+static void on_notify(struct msgq *q, void *arg)
+{
+    (void)arg;
+    drain(q);
+    // once, even if two callbacks see the last message counted
+    if (atomic_load(&got) >= expected && !atomic_exchange(&posted, 1))
+    {
+        if (close_in_fn)
+        {
+            // waits for the other callbacks; q is freed once we return
+            msgq_unlink(q);
+            msgq_close(q);
+        }
+        sem_post(&all_done);
+    }
+}
+
+static void producer(const char *name, long n, int burst)
+{
+    struct msgq *q = msgq_open(name, MSGQ_POSIX, 0, 0, 0);
+    char msg[64];
+    long i;
+
+    if (!q)
+    {
+        perror("producer: msgq_open");
+        _exit(1);
+    }
+    for (i = 0; i < n; i++)
+    {
+        // prio 0,1,2,3,0,1,... : each burst arrives out of priority order
+        snprintf(msg, sizeof(msg), "message %ld", i);
+        if (msgq_send(q, msg, strlen(msg) + 1, i % 4) < 0)
+            _exit(1);
+        if ((i + 1) % burst == 0)
+            usleep(1000);       // let the receiver catch up: a new burst
+    }
+    msgq_close(q);
+    _exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    char name[64], *mode = "epoll";
+    struct epoll_event ev;
+    struct msgq *q;
+    long n = 10000;
+    int burst = 8, opt, ep, st;
+
+    while ((opt = getopt(argc, argv, "m:cn:b:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm': mode = optarg; break;
+        case 'c': close_in_fn = 1; break;
+        case 'n': n = atol(optarg); break;
+        case 'b': burst = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage:./a.out [-m epoll|notify] [-c] [-n messages] [-b burst]\n");
+            return 1;
+        }
+    }
+    if (n < 1 || burst < 1 || (strcmp(mode, "epoll") && strcmp(mode, "notify")) ||
+        (close_in_fn && strcmp(mode, "notify")))
+        return 1;
+    expected = n;
+
+    // room for a whole burst, so the order within it is up to the queue
+    snprintf(name, sizeof(name), "/pmq.%d", getpid());
+    q = msgq_open(name, MSGQ_POSIX, MSGQ_CREATE, burst < 10 ? 10 : burst, 64);
+    if (!q)
+    {
+        perror("msgq_open (a burst over /proc/sys/fs/mqueue/msg_max needs CAP_SYS_RESOURCE)");
+        return 1;
+    }
+
+    if (strcmp(mode, "notify") == 0)
+    {
+        sem_init(&all_done, 0, 0);
+        if (msgq_notify(q, on_notify, 0) < 0)
+        {
+            perror("mq_notify");
+            return 1;
+        }
+        if (fork() == 0)
+            producer(name, n, burst);
+        sem_wait(&all_done);
+        // returns once the last callback is out of msgq_drain(q)
+        if (!close_in_fn)
+            msgq_notify(q, 0, 0);
+    }
+    else
+    {
+        ep = epoll_create1(0);
+        ev.events = EPOLLIN;
+        ev.data.fd = msgq_fd(q);
+        epoll_ctl(ep, EPOLL_CTL_ADD, msgq_fd(q), &ev);
+        if (fork() == 0)
+            producer(name, n, burst);
+        while (got < n)
+            if (epoll_wait(ep, &ev, 1, -1) == 1)
+                drain(q);
+    }
+    wait(&st);
+
+    printf("%s: %ld messages in %ld wakeups, %.1f per wakeup\n",
+           mode, atomic_load(&got), atomic_load(&wakeups), (double)atomic_load(&got) / atomic_load(&wakeups));
+    if (!close_in_fn)
+    {
+        msgq_unlink(q);
+        msgq_close(q);
+    }
+    return 0;
+}
+
+/*
+🧪 How to Run:
+==========================================
+./pmq -n 10000 -b 8
+wakeup 1: 8 messages, prio 3 3 2 2 1 1 0 0
+wakeup 2: 8 messages, prio 3 3 2 2 1 1 0 0
+wakeup 3: 8 messages, prio 3 3 2 2 1 1 0 0
+epoll: 10000 messages in 1888 wakeups, 5.3 per wakeup
+
+./pmq -m notify -n 10000 -b 8
+wakeup 1: 8 messages, prio 3 3 2 2 1 1 0 0
+wakeup 2: 1 messages, prio 0
+wakeup 3: 1 messages, prio 1
+notify: 10000 messages in 1259 wakeups, 7.9 per wakeup
+
+./pmq -m notify -c -n 10000 -b 8      (closed from inside the callback)
+wakeup 1: 1 messages, prio 0
+wakeup 2: 1 messages, prio 1
+wakeup 3: 1 messages, prio 2
+notify: 10000 messages in 1283 wakeups, 7.8 per wakeup
+*/
@@ -0,0 +1,288 @@
+/*
+🔧 7. Large Messages: the queue carries a descriptor, shared memory the data
+==========================================================
+Scenario:
+02_SendMQ.c sends data[20].  A SysV message is at most msgmax (8 KiB by
+default) and is copied twice, into the kernel and out again.  For
+megabytes that is the wrong tool, but a queue is still a good doorbell.
+
+Here the sender writes the payload once into a slot of a shmpool.h pool
+(SysV shared memory both sides attach) and sends a 12-byte descriptor
+{ slot, len, gen } through the queue.  Each receiver reads the payload
+in place and releases the slot: that is its ack, and the last ack puts
+the slot back.  With -r 2 every descriptor goes to two receivers
+(mtype 1 and 2) and the slot is freed after both.
+
+Compared, for every size, per message:
+  memcpy    one process copies the source into a buffer and sums it:
+            the memory bandwidth ceiling
+  sysvmq    the payload itself through msgsnd/msgrcv in msgmax pieces,
+            summed by the receiver
+  offload   copy into a slot, descriptor through the queue, receiver
+            sums the slot in place
+
+Build: gcc -O2 07_LargeMsgOffload.c shmpool.c -o offload
+Run:   ./offload [-s 64k,1m,4m,16m] [-b MB per size] [-k slots] [-r receivers]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include <sys/wait.h>
+#include "shmpool.h"
+
+#define MAXSIZES  8
+#define STOP      0xffffffffu
+#define ALLOC_MS  5000          // no slot back by then: a receiver is gone
+
+struct dmsg {
+    long mtype;
+    struct shmpool_desc d;
+};
+
+struct cmsg {
+    long mtype;
+    char data[];
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// what every receiver does with a message: read all of it
+static uint64_t sum(const void *p, size_t n)
+{
+    const uint64_t *w = p;
+    uint64_t s = 0;
+    size_t i;
+
+    for (i = 0; i < n / 8; i++)
+        s += w[i];
+    return s;
+}
+
+static double run_memcpy(const char *src, size_t size, long count)
+{
+    char *dst = malloc(size);
+    volatile uint64_t s = 0;
+    double t = now();
+    long i;
+
+    for (i = 0; i < count; i++)
+    {
+        memcpy(dst, src, size);
+        s += sum(dst, size);
+    }
+    t = now() - t;
+    free(dst);
+    return (double)size * count / t / 1e9;
+}
+
+static double run_sysv(const char *src, size_t size, long count, long msgmax)
+{
+    struct cmsg *m = malloc(sizeof(long) + msgmax);
+    char *dst;
+    volatile uint64_t s = 0;
+    size_t off, k;
+    long i;
+    int q = msgget(IPC_PRIVATE, IPC_CREAT | 0600), st;
+    double t;
+
+    if (q < 0)
+        return -1;
+    t = now();
+    if (fork() == 0)
+    {
+        dst = malloc(size);
+        for (i = 0; i < count; i++)
+        {
+            for (off = 0; off < size; off += k)
+            {
+                k = msgrcv(q, m, msgmax, 1, 0);
+                if ((ssize_t)k <= 0)
+                    _exit(1);
+                memcpy(dst + off, m->data, k);
+            }
+            s += sum(dst, size);
+        }
+        _exit(0);
+    }
+    m->mtype = 1;
+    for (i = 0; i < count; i++)
+        for (off = 0; off < size; off += k)
+        {
+            k = size - off < (size_t)msgmax ? size - off : (size_t)msgmax;
+            memcpy(m->data, src + off, k);
+            if (msgsnd(q, m, k, 0) < 0)
+                break;
+        }
+    wait(&st);
+    t = now() - t;
+    msgctl(q, IPC_RMID, 0);
+    free(m);
+    return WIFEXITED(st) && WEXITSTATUS(st) == 0 ? (double)size * count / t / 1e9 : -1;
+}
+
+static void receiver(int q, int shmid, int r, long count)
+{
+    struct shmpool *p = shmpool_attach(shmid);
+    volatile uint64_t s = 0;
+    struct dmsg m;
+    uint64_t *data;
+    long i;
+
+    if (!p)
+        _exit(1);
+    for (i = 0; ; i++)
+    {
+        if (msgrcv(q, &m, sizeof(m.d), r + 1, 0) < 0)
+            _exit(1);
+        if (m.d.slot == STOP)
+            break;
+        data = shmpool_data(p, &m.d);
+        if (!data || data[0] != (uint64_t)i)
+            _exit(2);       // stale descriptor or wrong message
+        s += sum(data, m.d.len);
+        if (shmpool_release(p, &m.d) < 0)
+            _exit(2);
+    }
+    shmpool_detach(p);
+    _exit(i == count ? 0 : 3);
+}
+
+static double run_offload(const char *src, size_t size, long count, unsigned slots, int nr)
+{
+    struct shmpool *p = shmpool_create(slots, size);
+    struct shmpool_desc last = { 0 };
+    struct dmsg m;
+    uint64_t *slot;
+    long i;
+    int q, r, st, bad = 0;
+    double t;
+
+    if (!p)
+        return -1;
+    q = msgget(IPC_PRIVATE, IPC_CREAT | 0600);
+    t = now();
+    for (r = 0; r < nr; r++)
+        if (fork() == 0)
+            receiver(q, shmpool_id(p), r, count);
+    for (i = 0; i < count; i++)
+    {
+        // one reference per receiver: the slot is free after the last ack
+        if (shmpool_alloc(p, nr, &m.d, ALLOC_MS) < 0)
+        {
+            perror("shmpool_alloc");
+            bad = 1;
+            break;
+        }
+        m.d.len = size;
+        slot = shmpool_data(p, &m.d);
+        memcpy(slot, src, size);
+        slot[0] = i;
+        for (r = 0; r < nr; r++)
+        {
+            m.mtype = r + 1;
+            msgsnd(q, &m, sizeof(m.d), 0);
+        }
+        last = m.d;
+    }
+    m.d.slot = STOP;
+    for (r = 0; r < nr; r++)
+    {
+        m.mtype = r + 1;
+        msgsnd(q, &m, sizeof(m.d), 0);
+    }
+    while (wait(&st) > 0)
+        if (!WIFEXITED(st) || WEXITSTATUS(st))
+            bad = 1;
+    t = now() - t;
+    if (shmpool_nfree(p) != slots)
+        bad = 1;            // every slot must have come back
+    if (shmpool_data(p, &last) || shmpool_release(p, &last) == 0)
+        bad = 1;            // and an old descriptor must not work any more
+    msgctl(q, IPC_RMID, 0);
+    shmpool_destroy(p);
+    shmpool_detach(p);
+    return bad ? -1 : (double)size * count / t / 1e9;
+}
+
+static void show(const char *name, size_t size, long count, double gbs)
+{
+    if (gbs < 0)
+        printf("%-8s %9zu %6ld  failed\n", name, size, count);
+    else
+        printf("%-8s %9zu %6ld %8.2f\n", name, size, count, gbs);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    long sizes[MAXSIZES] = { 64 << 10, 1 << 20, 4 << 20, 16 << 20 }, total = 1024, msgmax = 8192, count;
+    int nsizes = 4, opt, i, nr = 1;
+    unsigned slots = 4;
+    char *src, *tok, *end;
+    FILE *fp;
+
+    while ((opt = getopt(argc, argv, "s:b:k:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            nsizes = 0;
+            for (tok = strtok(optarg, ","); tok && nsizes < MAXSIZES; tok = strtok(0, ","))
+            {
+                sizes[nsizes] = strtol(tok, &end, 10);
+                if (*end == 'k' || *end == 'K')
+                    sizes[nsizes] <<= 10;
+                else if (*end == 'm' || *end == 'M')
+                    sizes[nsizes] <<= 20;
+                if (sizes[nsizes] < 8)
+                    return 1;
+                nsizes++;
+            }
+            break;
+        case 'b': total = atol(optarg); break;
+        case 'k': slots = atoi(optarg); break;
+        case 'r': nr = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage:./a.out [-s 64k,1m,...] [-b MB per size] [-k slots] [-r receivers]\n");
+            return 1;
+        }
+    }
+    if (nsizes < 1 || total < 1 || slots < 1 || nr < 1)
+        return 1;
+    if ((fp = fopen("/proc/sys/kernel/msgmax", "r")))
+    {
+        if (fscanf(fp, "%ld", &msgmax) != 1)
+            msgmax = 8192;
+        fclose(fp);
+    }
+
+    printf("%u slots, %d receiver%s, SysV pieces of %ld bytes\n", slots, nr, nr > 1 ? "s" : "", msgmax);
+    printf("%-8s %9s %6s %8s\n", "path", "size", "msgs", "GB/s");
+    for (i = 0; i < nsizes; i++)
+    {
+        count = (total << 20) / sizes[i];
+        if (count < 16)
+            count = 16;
+        src = malloc(sizes[i]);
+        memset(src, 'x', sizes[i]);
+        show("memcpy", sizes[i], count, run_memcpy(src, sizes[i], count));
+        if (nr == 1)
+            show("sysvmq", sizes[i], count, run_sysv(src, sizes[i], count, msgmax));
+        show("offload", sizes[i], count, run_offload(src, sizes[i], count, slots, nr));
+        free(src);
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <string.h>
+#include "hdrhist.h"
+
+#define HALF    (1u << (HDR_SUB_BITS - 1))
+
+static unsigned index_of(uint64_t v)
+{
+    unsigned msb, b;
+
+    if (v < 2 * HALF)
+        return v;
+    msb = 63 - __builtin_clzll(v);
+    if (msb >= HDR_MAX_BITS)
+        return HDR_NCOUNTS - 1;
+    // the top HDR_SUB_BITS bits: HALF..2*HALF-1 for bucket b
+    b = msb - (HDR_SUB_BITS - 1);
+    return b * HALF + (unsigned)(v >> b);
+}
+
+// the highest value counted at index i
+static uint64_t value_of(unsigned i)
+{
+    unsigned b;
+
+    if (i < 2 * HALF)
+        return i;
+    b = i / HALF - 1;
+    return (((uint64_t)(i % HALF + HALF) + 1) << b) - 1;
+}
+
+void hdr_init(struct hdrhist *h)
+{
+    memset(h, 0, sizeof(*h));
+    h->magic = HDR_MAGIC;
+}
+
+void hdr_record(struct hdrhist *h, uint64_t v)
+{
+    atomic_fetch_add_explicit(&h->counts[index_of(v)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->total, 1, memory_order_relaxed);
+}
+
+void hdr_copy(struct hdrhist *d, const struct hdrhist *a)
+{
+    uint64_t t = 0, c;
+    unsigned i;
+
+    // the total is summed from the copied counters, not read separately
+    d->magic = a->magic;
+    for (i = 0; i < HDR_NCOUNTS; i++)
+    {
+        c = atomic_load_explicit(&a->counts[i], memory_order_relaxed);
+        atomic_store_explicit(&d->counts[i], c, memory_order_relaxed);
+        t += c;
+    }
+    atomic_store_explicit(&d->total, t, memory_order_relaxed);
+}
+
+void hdr_sub(struct hdrhist *d, const struct hdrhist *a, const struct hdrhist *b)
+{
+    uint64_t t = 0, c;
+    unsigned i;
+
+    d->magic = a->magic;
+    for (i = 0; i < HDR_NCOUNTS; i++)
+    {
+        c = atomic_load_explicit(&a->counts[i], memory_order_relaxed) -
+            atomic_load_explicit(&b->counts[i], memory_order_relaxed);
+        atomic_store_explicit(&d->counts[i], c, memory_order_relaxed);
+        t += c;
+    }
+    atomic_store_explicit(&d->total, t, memory_order_relaxed);
+}
+
+uint64_t hdr_percentile(const struct hdrhist *h, double p)
+{
+    uint64_t total = atomic_load_explicit(&h->total, memory_order_relaxed), want, seen = 0;
+    unsigned i, last = 0;
+
+    if (total == 0)
+        return 0;
+    want = (uint64_t)(p / 100.0 * total + 0.5);
+    if (want < 1)
+        want = 1;
+    for (i = 0; i < HDR_NCOUNTS; i++)
+    {
+        if (atomic_load_explicit(&h->counts[i], memory_order_relaxed) == 0)
+            continue;
+        seen += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+        last = i;
+        if (seen >= want)
+            break;
+    }
+    return value_of(last);
+}
+
+size_t hdr_format(const struct hdrhist *h, char *buf, size_t n)
+{
+    char item[48];
+    size_t used = 0;
+    unsigned i;
+    uint64_t c;
+    int k;
+
+    if (n)
+        buf[0] = 0;
+    for (i = 0; i < HDR_NCOUNTS; i++)
+    {
+        c = atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+        if (c == 0)
+            continue;
+        k = snprintf(item, sizeof(item), "%s%llu:%llu", used ? "," : "",
+                     (unsigned long long)value_of(i), (unsigned long long)c);
+        if (used + k >= n)
+            break;
+        memcpy(buf + used, item, k + 1);
+        used += k;
+    }
+    return used;
+}
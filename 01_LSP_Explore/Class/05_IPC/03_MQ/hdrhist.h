@@ -0,0 +1,50 @@
+/*
+ * A fixed-size HDR (high dynamic range) histogram of 64-bit values,
+ * e.g. latencies in nanoseconds.
+ *
+ * Values below 256 have a counter each; above that every power of two
+ * is split into 128 equal counters, so a value is known to within 1/128
+ * (under 0.8%) anywhere from 1 ns to HDR_MAX_BITS (about 18 minutes in
+ * ns).  Larger values land in the last counter.
+ *
+ * The struct holds no pointers and has one fixed layout, so it can live
+ * in shared memory: hdr_record() is atomic, one process records while
+ * another copies it and subtracts the previous copy for an interval.
+ */
+#ifndef HDRHIST_H
+#define HDRHIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define HDR_SUB_BITS    8
+#define HDR_MAX_BITS    40
+#define HDR_NCOUNTS     ((HDR_MAX_BITS - HDR_SUB_BITS + 2) << (HDR_SUB_BITS - 1))
+#define HDR_MAGIC       0x68647268u     // "hdrh"
+
+struct hdrhist {
+    uint32_t magic;
+    uint32_t pad;
+    _Atomic uint64_t total;
+    _Atomic uint64_t counts[HDR_NCOUNTS];
+};
+
+void hdr_init(struct hdrhist *h);
+void hdr_record(struct hdrhist *h, uint64_t v);
+
+/* d = a - b, counter by counter: the values recorded since copy b */
+void hdr_sub(struct hdrhist *d, const struct hdrhist *a, const struct hdrhist *b);
+void hdr_copy(struct hdrhist *d, const struct hdrhist *a);
+
+/* the value below which p percent of the values lie; 0 when empty */
+uint64_t hdr_percentile(const struct hdrhist *h, double p);
+
+/*
+ * The non-empty counters as "value:count,..." (value = the highest one
+ * the counter stands for), enough to merge or replot it elsewhere.
+ * Returns the length written, truncated at a whole entry.
+ */
+size_t hdr_format(const struct hdrhist *h, char *buf, size_t n);
+
+#endif
@@ -0,0 +1,345 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include "msgq.h"
+
+struct msgq {
+    int backend, flags;
+    char name[256];
+    mqd_t mq;                   // POSIX, always O_NONBLOCK underneath
+    int msqid;                  // SysV
+    size_t msgsize;
+    struct qmsg { long mtype; char data[]; } *mb;   // SysV bounce buffer
+    // notify state, all under live_lock
+    void (*fn)(struct msgq *, void *);
+    void *arg;
+    uintptr_t id;               // what the notification carries, not q
+    int busy;                   // trampolines inside fn right now
+    int closing;                // closed from its own fn: freed when that returns
+    struct msgq *next;          // on the live list while notify is in use
+};
+
+/*
+ * A notification fires on a thread glibc starts later, possibly after
+ * msgq_close() freed q, so it carries q->id and the trampoline looks the
+ * queue up here.  Whoever finds q marks it busy under the same lock, and
+ * msgq_close() / msgq_notify(q, 0, 0) wait for busy to fall to zero.
+ */
+static pthread_mutex_t live_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t live_idle = PTHREAD_COND_INITIALIZER;
+static struct msgq *live;
+static uintptr_t live_ids;
+static __thread struct msgq *in_fn;     // the queue this thread's fn serves
+
+struct msgq *msgq_open(const char *name, int backend, int flags, long maxmsg, long msgsize)
+{
+    struct msgq *q = calloc(1, sizeof(*q));
+    struct mq_attr a = { 0 };
+    struct msqid_ds ds;
+    key_t key;
+
+    q->backend = backend;
+    q->flags = flags;
+    snprintf(q->name, sizeof(q->name), "%s", name);
+    if (backend == MSGQ_POSIX)
+    {
+        /*
+         * Non-blocking underneath either way: a blocking msgq_recv()
+         * waits in poll(), and msgq_drain() can stop at EAGAIN.
+         */
+        a.mq_maxmsg = maxmsg;
+        a.mq_msgsize = msgsize;
+        q->mq = mq_open(name, O_RDWR | O_NONBLOCK | (flags & MSGQ_CREATE ? O_CREAT : 0),
+                        0644, maxmsg > 0 ? &a : 0);
+        if (q->mq == (mqd_t)-1 || mq_getattr(q->mq, &a) < 0)
+            goto fail;
+        q->msgsize = a.mq_msgsize;
+        return q;
+    }
+
+    key = ftok(name, 'q');
+    q->msqid = key < 0 ? -1 : msgget(key, 0644 | (flags & MSGQ_CREATE ? IPC_CREAT : 0));
+    if (q->msqid < 0)
+        goto fail;
+    q->msgsize = msgsize > 0 ? msgsize : 8192;
+    if (maxmsg > 0 && msgctl(q->msqid, IPC_STAT, &ds) == 0 &&
+        ds.msg_qbytes != (msglen_t)(maxmsg * q->msgsize))
+    {
+        // past msgmnb needs CAP_SYS_RESOURCE: best effort
+        ds.msg_qbytes = maxmsg * q->msgsize;
+        msgctl(q->msqid, IPC_SET, &ds);
+    }
+    q->mb = malloc(sizeof(long) + q->msgsize);
+    return q;
+
+fail:
+    free(q);
+    return 0;
+}
+
+static void quiesce(struct msgq *q);
+
+static void destroy(struct msgq *q)
+{
+    // also drops a registration a callback renewed meanwhile
+    if (q->backend == MSGQ_POSIX)
+        mq_close(q->mq);
+    free(q->mb);
+    free(q);
+}
+
+void msgq_close(struct msgq *q)
+{
+    struct msgq **pp;
+
+    if (q->backend == MSGQ_POSIX)
+    {
+        pthread_mutex_lock(&live_lock);
+        for (pp = &live; *pp; pp = &(*pp)->next)
+            if (*pp == q)
+            {
+                *pp = q->next;
+                break;
+            }
+        quiesce(q);
+        if (q->busy)
+        {
+            // our own fn is still on the stack: the trampoline frees q
+            q->closing = 1;
+            pthread_mutex_unlock(&live_lock);
+            return;
+        }
+        pthread_mutex_unlock(&live_lock);
+    }
+    destroy(q);
+}
+
+int msgq_unlink(struct msgq *q)
+{
+    if (q->backend == MSGQ_POSIX)
+        return mq_unlink(q->name);
+    return msgctl(q->msqid, IPC_RMID, 0);
+}
+
+static int wait_fd(struct msgq *q, short ev)
+{
+    struct pollfd pf = { .fd = q->mq, .events = ev };
+
+    if (q->flags & MSGQ_NONBLOCK)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (poll(&pf, 1, -1) < 0 && errno != EINTR)
+        return -1;
+    return 0;
+}
+
+int msgq_send(struct msgq *q, const void *p, size_t n, unsigned prio)
+{
+    if (prio > MSGQ_PRIO_MAX)
+        prio = MSGQ_PRIO_MAX;
+    if (q->backend == MSGQ_POSIX)
+    {
+        while (mq_send(q->mq, p, n, prio) < 0)
+            if (errno != EAGAIN || wait_fd(q, POLLOUT) < 0)
+                return -1;
+        return 0;
+    }
+
+    if (n > q->msgsize)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    q->mb->mtype = MSGQ_PRIO_MAX + 1 - prio;
+    memcpy(q->mb->data, p, n);
+    while (msgsnd(q->msqid, q->mb, n, q->flags & MSGQ_NONBLOCK ? IPC_NOWAIT : 0) < 0)
+        if (errno != EINTR)
+            return -1;
+    return 0;
+}
+
+static ssize_t sysv_recv(struct msgq *q, void *p, size_t n, unsigned *prio, int nowait)
+{
+    ssize_t k;
+
+    // the lowest mtype <= MSGQ_PRIO_MAX+1 first: the highest prio.  At most
+    // n bytes and no MSG_NOERROR: a longer message gets E2BIG and stays
+    // queued, as mq_receive() leaves it with EMSGSIZE
+    while ((k = msgrcv(q->msqid, q->mb, n < q->msgsize ? n : q->msgsize, -(MSGQ_PRIO_MAX + 1),
+                       nowait ? IPC_NOWAIT : 0)) < 0)
+    {
+        if (errno == ENOMSG)
+            errno = EAGAIN;
+        if (errno == E2BIG)
+            errno = EMSGSIZE;
+        if (errno != EINTR)
+            return -1;
+    }
+    memcpy(p, q->mb->data, k);
+    if (prio)
+        *prio = MSGQ_PRIO_MAX + 1 - q->mb->mtype;
+    return k;
+}
+
+ssize_t msgq_recv(struct msgq *q, void *p, size_t n, unsigned *prio)
+{
+    ssize_t k;
+
+    if (q->backend == MSGQ_SYSV)
+        return sysv_recv(q, p, n, prio, q->flags & MSGQ_NONBLOCK);
+    while ((k = mq_receive(q->mq, p, n, prio)) < 0)
+        if (errno != EAGAIN || wait_fd(q, POLLIN) < 0)
+            return -1;
+    return k;
+}
+
+int msgq_drain(struct msgq *q, char *buf, size_t cap, struct msgq_msg *m, int max)
+{
+    size_t used = 0;
+    ssize_t k;
+    int n = 0;
+
+    while (n < max && cap - used >= q->msgsize)
+    {
+        if (q->backend == MSGQ_POSIX)
+            k = mq_receive(q->mq, buf + used, q->msgsize, &m[n].prio);
+        else
+            k = sysv_recv(q, buf + used, q->msgsize, &m[n].prio, 1);
+        if (k < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                break;
+            return n ? n : -1;
+        }
+        m[n].data = buf + used;
+        m[n].len = k;
+        used += k;
+        n++;
+    }
+    return n;
+}
+
+int msgq_fd(struct msgq *q)
+{
+    return q->backend == MSGQ_POSIX ? (int)q->mq : -1;
+}
+
+size_t msgq_msgsize(struct msgq *q)
+{
+    return q->msgsize;
+}
+
+long msgq_count(struct msgq *q)
+{
+    struct mq_attr a;
+    struct msqid_ds ds;
+
+    if (q->backend == MSGQ_POSIX)
+        return mq_getattr(q->mq, &a) < 0 ? -1 : a.mq_curmsgs;
+    return msgctl(q->msqid, IPC_STAT, &ds) < 0 ? -1 : (long)ds.msg_qnum;
+}
+
+static int arm(struct msgq *q);
+
+/* no fn of q's running but the caller's own; live_lock held */
+static void quiesce(struct msgq *q)
+{
+    q->fn = 0;
+    while (q->busy > (in_fn == q))
+        pthread_cond_wait(&live_idle, &live_lock);
+}
+
+static void trampoline(union sigval sv)
+{
+    void (*fn)(struct msgq *, void *) = 0;
+    struct msgq *q;
+    void *arg = 0;
+
+    pthread_mutex_lock(&live_lock);
+    for (q = live; q; q = q->next)
+        if (q->id == (uintptr_t)sv.sival_ptr)
+            break;
+    // closed or unregistered since this notification fired: leave it be
+    if (q && q->fn)
+    {
+        fn = q->fn;
+        arg = q->arg;
+        q->busy++;
+    }
+    pthread_mutex_unlock(&live_lock);
+    if (!fn)
+        return;
+    /*
+     * One shot: register again first, then drain.  The other order would
+     * miss a message that arrives between the drain and the registration
+     * (the queue would not go from empty to non-empty again).  The price:
+     * a message landing while fn drains starts a second fn next to it.
+     */
+    arm(q);
+    in_fn = q;
+    fn(q, arg);
+    in_fn = 0;
+    pthread_mutex_lock(&live_lock);
+    if (--q->busy == 0)
+        pthread_cond_broadcast(&live_idle);
+    // fn closed q: every other fn is out (msgq_close waited), so this is the last
+    if (q->closing)
+    {
+        pthread_mutex_unlock(&live_lock);
+        destroy(q);
+        return;
+    }
+    pthread_mutex_unlock(&live_lock);
+}
+
+static int arm(struct msgq *q)
+{
+    struct sigevent se;
+
+    memset(&se, 0, sizeof(se));
+    se.sigev_notify = SIGEV_THREAD;
+    se.sigev_notify_function = trampoline;
+    se.sigev_value.sival_ptr = (void *)q->id;
+    return mq_notify(q->mq, &se);
+}
+
+int msgq_notify(struct msgq *q, void (*fn)(struct msgq *q, void *arg), void *arg)
+{
+    if (q->backend != MSGQ_POSIX)
+    {
+        errno = ENOSYS;
+        return -1;
+    }
+    pthread_mutex_lock(&live_lock);
+    if (!fn)
+    {
+        quiesce(q);
+        pthread_mutex_unlock(&live_lock);
+        // after the wait: a callback that was running may have renewed it
+        return mq_notify(q->mq, 0);
+    }
+    if (!q->id)
+    {
+        q->id = ++live_ids;
+        q->next = live;
+        live = q;
+    }
+    q->fn = fn;
+    q->arg = arg;
+    pthread_mutex_unlock(&live_lock);
+    return arm(q);
+}
@@ -0,0 +1,84 @@
+/*
+ * One message queue API over two kernels' queues.
+ *
+ * MSGQ_POSIX is mq_open() and friends: the descriptor is a file
+ * descriptor on Linux, so it goes into poll/epoll like a socket, and
+ * mq_notify() can announce the first message into an empty queue.
+ * MSGQ_SYSV is msgget(): no descriptor, no notification, kept for
+ * comparison with 02_SendMQ.c / 03_ReceiveMQ.c.
+ *
+ * Priorities mean the same on both: the highest prio waiting is
+ * delivered first, FIFO within one prio.  SysV gets that by storing prio
+ * p as mtype MSGQ_PRIO_MAX + 1 - p and receiving with msgtyp
+ * -(MSGQ_PRIO_MAX + 1), "lowest mtype first".  The kernel finds that by
+ * walking the whole queue on every receive, so a long SysV queue of
+ * small messages gets slow.
+ *
+ * msgq_drain() is the batched receive: everything already in the queue,
+ * up to the caller's limits, in one call and without blocking.  After a
+ * wakeup (epoll, notify) that replaces one receive/poll round per message.
+ */
+#ifndef MSGQ_H
+#define MSGQ_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define MSGQ_POSIX      0
+#define MSGQ_SYSV       1
+
+#define MSGQ_CREATE     1       // create if missing
+#define MSGQ_NONBLOCK   2       // send/recv fail with EAGAIN instead of waiting
+
+#define MSGQ_PRIO_MAX   32767   // highest prio, both backends
+
+struct msgq;
+
+struct msgq_msg {
+    char *data;                 // points into the drain buffer
+    size_t len;
+    unsigned prio;
+};
+
+/*
+ * name is "/something" for POSIX; for SysV it goes through ftok(name, 'q')
+ * and so must be an existing path ("/" is fine).  maxmsg and msgsize size
+ * a new queue (SysV: its byte limit becomes maxmsg * msgsize).
+ */
+struct msgq *msgq_open(const char *name, int backend, int flags, long maxmsg, long msgsize);
+void msgq_close(struct msgq *q);
+int msgq_unlink(struct msgq *q);
+
+int msgq_send(struct msgq *q, const void *p, size_t n, unsigned prio);
+ssize_t msgq_recv(struct msgq *q, void *p, size_t n, unsigned *prio);
+
+/*
+ * Receive what is queued right now into buf (cap bytes), one msgq_msg per
+ * message, at most max.  Returns the count, 0 when the queue was empty.
+ * buf needs room for at least one message of msgq_msgsize() bytes.
+ */
+int msgq_drain(struct msgq *q, char *buf, size_t cap, struct msgq_msg *m, int max);
+
+/* readable when a message is waiting; -1 for SysV */
+int msgq_fd(struct msgq *q);
+
+size_t msgq_msgsize(struct msgq *q);
+long msgq_count(struct msgq *q);
+
+/*
+ * fn(q, arg) runs on a thread of its own when a message arrives in an
+ * empty queue.  The registration is renewed before fn runs, so fn just
+ * drains.  That also means the next notification can start another fn
+ * while this one is still draining: fn must be safe to run concurrently
+ * with itself (no shared buffers, atomic counters).  POSIX only (ENOSYS
+ * for SysV); link with -lpthread.
+ *
+ * fn == 0 unregisters and returns once no fn is running any more (other
+ * than the caller, when fn itself unregisters).  msgq_close() waits the
+ * same way, so q and arg may go away as soon as either returns.  fn may
+ * close its own queue: q stays valid until that fn returns, then it is
+ * freed; fn must not touch q after msgq_close(q).
+ */
+int msgq_notify(struct msgq *q, void (*fn)(struct msgq *q, void *arg), void *arg);
+
+#endif
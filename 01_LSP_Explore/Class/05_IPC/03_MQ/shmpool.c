@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/syscall.h>
+#include "shmpool.h"
+
+#define POOL_MAGIC  0x6c6f6f70u     // "pool"
+#define NIL         0xffffffffu
+#define PAGE        4096ul
+
+// gen and refs in one word, so a release checks the one and drops the
+// other in the same CAS
+#define GEN(s)      ((uint32_t)((s) >> 32))
+#define REFS(s)     ((uint32_t)(s))
+#define STATE(g, r) ((uint64_t)(g) << 32 | (uint32_t)(r))
+
+struct slot_meta {
+    _Atomic uint64_t state;         // gen << 32 | refs
+    uint32_t next;                  // free list link
+    uint32_t pad;
+};
+
+// at the start of the segment; the slots follow, page aligned
+struct pool_hdr {
+    uint32_t magic, nslots;
+    uint64_t slotsize, data_off;
+    _Alignas(64) _Atomic uint64_t head;     // free list: tag << 32 | index
+    _Alignas(64) _Atomic uint32_t nfree;    // futex word
+    _Atomic uint32_t sleepers;
+    _Alignas(64) struct slot_meta meta[];
+};
+
+// the geometry is copied out of the header once it has been checked
+// against the segment: a peer scribbling on it later cannot move us
+// outside the mapping
+struct shmpool {
+    int shmid;
+    struct pool_hdr *h;
+    uint32_t nslots;
+    uint64_t slotsize, data_off;
+};
+
+static void push(struct pool_hdr *h, uint32_t i)
+{
+    uint64_t old = atomic_load(&h->head), new;
+
+    do {
+        h->meta[i].next = (uint32_t)old;
+        new = ((old >> 32) + 1) << 32 | i;
+    } while (!atomic_compare_exchange_weak(&h->head, &old, new));
+    atomic_fetch_add(&h->nfree, 1);
+    if (atomic_load(&h->sleepers))
+        syscall(SYS_futex, &h->nfree, FUTEX_WAKE, 1, 0, 0, 0);
+}
+
+static uint32_t pop(struct pool_hdr *h)
+{
+    uint64_t old = atomic_load(&h->head), new;
+    uint32_t i;
+
+    do {
+        i = (uint32_t)old;
+        if (i == NIL)
+            return NIL;
+        // a stale next is harmless: the tag makes that CAS fail
+        new = ((old >> 32) + 1) << 32 | h->meta[i].next;
+    } while (!atomic_compare_exchange_weak(&h->head, &old, new));
+    atomic_fetch_sub(&h->nfree, 1);
+    return i;
+}
+
+static struct shmpool *attach(int shmid)
+{
+    struct shmpool *p;
+    void *a = shmat(shmid, 0, 0);
+
+    if (a == (void *)-1)
+        return 0;
+    p = malloc(sizeof(*p));
+    if (!p)
+    {
+        shmdt(a);
+        return 0;
+    }
+    p->shmid = shmid;
+    p->h = a;
+    return p;
+}
+
+struct shmpool *shmpool_create(unsigned nslots, size_t slotsize)
+{
+    struct shmpool *p;
+    struct pool_hdr *h;
+    size_t hdr;
+    unsigned i;
+    int id;
+
+    if (nslots == 0 || nslots >= NIL)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+    slotsize = (slotsize + PAGE - 1) & ~(PAGE - 1);
+    hdr = (sizeof(*h) + nslots * sizeof(h->meta[0]) + PAGE - 1) & ~(PAGE - 1);
+    id = shmget(IPC_PRIVATE, hdr + nslots * slotsize, IPC_CREAT | 0600);
+    if (id < 0 || !(p = attach(id)))
+        return 0;
+    h = p->h;
+    h->magic = POOL_MAGIC;
+    h->nslots = nslots;
+    h->slotsize = slotsize;
+    h->data_off = hdr;
+    p->nslots = nslots;
+    p->slotsize = slotsize;
+    p->data_off = hdr;
+    atomic_store(&h->head, NIL);
+    for (i = nslots; i-- > 0; )
+        push(h, i);
+    return p;
+}
+
+struct shmpool *shmpool_attach(int shmid)
+{
+    struct shmid_ds ds;
+    struct pool_hdr *h;
+    struct shmpool *p;
+    uint64_t meta;
+
+    if (shmctl(shmid, IPC_STAT, &ds) < 0)
+        return 0;
+    if (ds.shm_segsz < sizeof(*h))
+        goto foreign;
+    if (!(p = attach(shmid)))
+        return 0;
+    h = p->h;
+    // not ours, or a header that points past the segment: refuse it
+    meta = sizeof(*h) + (uint64_t)h->nslots * sizeof(h->meta[0]);
+    if (h->magic != POOL_MAGIC || h->nslots == 0 || h->nslots >= NIL ||
+        h->slotsize == 0 || h->slotsize % PAGE || h->data_off < meta ||
+        h->data_off > ds.shm_segsz ||
+        h->slotsize > (ds.shm_segsz - h->data_off) / h->nslots)
+    {
+        shmpool_detach(p);
+        goto foreign;
+    }
+    p->nslots = h->nslots;
+    p->slotsize = h->slotsize;
+    p->data_off = h->data_off;
+    return p;
+
+foreign:
+    errno = EINVAL;
+    return 0;
+}
+
+int shmpool_id(struct shmpool *p)
+{
+    return p->shmid;
+}
+
+void shmpool_detach(struct shmpool *p)
+{
+    shmdt(p->h);
+    free(p);
+}
+
+int shmpool_destroy(struct shmpool *p)
+{
+    return shmctl(p->shmid, IPC_RMID, 0);
+}
+
+size_t shmpool_slotsize(struct shmpool *p)
+{
+    return p->slotsize;
+}
+
+unsigned shmpool_nfree(struct shmpool *p)
+{
+    return atomic_load(&p->h->nfree);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int shmpool_alloc(struct shmpool *p, unsigned refs, struct shmpool_desc *d, int timeout_ms)
+{
+    struct pool_hdr *h = p->h;
+    double end = now() + timeout_ms / 1e3, left;
+    struct timespec ts;
+    uint32_t i;
+
+    if (refs == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    while ((i = pop(h)) == NIL || i >= p->nslots)
+    {
+        if (i != NIL)
+        {
+            errno = EINVAL;     // the free list points outside the pool
+            return -1;
+        }
+        left = end - now();
+        if (timeout_ms >= 0 && left <= 0)
+        {
+            // a receiver that died holding references never gives them back
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        ts.tv_sec = left;
+        ts.tv_nsec = (left - ts.tv_sec) * 1e9;
+        // sleep only while nfree is 0; a push in between changes it
+        atomic_fetch_add(&h->sleepers, 1);
+        if (atomic_load(&h->nfree) == 0)
+            syscall(SYS_futex, &h->nfree, FUTEX_WAIT, 0, timeout_ms < 0 ? 0 : &ts, 0, 0);
+        atomic_fetch_sub(&h->sleepers, 1);
+    }
+    // free, so refs is 0 and nobody else can change the word
+    d->gen = GEN(atomic_load(&h->meta[i].state));
+    atomic_store(&h->meta[i].state, STATE(d->gen, refs));
+    d->slot = i;
+    d->len = 0;
+    return 0;
+}
+
+static struct slot_meta *check(struct shmpool *p, const struct shmpool_desc *d)
+{
+    struct slot_meta *m;
+    uint64_t s;
+
+    if (d->slot >= p->nslots || d->len > p->slotsize)
+        return 0;
+    m = &p->h->meta[d->slot];
+    s = atomic_load(&m->state);
+    if (GEN(s) != d->gen || REFS(s) == 0)
+        return 0;
+    return m;
+}
+
+void *shmpool_data(struct shmpool *p, const struct shmpool_desc *d)
+{
+    if (!check(p, d))
+        return 0;
+    return (char *)p->h + p->data_off + (size_t)d->slot * p->slotsize;
+}
+
+/*
+ * Checking gen and dropping the reference is one CAS: a duplicated
+ * descriptor racing the last release either gets in first (and is just
+ * one of the refs) or sees the new generation, never a slot that has
+ * been freed and handed out again.
+ */
+int shmpool_release(struct shmpool *p, const struct shmpool_desc *d)
+{
+    struct slot_meta *m = check(p, d);
+    uint64_t s, next;
+
+    if (!m)
+    {
+        errno = ESTALE;
+        return -1;
+    }
+    s = atomic_load(&m->state);
+    do {
+        if (GEN(s) != d->gen || REFS(s) == 0)
+        {
+            errno = ESTALE;
+            return -1;
+        }
+        // last reference: new generation, no refs
+        next = REFS(s) == 1 ? STATE(d->gen + 1, 0) : s - 1;
+    } while (!atomic_compare_exchange_weak(&m->state, &s, next));
+    if (REFS(next) == 0)
+        push(p->h, d->slot);
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Fixed-size slots in one SysV shared memory segment, for messages too
+ * big for a queue.
+ *
+ * The payload is written once into a slot; only a descriptor (slot,
+ * len, gen) travels through the message queue, and the receiver reads
+ * the payload where it lies.  A slot carries a reference count, one per
+ * receiver the descriptor went to; each receiver's shmpool_release() is
+ * its acknowledgement, and the last one puts the slot back on the free
+ * list.  The generation goes up every time a slot is freed, so a stale
+ * or duplicated descriptor is refused instead of reading someone else's
+ * message.
+ *
+ * The free list is a lock-free stack in the segment (index + ABA tag in
+ * one 64-bit word); a sender that finds it empty sleeps on a futex in
+ * the segment until a slot comes back.
+ */
+#ifndef SHMPOOL_H
+#define SHMPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct shmpool;
+
+struct shmpool_desc {
+    uint32_t slot;
+    uint32_t len;
+    uint32_t gen;
+};
+
+/* a new private segment; slotsize is rounded up to whole pages */
+struct shmpool *shmpool_create(unsigned nslots, size_t slotsize);
+/*
+ * attach a pool another process created; EINVAL when the segment is not
+ * a pool or its header does not fit the segment
+ */
+struct shmpool *shmpool_attach(int shmid);
+int shmpool_id(struct shmpool *p);
+void shmpool_detach(struct shmpool *p);
+/* mark the segment for removal once everybody has detached */
+int shmpool_destroy(struct shmpool *p);
+
+size_t shmpool_slotsize(struct shmpool *p);
+unsigned shmpool_nfree(struct shmpool *p);
+
+/*
+ * Take a free slot with refs references, waiting up to timeout_ms for one
+ * (-1: no limit).  Fills d->slot and d->gen; the caller sets d->len.  0
+ * ok, -1 with ETIMEDOUT when none came back in time, which is also what
+ * a receiver that died holding references looks like.
+ */
+int shmpool_alloc(struct shmpool *p, unsigned refs, struct shmpool_desc *d, int timeout_ms);
+
+/* the payload of d, or 0 when d is stale (wrong gen, freed, bad slot) */
+void *shmpool_data(struct shmpool *p, const struct shmpool_desc *d);
+
+/* drop one reference: the ack; -1 for a stale d */
+int shmpool_release(struct shmpool *p, const struct shmpool_desc *d);
+
+#endif
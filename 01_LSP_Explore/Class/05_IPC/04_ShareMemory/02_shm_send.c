@@ -1,37 +1,42 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
-#include <sys/shm.h>
+#include <sys/ipc.h>
+#include "shmring.h"
+
+// Build: gcc 02_shm_send.c shmring.c -o send
+// Key 6, not 5: 01_shmget.c's 50-byte segment keeps key 5.
+#define KEY     6
 
 int main() {
-    int id;
-    char *p;
+    struct shmring *r;
+    char line[256];
 
-    // Create or get a shared memory segment with key = 5 and size = 50 bytes
-    id = shmget(5, 50, IPC_CREAT | 0666);
-    if (id < 0) {
-        perror("shmget");
+    // Create or attach a ring of 64 messages of up to 256 bytes
+    r = shmring_open(KEY, 64, sizeof(line));
+    if (r == NULL) {
+        perror("shmring_open");
         return 1;
     }
 
-    printf("Shared Memory ID = %d\n", id);
-
-    // Attach the shared memory segment to the process
-    p = (char *)shmat(id, NULL, 0);
-    if (p == (char *)(-1)) {
-        perror("shmat");
-        return 1;
+    // Every line is one message; the receiver gets them in order, and
+    // this blocks only while the ring is full (receiver not keeping up)
+    printf("Enter the data (Ctrl-D to end):\n");
+    while (fgets(line, sizeof(line), stdin)) {
+        line[strcspn(line, "\n")] = 0;
+        if (line[0] == 0)
+            continue;
+        if (shmring_send(r, line, strlen(line) + 1) < 0) {
+            perror("shmring_send");
+            return 1;
+        }
     }
 
-    // Loop to continuously write data into shared memory
-    //while (1) {
-        printf("Enter the data: ");
-        scanf("%s", p);  // Data written directly to shared memory
-        printf("Data written directly to shared memory\n");
-        //}
-
-    // (Unreachable in this case, but good practice to include)
-    shmdt(p);  // Detach the shared memory
+    // An empty message: the end
+    shmring_send(r, "", 0);
+    printf("Data written to shared memory\n");
 
+    shmring_close(r);  // Detach; the receiver removes the segment
     return 0;
 }
@@ -1,35 +1,31 @@
 #include <stdio.h>
-#include <stdlib.h>      // For exit()
-#include <unistd.h>      // For sleep()
+#include <stdlib.h>
 #include <sys/types.h>
-#include <sys/shm.h>
+#include <sys/ipc.h>
+#include "shmring.h"
+
+// Build: gcc 03_shm_receive.c shmring.c -o receive
+#define KEY     6
 
 int main() {
-    int id;
-    char *p;
+    struct shmring *r;
+    char buf[256];
+    ssize_t n;
 
-    // Create or get a shared memory segment with key 5 and size 50 bytes
-    id = shmget(5, 50, IPC_CREAT | 0666);
-    if (id < 0) {
-        perror("shmget");  // Print error if shmget fails
+    // Create or attach the same ring as 02_shm_send.c, whichever starts first
+    r = shmring_open(KEY, 64, sizeof(buf));
+    if (r == NULL) {
+        perror("shmring_open");
         exit(1);
     }
 
-    //while (1) {
-        printf("Shared Memory ID = %d\n", id);
-
-        // Attach the shared memory to process address space
-        p = shmat(id, NULL, 0);
-        if (p == (char *)-1) {
-            perror("shmat");
-            exit(1);
-        }
-
-        // Print the content from shared memory
-        printf("Data from shared memory: %s\n", p);
-
-        sleep(2);  // Sleep added to avoid spamming output
-    //}
+    // Sleeps on a futex while the ring is empty: no polling, no sleep(2),
+    // and every message is printed exactly once
+    while ((n = shmring_recv(r, buf, sizeof(buf))) > 0)
+        printf("Data from shared memory: %s\n", buf);
 
+    // The empty message ends it; remove the segment
+    shmring_destroy(r);
+    shmring_close(r);
     return 0;
 }
@@ -0,0 +1,189 @@
+/*
+🔁 4. SPSC Ring Throughput: small messages between two pinned processes
+==========================================================
+Scenario:
+02_shm_send.c / 03_shm_receive.c move one line at a time through
+shmring.h.  This one measures the ring itself.  A forked producer and a
+forked consumer are pinned (-c producer,consumer CPUs) and move -n
+messages of -s bytes; each message carries its sequence number, which
+the consumer checks.  The parent only watches: a consumer that dies
+takes the producer with it instead of leaving it on a full ring.
+
+For every -b batch size the producer hands shmring_sendv() that many
+messages at once, and the consumer takes up to that many per
+shmring_recvv() / shmring_release().  With -b 1 every message is
+published (release store + fence) and acknowledged on its own.
+"sleeps" counts how often a side found the ring full or empty for longer
+than its spin and slept on the futex.  On two cores that should stay
+near zero.  On one core every sleep is the switch to the other side.
+
+Build: gcc -O2 04_RingBench.c shmring.c -o ringbench
+Run:   ./ringbench [-n messages] [-s size] [-k slots] [-b 1,16,256] [-c 0,1]
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include "shmring.h"
+
+#define MAXBATCH  4096
+#define MAXLIST   8
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void pin(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+        perror("sched_setaffinity");
+}
+
+static void consumer(struct shmring *r, long n, int batch)
+{
+    static struct shmring_msg m[MAXBATCH];
+    uint64_t seq;
+    long got = 0;
+    int k, i;
+
+    while (got < n)
+    {
+        k = shmring_recvv(r, m, batch);
+        for (i = 0; i < k; i++, got++)
+        {
+            memcpy(&seq, m[i].data, sizeof(seq));
+            if (seq != (uint64_t)got)
+                _exit(2);
+        }
+        shmring_release(r, k);
+    }
+    _exit(0);
+}
+
+static void run(long n, int size, unsigned slots, int batch, int pcpu, int ccpu)
+{
+    static struct iovec v[MAXBATCH];
+    uint64_t psleeps, csleeps;
+    struct shmring *r = shmring_open(IPC_PRIVATE, slots, size);
+    char *buf;
+    long i;
+    int k, j, st;
+    pid_t cons, prod;
+    double t;
+
+    if (!r)
+    {
+        perror("shmring_open");
+        exit(1);
+    }
+    buf = calloc(batch, size);
+    for (j = 0; j < batch; j++)
+    {
+        v[j].iov_base = buf + (size_t)j * size;
+        v[j].iov_len = size;
+    }
+    t = now();
+    if ((cons = fork()) == 0)
+    {
+        pin(ccpu);
+        consumer(r, n, batch);
+    }
+    // the producer is a child too: if the consumer dies (a bad sequence
+    // number, a crash), the producer would wait on a full ring forever
+    if ((prod = fork()) == 0)
+    {
+        pin(pcpu);
+        for (i = 0; i < n; i += k)
+        {
+            k = n - i < batch ? n - i : batch;
+            for (j = 0; j < k; j++)
+            {
+                uint64_t seq = i + j;
+
+                memcpy(v[j].iov_base, &seq, sizeof(seq));
+            }
+            shmring_sendv(r, v, k);
+        }
+        _exit(0);
+    }
+    waitpid(cons, &st, 0);
+    if (!WIFEXITED(st) || WEXITSTATUS(st) != 0)
+        kill(prod, SIGKILL);
+    waitpid(prod, 0, 0);
+    t = now() - t;
+    shmring_sleeps(r, &psleeps, &csleeps);
+    printf("%6d %12.0f %9.1f %10llu %10llu%s\n", batch, n / t, n * (double)size / t / 1e6,
+           (unsigned long long)psleeps, (unsigned long long)csleeps,
+           WIFEXITED(st) && WEXITSTATUS(st) == 0 ? "" :
+           WIFEXITED(st) && WEXITSTATUS(st) == 2 ? "  (out of order!)" : "  (consumer died)");
+    fflush(stdout);
+    shmring_destroy(r);
+    shmring_close(r);
+    free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    int list[MAXLIST] = { 1, 16, 256 }, nl = 3, size = 16, opt, i, pcpu = 0, ccpu = 1;
+    long n = 20000000;
+    unsigned slots = 4096;
+    char *tok;
+
+    while ((opt = getopt(argc, argv, "n:s:k:b:c:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': n = atol(optarg); break;
+        case 's': size = atoi(optarg); break;
+        case 'k': slots = atoi(optarg); break;
+        case 'b':
+            for (nl = 0, tok = strtok(optarg, ","); tok && nl < MAXLIST; tok = strtok(0, ","))
+                list[nl++] = atoi(tok);
+            break;
+        case 'c':
+            if (sscanf(optarg, "%d,%d", &pcpu, &ccpu) != 2)
+                goto usage;
+            break;
+        default:
+            goto usage;
+        }
+    }
+    if (n < 1 || size < 8 || slots < 1 || nl < 1)
+        goto usage;
+    for (i = 0; i < nl; i++)
+        if (list[i] < 1 || list[i] > MAXBATCH)
+            goto usage;
+    if (ccpu >= sysconf(_SC_NPROCESSORS_ONLN))
+    {
+        fprintf(stderr, "only %ld CPU(s): both sides on CPU %d\n", sysconf(_SC_NPROCESSORS_ONLN), pcpu);
+        ccpu = pcpu;
+    }
+
+    printf("%ld messages of %d bytes, %u slots, producer on CPU %d, consumer on CPU %d\n",
+           n, size, slots, pcpu, ccpu);
+    printf("%6s %12s %9s %10s %10s\n", "batch", "msgs/s", "MB/s", "p sleeps", "c sleeps");
+    for (i = 0; i < nl; i++)
+        run(n, size, slots, list[i], pcpu, ccpu);
+    return 0;
+
+usage:
+    fprintf(stderr, "usage:./a.out [-n messages] [-s size>=8] [-k slots] [-b 1,16,256] [-c pcpu,ccpu]\n");
+    return 1;
+}
@@ -0,0 +1,179 @@
+/*
+🔀 5. MPMC Queue Scaling: many producer and consumer processes, one segment
+==========================================================
+Scenario:
+shmring.h is one sender and one receiver.  shmq.h lets any number of
+processes send and receive through one segment without a lock.  Here k
+producer and k consumer processes share one queue for every k in -p
+(default 1, 2, 4, ... up to the number of CPUs).  The producers split -n
+messages of -s bytes between them, each message carries its number, and
+the consumers add up how many they got and the sum of the numbers.  A
+run is "ok" only if every message arrived exactly once.
+
+-x first forks a producer that reserves a slot and exits without
+committing it, as if it were killed mid-message.  The queue must still
+deliver everything: the first process that waits on that slot finds the
+owner gone, turns the slot into a tombstone, and the consumers skip it
+("recovered").
+
+Build: gcc -O2 05_MPMCBench.c shmq.c -o mpmcbench
+Run:   ./mpmcbench [-n messages] [-s size] [-k slots] [-p 1,2,4] [-x]
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "shmq.h"
+
+#define MAXLIST   16
+
+struct cstat {
+    uint64_t count, sum;
+    char pad[48];       // one cache line per consumer
+};
+
+static struct cstat *cs;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void producer(struct shmq *q, int j, int k, long n, int size)
+{
+    char *msg = calloc(1, size);
+    uint64_t id;
+
+    for (id = j; id < (uint64_t)n; id += k)
+    {
+        memcpy(msg, &id, sizeof(id));
+        shmq_send(q, msg, size);
+    }
+    _exit(0);
+}
+
+static void consumer(struct shmq *q, int j, int size)
+{
+    char *msg = malloc(size);
+    uint64_t id;
+
+    // an empty message is the end
+    while (shmq_recv(q, msg, size) > 0)
+    {
+        memcpy(&id, msg, sizeof(id));
+        cs[j].count++;
+        cs[j].sum += id;
+    }
+    _exit(0);
+}
+
+static void run(int k, long n, int size, unsigned slots, int dead)
+{
+    struct shmq *q = shmq_open(IPC_PRIVATE, slots, size);
+    struct shmq_stats st;
+    uint64_t count = 0, sum = 0;
+    pid_t *prod = calloc(k, sizeof(*prod)), pid;
+    int j;
+    double t;
+
+    if (!q)
+    {
+        perror("shmq_open");
+        exit(1);
+    }
+    if (dead)
+    {
+        // dies holding a reserved slot; reaped at once, so the pid is gone
+        if ((pid = fork()) == 0)
+        {
+            shmq_reserve(q);
+            _exit(0);
+        }
+        waitpid(pid, 0, 0);
+    }
+    memset(cs, 0, k * sizeof(*cs));
+
+    t = now();
+    for (j = 0; j < k; j++)
+        if (fork() == 0)
+            consumer(q, j, size);
+    for (j = 0; j < k; j++)
+        if ((prod[j] = fork()) == 0)
+            producer(q, j, k, n, size);
+    for (j = 0; j < k; j++)
+        waitpid(prod[j], 0, 0);
+    for (j = 0; j < k; j++)
+        shmq_send(q, "", 0);
+    while (wait(0) > 0)
+        ;
+    t = now() - t;
+
+    for (j = 0; j < k; j++)
+    {
+        count += cs[j].count;
+        sum += cs[j].sum;
+    }
+    shmq_getstats(q, &st);
+    printf("%4d %12.0f %10llu %9llu  %s\n", k, n / t, (unsigned long long)st.sleeps,
+           (unsigned long long)st.recovered,
+           count == (uint64_t)n && sum == (uint64_t)n * (n - 1) / 2 ? "ok" : "LOST OR DUPLICATED");
+    fflush(stdout);
+    shmq_destroy(q);
+    shmq_close(q);
+    free(prod);
+}
+
+int main(int argc, char **argv)
+{
+    int list[MAXLIST], nl = 0, size = 16, opt, i, dead = 0;
+    long n = 4000000, ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned slots = 1024;
+    char *tok;
+
+    for (i = 1; i < ncpu && nl < MAXLIST - 1; i <<= 1)
+        list[nl++] = i;
+    list[nl++] = ncpu;
+    while ((opt = getopt(argc, argv, "n:s:k:p:x")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': n = atol(optarg); break;
+        case 's': size = atoi(optarg); break;
+        case 'k': slots = atoi(optarg); break;
+        case 'p':
+            for (nl = 0, tok = strtok(optarg, ","); tok && nl < MAXLIST; tok = strtok(0, ","))
+                list[nl++] = atoi(tok);
+            break;
+        case 'x': dead = 1; break;
+        default:
+            goto usage;
+        }
+    }
+    if (n < 1 || size < 8 || slots < 1 || nl < 1)
+        goto usage;
+    for (i = 0; i < nl; i++)
+        if (list[i] < 1 || list[i] > 4096)
+            goto usage;
+
+    cs = mmap(0, 4096 * sizeof(*cs), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    printf("%ld messages of %d bytes, %u slots, %ld CPU(s)%s\n", n, size, slots, ncpu,
+           dead ? ", a dead producer holding a slot" : "");
+    printf("%4s %12s %10s %9s  %s\n", "k", "msgs/s", "sleeps", "recovered", "k producers + k consumers");
+    for (i = 0; i < nl; i++)
+        run(list[i], n, size, slots, dead);
+    return 0;
+
+usage:
+    fprintf(stderr, "usage:./a.out [-n messages] [-s size>=8] [-k slots] [-p 1,2,4] [-x]\n");
+    return 1;
+}
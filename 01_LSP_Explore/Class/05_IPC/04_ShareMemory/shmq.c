@@ -0,0 +1,319 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/syscall.h>
+#include "shmq.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "the futex waits on the low half of the slot word"
+#endif
+
+#define Q_MAGIC     0x71636d70u     // "pmcq"
+#define SPIN        128
+#define CHECK_NS    20000000        // how long a sleeper waits before checking the owner
+#define ATTACH_MS   1000            // how long to wait for another creator's header
+
+// owner half of a slot word
+#define READING     0x80000000u     // | pid: a consumer is copying out
+#define DEAD        0x40000000u     // tombstone of a dead producer
+#define WAITED      0x20000000u     // somebody sleeps on this slot: wake on change
+
+#define SEQ(w)      ((uint32_t)(w))
+#define OWNER(w)    ((uint32_t)((w) >> 32) & ~WAITED)
+#define WORD(s, o)  ((uint64_t)(o) << 32 | (uint32_t)(s))
+
+struct slot {
+    _Atomic uint64_t w;             // owner << 32 | seq
+    uint32_t len;
+    char data[];
+};
+
+struct q_hdr {
+    uint32_t nslots, stride, msgsize;
+    _Atomic uint32_t magic;
+    _Alignas(64) _Atomic uint32_t enq;
+    _Alignas(64) _Atomic uint32_t deq;
+    _Alignas(64) _Atomic uint64_t sleeps, recovered;
+    _Alignas(64) char slots[];
+};
+
+struct shmq {
+    int shmid;
+    struct q_hdr *h;
+    uint32_t mask;
+    uint32_t rpos;                  // the reserved slot
+};
+
+// getpid() per claim is a syscall: cache it, and again in fork()ed children
+static pid_t mypid;
+
+static void refresh_pid(void)
+{
+    mypid = getpid();
+}
+
+static struct slot *slot_at(struct shmq *q, uint32_t pos)
+{
+    return (struct slot *)(q->h->slots + (size_t)(pos & q->mask) * q->h->stride);
+}
+
+static void wake(struct slot *s)
+{
+    syscall(SYS_futex, (uint32_t *)&s->w, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+}
+
+struct shmq *shmq_open(key_t key, unsigned nslots, unsigned msgsize)
+{
+    struct shmq *q;
+    struct q_hdr *h;
+    struct shmid_ds ds;
+    unsigned n = 2, stride, i;
+    int id, created = 1, ms;
+
+    // at least two: with one slot a consumer's READING state (seq p + 1)
+    // looks like "claimed already" to the producer at p + 1
+    while (n < nslots)
+        n <<= 1;
+    if (n > 1u << 30 || msgsize == 0)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+    stride = (sizeof(struct slot) + msgsize + 63) & ~63u;   // no two slots share a line
+    id = shmget(key, sizeof(*h) + (size_t)n * stride, IPC_CREAT | IPC_EXCL | 0666);
+    if (id < 0 && errno == EEXIST)
+    {
+        created = 0;
+        id = shmget(key, 0, 0);
+    }
+    if (id < 0 || shmctl(id, IPC_STAT, &ds) < 0)
+        return 0;
+    if (ds.shm_segsz < sizeof(*h))
+        goto foreign;
+    h = shmat(id, 0, 0);
+    if (h == (void *)-1)
+        return 0;
+    if (!created)
+    {
+        // the creator may still be filling in the header; a segment that
+        // never gets the magic, or is too small for its header, is not a queue
+        for (ms = 0; atomic_load_explicit(&h->magic, memory_order_acquire) != Q_MAGIC; ms++)
+        {
+            if (ms == ATTACH_MS)
+                goto bad;
+            usleep(1000);
+        }
+        if (h->nslots < 2 || (h->nslots & (h->nslots - 1)) || h->stride < sizeof(struct slot) + h->msgsize ||
+            ds.shm_segsz < sizeof(*h) + (size_t)h->nslots * h->stride)
+            goto bad;
+    }
+    q = calloc(1, sizeof(*q));
+    q->shmid = id;
+    q->h = h;
+    if (created)
+    {
+        h->nslots = n;
+        h->stride = stride;
+        h->msgsize = msgsize;
+        q->mask = n - 1;
+        for (i = 0; i < n; i++)
+            atomic_store_explicit(&slot_at(q, i)->w, WORD(i, 0), memory_order_relaxed);
+        atomic_store_explicit(&h->magic, Q_MAGIC, memory_order_release);
+    }
+    else
+        q->mask = h->nslots - 1;
+    if (mypid == 0)
+    {
+        refresh_pid();
+        pthread_atfork(0, 0, refresh_pid);
+    }
+    return q;
+
+bad:
+    shmdt(h);
+foreign:
+    errno = EINVAL;
+    return 0;
+}
+
+void shmq_close(struct shmq *q)
+{
+    shmdt(q->h);
+    free(q);
+}
+
+int shmq_destroy(struct shmq *q)
+{
+    return shmctl(q->shmid, IPC_RMID, 0);
+}
+
+unsigned shmq_msgsize(struct shmq *q)
+{
+    return q->h->msgsize;
+}
+
+void shmq_getstats(struct shmq *q, struct shmq_stats *st)
+{
+    st->sleeps = atomic_load(&q->h->sleeps);
+    st->recovered = atomic_load(&q->h->recovered);
+}
+
+/*
+ * The slot has been in state w for a while: if its owner is gone, put
+ * it where the owner would have left it, as far as that is known.
+ */
+static void recover(struct shmq *q, struct slot *s, uint64_t w)
+{
+    uint32_t own = OWNER(w), seq = SEQ(w);
+    pid_t pid = own & ~READING;
+
+    if (own == 0 || own == DEAD || kill(pid, 0) == 0 || errno != ESRCH)
+        return;
+    if (atomic_compare_exchange_strong(&s->w, &w, own & READING ?
+                                       WORD(seq - 1 + q->h->nslots, 0) :    // freed; the message is lost
+                                       WORD(seq + 1, DEAD)))                // full of nothing: skipped
+    {
+        atomic_fetch_add(&q->h->recovered, 1);
+        wake(s);
+    }
+}
+
+/*
+ * Nothing to do at pos: sleep until slot s leaves state w.  WAITED goes
+ * into the slot word with a CAS on exactly that state; every later
+ * change of the word either keeps the bit (a claim) or swaps the word
+ * and sees it (hand_over, recover), so the wake is not lost, and only
+ * this slot's sleepers are woken.  The sleep is bounded so that a dead
+ * owner gets noticed.
+ */
+static void wait_slot(struct shmq *q, struct slot *s, uint64_t w, _Atomic uint32_t *pos_word, uint32_t pos)
+{
+    struct timespec ts = { 0, CHECK_NS };
+    int i;
+
+    for (i = 0; i < SPIN; i++)
+    {
+        if (atomic_load_explicit(&s->w, memory_order_relaxed) != w ||
+            atomic_load_explicit(pos_word, memory_order_relaxed) != pos)
+            return;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    if (!(w >> 32 & WAITED) && !atomic_compare_exchange_strong(&s->w, &w, w | WORD(0, WAITED)))
+        return;
+    w |= WORD(0, WAITED);
+    atomic_fetch_add_explicit(&q->h->sleeps, 1, memory_order_relaxed);
+    if (syscall(SYS_futex, (uint32_t *)&s->w, FUTEX_WAIT, SEQ(w), &ts, 0, 0) < 0 && errno == ETIMEDOUT)
+        recover(q, s, w);
+}
+
+// the slot's next state; wake whoever sleeps on it
+static void hand_over(struct slot *s, uint64_t w)
+{
+    if (atomic_exchange(&s->w, w) >> 32 & WAITED)
+        wake(s);
+}
+
+//////////////////////////////////////////////////////////////
+
+void *shmq_reserve(struct shmq *q)
+{
+    struct q_hdr *h = q->h;
+    struct slot *s;
+    uint32_t pos, cur;
+    uint64_t w;
+    int32_t dif;
+
+    for (;;)
+    {
+        pos = atomic_load_explicit(&h->enq, memory_order_relaxed);
+        s = slot_at(q, pos);
+        w = atomic_load_explicit(&s->w, memory_order_acquire);
+        dif = (int32_t)(SEQ(w) - pos);
+        if (dif == 0 && OWNER(w) == 0)
+        {
+            // the claim is this CAS (sleepers stay marked); moving enq on is a courtesy
+            if (atomic_compare_exchange_weak(&s->w, &w, w | WORD(0, mypid)))
+            {
+                cur = pos;
+                atomic_compare_exchange_strong(&h->enq, &cur, pos + 1);
+                q->rpos = pos;
+                return s->data;
+            }
+        }
+        else if (dif >= 0)
+            atomic_compare_exchange_strong(&h->enq, &pos, pos + 1);    // claimed already: help
+        else
+            wait_slot(q, s, w, &h->enq, pos);                           // full
+    }
+}
+
+void shmq_commit(struct shmq *q, size_t n)
+{
+    struct slot *s = slot_at(q, q->rpos);
+
+    s->len = n;
+    hand_over(s, WORD(q->rpos + 1, 0));
+}
+
+int shmq_send(struct shmq *q, const void *p, size_t n)
+{
+    if (n > q->h->msgsize)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    memcpy(shmq_reserve(q), p, n);
+    shmq_commit(q, n);
+    return 0;
+}
+
+ssize_t shmq_recv(struct shmq *q, void *p, size_t n)
+{
+    struct q_hdr *h = q->h;
+    struct slot *s;
+    uint32_t pos, own, cur;
+    uint64_t w;
+    int32_t dif;
+
+    for (;;)
+    {
+        pos = atomic_load_explicit(&h->deq, memory_order_relaxed);
+        s = slot_at(q, pos);
+        w = atomic_load_explicit(&s->w, memory_order_acquire);
+        dif = (int32_t)(SEQ(w) - (pos + 1));
+        own = OWNER(w);
+        if (dif == 0 && (own == 0 || own == DEAD))
+        {
+            if (!atomic_compare_exchange_weak(&s->w, &w, (w & WORD(0, WAITED)) | WORD(pos + 1, mypid | READING)))
+                continue;
+            cur = pos;
+            atomic_compare_exchange_strong(&h->deq, &cur, pos + 1);
+            if (own == DEAD)
+            {
+                hand_over(s, WORD(pos + h->nslots, 0));
+                continue;
+            }
+            if (n > s->len)
+                n = s->len;
+            memcpy(p, s->data, n);
+            hand_over(s, WORD(pos + h->nslots, 0));
+            return n;
+        }
+        else if (dif >= 0)
+            atomic_compare_exchange_strong(&h->deq, &pos, pos + 1);    // taken already: help
+        else
+            wait_slot(q, s, w, &h->deq, pos);                           // empty or being written
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * A bounded multi-producer, multi-consumer message queue in a SysV
+ * shared memory segment, for any number of processes on each side.
+ *
+ * It is Vyukov's bounded queue with one 64-bit word per slot: a 32-bit
+ * sequence number that says whose turn the slot is (producer for lap
+ * position p when it equals p, consumer when it equals p + 1) and the
+ * pid of the process working on the slot right now.  A process claims a
+ * slot with one compare-and-swap on that word, and the enqueue/dequeue
+ * positions are hints that anybody moves forward.  Nobody takes a lock.
+ *
+ * Because the claim records a pid, a process that dies in the middle
+ * cannot wedge the queue.  A process that has waited on the slot for a
+ * while checks the owner with kill(pid, 0) and, if it is gone, repairs
+ * the slot:
+ *   - a producer that died after shmq_reserve() leaves a tombstone, and
+ *     the consumers skip it;
+ *   - a consumer that died while copying out gives the slot back to the
+ *     producers, and the message is lost.
+ * (A recycled pid looks alive: such a slot waits until that process
+ * exits.)
+ *
+ * Empty and full sleep on a futex on the slot's sequence number.  A
+ * sleeper marks the slot word first, so a wake syscall is made only for
+ * a slot somebody actually sleeps on.
+ */
+#ifndef SHMQ_H
+#define SHMQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+struct shmq;
+
+struct shmq_stats {
+    uint64_t sleeps;        // futex waits, both sides
+    uint64_t recovered;     // slots taken back from dead processes
+};
+
+/*
+ * Create the queue for key, or attach it (nslots and msgsize then come
+ * from the segment).  IPC_PRIVATE always creates: for fork()ed users.
+ * nslots is rounded up to a power of two, at least 2.  A segment at key
+ * that is not a queue (too small for its header, or still without one
+ * after a second) gives EINVAL.
+ */
+struct shmq *shmq_open(key_t key, unsigned nslots, unsigned msgsize);
+void shmq_close(struct shmq *q);
+int shmq_destroy(struct shmq *q);
+
+unsigned shmq_msgsize(struct shmq *q);
+void shmq_getstats(struct shmq *q, struct shmq_stats *st);
+
+/* one message, waiting while the queue is full.  -1 EMSGSIZE */
+int shmq_send(struct shmq *q, const void *p, size_t n);
+
+/*
+ * The same in two steps, without a copy: a slot to write up to
+ * shmq_msgsize() bytes into, then the commit that hands it to the
+ * consumers.  One reservation per handle at a time.
+ */
+void *shmq_reserve(struct shmq *q);
+void shmq_commit(struct shmq *q, size_t n);
+
+/* one message, waiting while the queue is empty.  Its length */
+ssize_t shmq_recv(struct shmq *q, void *p, size_t n);
+
+#endif
@@ -0,0 +1,292 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/syscall.h>
+#include "shmring.h"
+
+#define RING_MAGIC  0x676e6972u     // "ring"
+#define SPIN        256
+#define ATTACH_MS   1000            // how long to wait for another creator's header
+
+struct slot {
+    uint32_t len;
+    char data[];
+};
+
+struct ring_hdr {
+    uint32_t nslots, slotsize;
+    _Atomic uint32_t magic;                 // set last: the ring is ready
+    _Alignas(64) _Atomic uint32_t head;     // producer's line
+    _Alignas(64) _Atomic uint32_t tail;     // consumer's line
+    // rarely written, so reading them stays cheap for the other side
+    _Alignas(64) _Atomic uint32_t empty_wait, full_wait;
+    _Atomic uint64_t csleeps, psleeps;
+    _Alignas(64) char slots[];
+};
+
+struct shmring {
+    int shmid;
+    struct ring_hdr *h;
+    uint32_t mask, seen;        // seen: the other side's counter, last read
+    int synced;                 // seen has been read at all: a new handle
+                                // may attach to a ring already in use
+};
+
+static void futex_wait(_Atomic uint32_t *w, uint32_t val)
+{
+    syscall(SYS_futex, w, FUTEX_WAIT, val, 0, 0, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *w)
+{
+    syscall(SYS_futex, w, FUTEX_WAKE, 1, 0, 0, 0);
+}
+
+static inline void relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static struct slot *slot_at(struct shmring *r, uint32_t i)
+{
+    return (struct slot *)(r->h->slots + (size_t)(i & r->mask) * r->h->slotsize);
+}
+
+struct shmring *shmring_open(key_t key, unsigned nslots, unsigned msgsize)
+{
+    struct shmring *r;
+    struct ring_hdr *h;
+    struct shmid_ds ds;
+    unsigned n = 1, slotsize;
+    int id, created = 1, ms;
+
+    while (n < nslots)
+        n <<= 1;
+    if (n > 1u << 30 || msgsize == 0)
+    {
+        errno = EINVAL;
+        return 0;
+    }
+    slotsize = (sizeof(struct slot) + msgsize + 7) & ~7u;
+    id = shmget(key, sizeof(*h) + (size_t)n * slotsize, IPC_CREAT | IPC_EXCL | 0666);
+    if (id < 0 && errno == EEXIST)
+    {
+        created = 0;
+        id = shmget(key, 0, 0);
+    }
+    if (id < 0 || shmctl(id, IPC_STAT, &ds) < 0)
+        return 0;
+    if (ds.shm_segsz < sizeof(*h))
+        goto foreign;           // e.g. 01_shmget.c's 50 bytes
+    h = shmat(id, 0, 0);
+    if (h == (void *)-1)
+        return 0;
+    if (created)
+    {
+        h->nslots = n;
+        h->slotsize = slotsize;
+        atomic_store_explicit(&h->magic, RING_MAGIC, memory_order_release);
+    }
+    else
+    {
+        // the creator may still be filling in the header; one that never
+        // gets the magic, or does not match the segment, is not a ring
+        for (ms = 0; atomic_load_explicit(&h->magic, memory_order_acquire) != RING_MAGIC; ms++)
+        {
+            if (ms == ATTACH_MS)
+                goto bad;
+            usleep(1000);
+        }
+        if (h->nslots == 0 || (h->nslots & (h->nslots - 1)) || h->slotsize <= sizeof(struct slot) ||
+            ds.shm_segsz < sizeof(*h) + (size_t)h->nslots * h->slotsize)
+            goto bad;
+    }
+    r = calloc(1, sizeof(*r));
+    r->shmid = id;
+    r->h = h;
+    r->mask = h->nslots - 1;
+    return r;
+
+bad:
+    shmdt(h);
+foreign:
+    errno = EINVAL;
+    return 0;
+}
+
+void shmring_close(struct shmring *r)
+{
+    shmdt(r->h);
+    free(r);
+}
+
+int shmring_destroy(struct shmring *r)
+{
+    return shmctl(r->shmid, IPC_RMID, 0);
+}
+
+unsigned shmring_msgsize(struct shmring *r)
+{
+    return r->h->slotsize - sizeof(struct slot);
+}
+
+void shmring_sleeps(struct shmring *r, uint64_t *producer, uint64_t *consumer)
+{
+    *producer = atomic_load(&r->h->psleeps);
+    *consumer = atomic_load(&r->h->csleeps);
+}
+
+/*
+ * Wait until *w != val.  The flag goes up before the last look at *w,
+ * and the other side stores *w before it looks at the flag (both
+ * seq_cst), so at least one of them sees the other: no lost wakeup.
+ * The waker takes the flag down; a waiter that must sleep again puts
+ * it back up.
+ */
+static uint32_t wait_change(_Atomic uint32_t *w, uint32_t val, _Atomic uint32_t *flag, _Atomic uint64_t *sleeps)
+{
+    uint32_t v;
+    int i;
+
+    for (i = 0; i < SPIN; i++)
+    {
+        v = atomic_load_explicit(w, memory_order_acquire);
+        if (v != val)
+            return v;
+        relax();
+    }
+    for (;;)
+    {
+        atomic_store(flag, 1);
+        v = atomic_load(w);
+        if (v != val)
+            break;
+        atomic_fetch_add_explicit(sleeps, 1, memory_order_relaxed);
+        futex_wait(w, val);
+    }
+    atomic_store_explicit(flag, 0, memory_order_relaxed);
+    return v;
+}
+
+static void publish(_Atomic uint32_t *w, uint32_t val, _Atomic uint32_t *flag)
+{
+    atomic_store_explicit(w, val, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+    // take the flag down: until the sleeper has run, further publishes
+    // need no syscall
+    if (atomic_load_explicit(flag, memory_order_relaxed) && atomic_exchange(flag, 0))
+        futex_wake(w);
+}
+
+//////////////////////////////////////////////////////////////
+// producer
+
+// free slots from head on, waiting for at least one
+static uint32_t space(struct shmring *r, uint32_t head)
+{
+    struct ring_hdr *h = r->h;
+
+    if (!r->synced)
+    {
+        r->seen = atomic_load_explicit(&h->tail, memory_order_acquire);
+        r->synced = 1;
+    }
+    if (head - r->seen == h->nslots)
+    {
+        r->seen = atomic_load_explicit(&h->tail, memory_order_acquire);
+        if (head - r->seen == h->nslots)
+            r->seen = wait_change(&h->tail, head - h->nslots, &h->full_wait, &h->psleeps);
+    }
+    return h->nslots - (head - r->seen);
+}
+
+int shmring_sendv(struct shmring *r, const struct iovec *v, int cnt)
+{
+    struct ring_hdr *h = r->h;
+    uint32_t head = atomic_load_explicit(&h->head, memory_order_relaxed), free;
+    struct slot *s;
+    int i;
+
+    for (i = 0; i < cnt; i++)
+        if (v[i].iov_len > shmring_msgsize(r))
+        {
+            errno = EMSGSIZE;
+            return -1;
+        }
+    for (i = 0; i < cnt; )
+    {
+        for (free = space(r, head); free > 0 && i < cnt; free--, i++, head++)
+        {
+            s = slot_at(r, head);
+            s->len = v[i].iov_len;
+            memcpy(s->data, v[i].iov_base, v[i].iov_len);
+        }
+        publish(&h->head, head, &h->empty_wait);
+    }
+    return cnt;
+}
+
+int shmring_send(struct shmring *r, const void *p, size_t n)
+{
+    struct iovec v = { (void *)p, n };
+
+    return shmring_sendv(r, &v, 1) < 0 ? -1 : 0;
+}
+
+//////////////////////////////////////////////////////////////
+// consumer
+
+int shmring_recvv(struct shmring *r, struct shmring_msg *m, int max)
+{
+    struct ring_hdr *h = r->h;
+    uint32_t tail = atomic_load_explicit(&h->tail, memory_order_relaxed);
+    struct slot *s;
+    int n;
+
+    if (!r->synced)
+    {
+        r->seen = atomic_load_explicit(&h->head, memory_order_acquire);
+        r->synced = 1;
+    }
+    if (r->seen == tail)
+    {
+        r->seen = atomic_load_explicit(&h->head, memory_order_acquire);
+        if (r->seen == tail)
+            r->seen = wait_change(&h->head, tail, &h->empty_wait, &h->csleeps);
+    }
+    for (n = 0; n < max && tail != r->seen; n++, tail++)
+    {
+        s = slot_at(r, tail);
+        m[n].data = s->data;
+        m[n].len = s->len;
+    }
+    return n;
+}
+
+void shmring_release(struct shmring *r, int count)
+{
+    struct ring_hdr *h = r->h;
+    uint32_t tail = atomic_load_explicit(&h->tail, memory_order_relaxed);
+
+    publish(&h->tail, tail + count, &h->full_wait);
+}
+
+ssize_t shmring_recv(struct shmring *r, void *p, size_t n)
+{
+    struct shmring_msg m;
+    size_t k;
+
+    shmring_recvv(r, &m, 1);
+    k = m.len < n ? m.len : n;
+    memcpy(p, m.data, k);
+    shmring_release(r, 1);
+    return k;
+}
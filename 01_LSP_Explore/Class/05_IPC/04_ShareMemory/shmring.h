@@ -0,0 +1,74 @@
+/*
+ * A single-producer, single-consumer ring of messages in a SysV shared
+ * memory segment.
+ *
+ * nslots is a power of two and every slot holds one message of up to
+ * msgsize bytes.  head (next slot to write) and tail (next slot to
+ * read) are free-running 32-bit counters, each on its own cache line
+ * and written by one side only.  The producer fills a slot and then
+ * publishes head with a release store; the consumer reads head with
+ * acquire, so the slot contents are visible before the index is.  The
+ * same holds the other way for tail.  There are no locks.
+ *
+ * A side that finds the ring empty (consumer) or full (producer) spins
+ * briefly.  After that it sleeps on a futex on the other side's
+ * counter.  The other side only makes the wake syscall when a waiter
+ * flag says somebody is asleep.
+ *
+ * Each process opens its own handle for its own side: a handle keeps
+ * the last value it read of the other side's counter.
+ *
+ * The batch calls are where the speed is.  shmring_sendv() fills every
+ * free slot and publishes once.  shmring_recvv() hands out everything
+ * waiting, in place, and shmring_release() returns those slots in one
+ * store.
+ */
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+struct shmring;
+
+struct shmring_msg {
+    const void *data;
+    size_t len;
+};
+
+/*
+ * Create the ring for key, or attach it if it is already there (then
+ * nslots and msgsize are taken from the segment).  IPC_PRIVATE always
+ * creates: for a ring shared with fork()ed children.
+ * nslots is rounded up to a power of two.  A segment at key that is not
+ * a ring (too small for its header, or still without one after a
+ * second) gives EINVAL.
+ */
+struct shmring *shmring_open(key_t key, unsigned nslots, unsigned msgsize);
+void shmring_close(struct shmring *r);
+/* mark the segment for removal once both sides have closed */
+int shmring_destroy(struct shmring *r);
+
+unsigned shmring_msgsize(struct shmring *r);
+
+/* producer: one message, waiting while full.  -1 EMSGSIZE */
+int shmring_send(struct shmring *r, const void *p, size_t n);
+/* producer: cnt messages, one per iovec; publishes once per free stretch */
+int shmring_sendv(struct shmring *r, const struct iovec *v, int cnt);
+
+/* consumer: one message copied out, waiting while empty.  Its length */
+ssize_t shmring_recv(struct shmring *r, void *p, size_t n);
+/*
+ * consumer: up to max waiting messages, in place, waiting for at least
+ * one.  They stay valid until shmring_release(r, count) gives the slots
+ * back.
+ */
+int shmring_recvv(struct shmring *r, struct shmring_msg *m, int max);
+void shmring_release(struct shmring *r, int count);
+
+/* how often each side went to sleep, since creation */
+void shmring_sleeps(struct shmring *r, uint64_t *producer, uint64_t *consumer);
+
+#endif
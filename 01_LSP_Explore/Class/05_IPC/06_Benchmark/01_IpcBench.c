@@ -0,0 +1,745 @@
+/*
+📏 1. One Benchmark for Every Transport
+==========================================================
+Scenario:
+01_pipe .. 05_Shemaphore each show one mechanism.  Which one to use for
+a given message size is a question of numbers, so this program runs the
+same two workloads over all of them, between a parent and a forked child:
+
+  ping-pong  parent sends a message, child sends it back; round trip
+             time per message, p50/p99/p99.9/max
+  stream     parent sends -b MB in messages of that size, child reads
+             them all and answers with one byte; GB/s and msgs/s
+
+Transports:
+  pipe      two pipes
+  fifo      two FIFOs in /tmp (a pipe with a name: same kernel code)
+  unix      socketpair(AF_UNIX, SOCK_STREAM)
+  sysvmq    one msgget() queue, mtype 1 and 2 for the two directions
+  posixmq   two mq_open() queues
+  shmfutex  a byte ring per direction in shared memory; a side that
+            finds it empty (or full) sleeps in FUTEX_WAIT
+  shmefd    the same rings, but sleep/wake is read()/write() on eventfd
+
+Both queues carry at most msgmax (SysV) / msgsize_max (POSIX) bytes per
+message, 8 KiB by default, so a bigger message goes as several; that is
+what using a queue for big messages costs.  The rings never spin: a side
+with nothing to do sleeps, as it would in a real program.
+
+Placement (-c): "a,b" pins parent to CPU a and child to CPU b; "any"
+leaves it to the scheduler.  The default is the first two CPUs we may
+use, or the same one twice on a single CPU box.
+
+Build: gcc -O2 01_IpcBench.c -o ipcbench -lrt
+Run:   ./ipcbench [-t pipe,unix,...] [-s 8,4k,1m] [-w pingpong,stream]
+                  [-c a,b|any] [-n round trips] [-b MB]
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/msg.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define MAXLIST     16
+#define MAXMSG      (1 << 20)
+#define RINGSZ      (2 << 20)       // bytes per direction, power of two
+#define MAXSTREAM   500000          // messages per stream run, at most
+#define MAXRTT      20000           // round trips per ping-pong run, at most
+
+struct ring {
+    _Alignas(64) _Atomic uint64_t head;     // producer side
+    _Atomic uint32_t hseq;                  // bumped with head: futex word
+    _Atomic uint32_t wwait;                 // producer asleep (ring full)
+    _Alignas(64) _Atomic uint64_t tail;     // consumer side
+    _Atomic uint32_t tseq;
+    _Atomic uint32_t rwait;                 // consumer asleep (ring empty)
+    int efd_data, efd_room;                 // shmefd: wake consumer / producer
+    _Alignas(64) char data[RINGSZ];
+};
+
+// dir 0: parent -> child, dir 1: child -> parent
+struct chan {
+    int rd[2], wr[2];
+    int msqid;
+    mqd_t mq[2];
+    char mqname[2][32];
+    char fifo[2][32];
+    size_t chunk;           // largest message a queue takes
+    struct qmsg { long mtype; char data[]; } *mb;
+    struct ring *ring[2];
+    int efd;                // rings wake through eventfd, not futex
+};
+
+struct transport {
+    const char *name;
+    int (*setup)(struct chan *c);
+    int (*send)(struct chan *c, int dir, const char *p, size_t n);
+    int (*recv)(struct chan *c, int dir, char *p, size_t n);
+    void (*done)(struct chan *c);
+};
+
+static uint64_t ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static long sysctl_long(const char *path, long dflt)
+{
+    FILE *fp = fopen(path, "r");
+    long v = dflt;
+
+    if (fp)
+    {
+        if (fscanf(fp, "%ld", &v) != 1)
+            v = dflt;
+        fclose(fp);
+    }
+    return v;
+}
+
+/* ---------------- byte streams: pipe, fifo, unix ---------------- */
+
+static int fd_send(struct chan *c, int dir, const char *p, size_t n)
+{
+    ssize_t r;
+
+    while (n)
+    {
+        r = write(c->wr[dir], p, n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        n -= r;
+    }
+    return 0;
+}
+
+static int fd_recv(struct chan *c, int dir, char *p, size_t n)
+{
+    ssize_t r;
+
+    while (n)
+    {
+        r = read(c->rd[dir], p, n);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return -1;
+        p += r;
+        n -= r;
+    }
+    return 0;
+}
+
+static void fd_done(struct chan *c)
+{
+    int d;
+
+    for (d = 0; d < 2; d++)
+    {
+        close(c->rd[d]);
+        if (c->wr[d] != c->rd[!d])
+            close(c->wr[d]);
+        if (c->fifo[d][0])
+            unlink(c->fifo[d]);
+    }
+}
+
+static int pipe_setup(struct chan *c)
+{
+    int p[2], d;
+
+    for (d = 0; d < 2; d++)
+    {
+        if (pipe(p) < 0)
+            return -1;
+        c->rd[d] = p[0];
+        c->wr[d] = p[1];
+    }
+    return 0;
+}
+
+static int fifo_setup(struct chan *c)
+{
+    int d;
+
+    for (d = 0; d < 2; d++)
+    {
+        snprintf(c->fifo[d], sizeof(c->fifo[d]), "/tmp/ipcbench.%d.%d", getpid(), d);
+        if (mkfifo(c->fifo[d], 0600) < 0)
+            return -1;
+        // read end first, non-blocking, so neither open() waits
+        c->rd[d] = open(c->fifo[d], O_RDONLY | O_NONBLOCK);
+        c->wr[d] = open(c->fifo[d], O_WRONLY);
+        if (c->rd[d] < 0 || c->wr[d] < 0)
+            return -1;
+        fcntl(c->rd[d], F_SETFL, 0);
+    }
+    return 0;
+}
+
+static int unix_setup(struct chan *c)
+{
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        return -1;
+    c->wr[0] = c->rd[1] = sv[0];        // parent's end
+    c->wr[1] = c->rd[0] = sv[1];        // child's end
+    return 0;
+}
+
+/* ---------------- queues: messages of at most c->chunk ---------------- */
+
+static int sysv_setup(struct chan *c)
+{
+    c->chunk = sysctl_long("/proc/sys/kernel/msgmax", 8192);
+    c->msqid = msgget(IPC_PRIVATE, IPC_CREAT | 0600);
+    c->mb = malloc(sizeof(long) + c->chunk);
+    return c->msqid < 0 ? -1 : 0;
+}
+
+static int sysv_send(struct chan *c, int dir, const char *p, size_t n)
+{
+    size_t k;
+
+    for (; n; p += k, n -= k)
+    {
+        k = n < c->chunk ? n : c->chunk;
+        c->mb->mtype = dir + 1;
+        memcpy(c->mb->data, p, k);
+        while (msgsnd(c->msqid, c->mb, k, 0) < 0)
+            if (errno != EINTR)
+                return -1;
+    }
+    return 0;
+}
+
+static int sysv_recv(struct chan *c, int dir, char *p, size_t n)
+{
+    ssize_t k;
+
+    for (; n; p += k, n -= k)
+    {
+        k = msgrcv(c->msqid, c->mb, c->chunk, dir + 1, 0);
+        if (k < 0 && errno == EINTR)
+        {
+            k = 0;
+            continue;
+        }
+        if (k <= 0 || (size_t)k > n)
+            return -1;
+        memcpy(p, c->mb->data, k);
+    }
+    return 0;
+}
+
+static void sysv_done(struct chan *c)
+{
+    msgctl(c->msqid, IPC_RMID, 0);
+    free(c->mb);
+}
+
+static int pmq_setup(struct chan *c)
+{
+    struct mq_attr a = { 0 };
+    int d;
+
+    c->chunk = sysctl_long("/proc/sys/fs/mqueue/msgsize_max", 8192);
+    a.mq_maxmsg = sysctl_long("/proc/sys/fs/mqueue/msg_max", 10);
+    a.mq_msgsize = c->chunk;
+    for (d = 0; d < 2; d++)
+    {
+        snprintf(c->mqname[d], sizeof(c->mqname[d]), "/ipcbench.%d.%d", getpid(), d);
+        c->mq[d] = mq_open(c->mqname[d], O_RDWR | O_CREAT | O_EXCL, 0600, &a);
+        if (c->mq[d] == (mqd_t)-1)
+            return -1;
+    }
+    return 0;
+}
+
+static int pmq_send(struct chan *c, int dir, const char *p, size_t n)
+{
+    size_t k;
+
+    for (; n; p += k, n -= k)
+    {
+        k = n < c->chunk ? n : c->chunk;
+        while (mq_send(c->mq[dir], p, k, 0) < 0)
+            if (errno != EINTR)
+                return -1;
+    }
+    return 0;
+}
+
+static int pmq_recv(struct chan *c, int dir, char *p, size_t n)
+{
+    static char *tmp;
+    ssize_t k;
+
+    // mq_receive() wants room for a whole message
+    if (!tmp)
+        tmp = malloc(c->chunk);
+    for (; n; p += k, n -= k)
+    {
+        k = mq_receive(c->mq[dir], n >= c->chunk ? p : tmp, c->chunk, 0);
+        if (k < 0 && errno == EINTR)
+        {
+            k = 0;
+            continue;
+        }
+        if (k <= 0 || (size_t)k > n)
+            return -1;
+        if (n < c->chunk)
+            memcpy(p, tmp, k);
+    }
+    return 0;
+}
+
+static void pmq_done(struct chan *c)
+{
+    int d;
+
+    for (d = 0; d < 2; d++)
+    {
+        mq_close(c->mq[d]);
+        mq_unlink(c->mqname[d]);
+    }
+}
+
+/* ---------------- shared memory rings ---------------- */
+
+static void ring_sleep(struct chan *c, _Atomic uint32_t *seq, uint32_t val, int efd)
+{
+    uint64_t v;
+
+    if (c->efd)
+    {
+        // a stale count only means one more trip round the caller's loop
+        if (read(efd, &v, sizeof(v)) < 0 && errno != EINTR)
+            abort();
+    }
+    else
+        syscall(SYS_futex, seq, FUTEX_WAIT, val, 0, 0, 0);
+}
+
+static void ring_wake(struct chan *c, _Atomic uint32_t *seq, int efd)
+{
+    uint64_t one = 1;
+
+    if (c->efd)
+    {
+        if (write(efd, &one, sizeof(one)) < 0)
+            abort();
+    }
+    else
+        syscall(SYS_futex, seq, FUTEX_WAKE, 1, 0, 0, 0);
+}
+
+static int ring_send(struct chan *c, int dir, const char *p, size_t n)
+{
+    struct ring *r = c->ring[dir];
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed), tail;
+    size_t k, off;
+    uint32_t s;
+
+    while (n)
+    {
+        tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (head - tail == RINGSZ)
+        {
+            // full: announce we sleep, then look again (the other side
+            // stores tail then reads wwait; seq_cst on both orders it)
+            s = atomic_load(&r->tseq);
+            atomic_store(&r->wwait, 1);
+            if (atomic_load(&r->tail) == tail)
+                ring_sleep(c, &r->tseq, s, r->efd_room);
+            atomic_store(&r->wwait, 0);
+            continue;
+        }
+        k = RINGSZ - (head - tail);
+        off = head & (RINGSZ - 1);
+        if (k > n)
+            k = n;
+        if (k > RINGSZ - off)
+            k = RINGSZ - off;
+        memcpy(r->data + off, p, k);
+        head += k;
+        p += k;
+        n -= k;
+        atomic_store(&r->head, head);
+        atomic_fetch_add(&r->hseq, 1);
+        if (atomic_load(&r->rwait))
+            ring_wake(c, &r->hseq, r->efd_data);
+    }
+    return 0;
+}
+
+static int ring_recv(struct chan *c, int dir, char *p, size_t n)
+{
+    struct ring *r = c->ring[dir];
+    uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed), head;
+    size_t k, off;
+    uint32_t s;
+
+    while (n)
+    {
+        head = atomic_load_explicit(&r->head, memory_order_acquire);
+        if (head == tail)
+        {
+            s = atomic_load(&r->hseq);
+            atomic_store(&r->rwait, 1);
+            if (atomic_load(&r->head) == tail)
+                ring_sleep(c, &r->hseq, s, r->efd_data);
+            atomic_store(&r->rwait, 0);
+            continue;
+        }
+        k = head - tail;
+        off = tail & (RINGSZ - 1);
+        if (k > n)
+            k = n;
+        if (k > RINGSZ - off)
+            k = RINGSZ - off;
+        memcpy(p, r->data + off, k);
+        tail += k;
+        p += k;
+        n -= k;
+        atomic_store(&r->tail, tail);
+        atomic_fetch_add(&r->tseq, 1);
+        if (atomic_load(&r->wwait))
+            ring_wake(c, &r->tseq, r->efd_room);
+    }
+    return 0;
+}
+
+static int ring_setup(struct chan *c)
+{
+    int d;
+
+    for (d = 0; d < 2; d++)
+    {
+        c->ring[d] = mmap(0, sizeof(struct ring), PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (c->ring[d] == MAP_FAILED)
+            return -1;
+        c->ring[d]->efd_data = c->efd ? eventfd(0, 0) : -1;
+        c->ring[d]->efd_room = c->efd ? eventfd(0, 0) : -1;
+    }
+    return 0;
+}
+
+static int futex_setup(struct chan *c)
+{
+    c->efd = 0;
+    return ring_setup(c);
+}
+
+static int efd_setup(struct chan *c)
+{
+    c->efd = 1;
+    return ring_setup(c);
+}
+
+static void ring_done(struct chan *c)
+{
+    int d;
+
+    for (d = 0; d < 2; d++)
+    {
+        if (c->efd)
+        {
+            close(c->ring[d]->efd_data);
+            close(c->ring[d]->efd_room);
+        }
+        munmap(c->ring[d], sizeof(struct ring));
+    }
+}
+
+static const struct transport transports[] = {
+    { "pipe",     pipe_setup,  fd_send,   fd_recv,   fd_done },
+    { "fifo",     fifo_setup,  fd_send,   fd_recv,   fd_done },
+    { "unix",     unix_setup,  fd_send,   fd_recv,   fd_done },
+    { "sysvmq",   sysv_setup,  sysv_send, sysv_recv, sysv_done },
+    { "posixmq",  pmq_setup,   pmq_send,  pmq_recv,  pmq_done },
+    { "shmfutex", futex_setup, ring_send, ring_recv, ring_done },
+    { "shmefd",   efd_setup,   ring_send, ring_recv, ring_done },
+};
+#define NTRANSPORT  (int)(sizeof(transports) / sizeof(transports[0]))
+
+/* ---------------- workloads ---------------- */
+
+static int cpu_parent = -1, cpu_child = -1;
+static char *buf;
+
+static void pin(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0)
+        return;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+static int cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// Fork the child, run the parent's side, reap.  0 ok.
+static int run(const struct transport *t, int stream, size_t size, long count,
+               uint32_t *lat, double *secs)
+{
+    struct chan c;
+    uint64_t t0, t1;
+    long i, warm = count / 10;
+    int st, ok = 0;
+    pid_t pid;
+
+    memset(&c, 0, sizeof(c));
+    if (t->setup(&c) < 0)
+    {
+        perror(t->name);
+        return -1;
+    }
+    pid = fork();
+    if (pid == 0)
+    {
+        pin(cpu_child);
+        for (i = 0; i < (stream ? count : count + warm); i++)
+        {
+            if (t->recv(&c, 0, buf, size) < 0)
+                _exit(1);
+            if (!stream && t->send(&c, 1, buf, size) < 0)
+                _exit(1);
+        }
+        if (stream && t->send(&c, 1, buf, 1) < 0)
+            _exit(1);
+        _exit(0);
+    }
+    if (pid < 0)
+    {
+        // and never kill(-1, ...) below
+        perror("fork");
+        t->done(&c);
+        return -1;
+    }
+    pin(cpu_parent);
+
+    if (stream)
+    {
+        t0 = ns();
+        for (i = 0; i < count && ok == 0; i++)
+            ok = t->send(&c, 0, buf, size);
+        if (ok == 0)
+            ok = t->recv(&c, 1, buf, 1);
+        *secs = (ns() - t0) / 1e9;
+    }
+    else
+    {
+        // the first tenth is warm-up and not recorded
+        for (i = 0; i < count + warm && ok == 0; i++)
+        {
+            t0 = ns();
+            ok = t->send(&c, 0, buf, size);
+            if (ok == 0)
+                ok = t->recv(&c, 1, buf, size);
+            t1 = ns();
+            if (i >= warm)
+                lat[i - warm] = t1 - t0;
+        }
+    }
+    if (ok < 0)
+        kill(pid, SIGKILL);
+    waitpid(pid, &st, 0);
+    t->done(&c);
+    if (ok < 0 || !WIFEXITED(st) || WEXITSTATUS(st))
+        return -1;
+    return 0;
+}
+
+static int parse_list(char *s, long *v)
+{
+    char *tok, *end;
+    int n = 0;
+
+    for (tok = strtok(s, ","); tok && n < MAXLIST; tok = strtok(0, ","))
+    {
+        v[n] = strtol(tok, &end, 10);
+        if (*end == 'k' || *end == 'K')
+            v[n] <<= 10;
+        else if (*end == 'm' || *end == 'M')
+            v[n] <<= 20;
+        if (v[n] <= 0 || v[n] > MAXMSG)
+            return -1;
+        n++;
+    }
+    return n;
+}
+
+// first two CPUs we may run on; the same one twice on one CPU
+static void default_cpus(void)
+{
+    cpu_set_t set;
+    int i;
+
+    sched_getaffinity(0, sizeof(set), &set);
+    for (i = 0; i < CPU_SETSIZE; i++)
+        if (CPU_ISSET(i, &set))
+        {
+            if (cpu_parent < 0)
+                cpu_parent = cpu_child = i;
+            else
+            {
+                cpu_child = i;
+                break;
+            }
+        }
+}
+
+int main(int argc, char **argv)
+{
+    long sizes[MAXLIST] = { 8, 64, 512, 4096, 32768, 262144, 1048576 };
+    long total = 64 << 20, rtt = 0, count, n;
+    int nsizes = 7, opt, want[NTRANSPORT], i, j, w, pingpong = 1, stream = 1, bad = 0;
+    uint32_t *lat;
+    double secs;
+    char *tok;
+
+    for (i = 0; i < NTRANSPORT; i++)
+        want[i] = 1;
+    default_cpus();
+    while ((opt = getopt(argc, argv, "t:s:w:c:n:b:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            memset(want, 0, sizeof(want));
+            for (tok = strtok(optarg, ","); tok; tok = strtok(0, ","))
+            {
+                for (i = 0; i < NTRANSPORT && strcmp(tok, transports[i].name); i++)
+                    ;
+                if (i == NTRANSPORT)
+                    goto usage;
+                want[i] = 1;
+            }
+            break;
+        case 's':
+            if ((nsizes = parse_list(optarg, sizes)) < 1)
+                goto usage;
+            break;
+        case 'w':
+            pingpong = strstr(optarg, "ping") != 0;
+            stream = strstr(optarg, "stream") != 0;
+            break;
+        case 'c':
+            if (strcmp(optarg, "any") == 0)
+                cpu_parent = cpu_child = -1;
+            else if (sscanf(optarg, "%d,%d", &cpu_parent, &cpu_child) != 2)
+                goto usage;
+            break;
+        case 'n':
+            rtt = atol(optarg);
+            break;
+        case 'b':
+            total = atol(optarg) << 20;
+            break;
+        default:
+            goto usage;
+        }
+    }
+    if (optind != argc || (!pingpong && !stream) || total <= 0)
+        goto usage;
+
+    buf = malloc(MAXMSG);
+    memset(buf, 'x', MAXMSG);
+    lat = malloc(sizeof(*lat) * MAXRTT);
+    if (cpu_parent < 0)
+        printf("placement: any CPU\n");
+    else
+        printf("placement: parent on CPU %d, child on CPU %d\n", cpu_parent, cpu_child);
+    printf("%-9s %8s  %9s %9s %9s %9s  %9s %11s\n", "transport", "size",
+           "p50 us", "p99 us", "p99.9 us", "max us", "GB/s", "msgs/s");
+
+    for (i = 0; i < NTRANSPORT; i++)
+    {
+        if (!want[i])
+            continue;
+        for (j = 0; j < nsizes; j++)
+        {
+            printf("%-9s %8ld ", transports[i].name, sizes[j]);
+            fflush(stdout);
+            if (pingpong)
+            {
+                // enough round trips for a p99.9, fewer for big messages
+                count = (256l << 20) / sizes[j];
+                if (count < 1000)
+                    count = 1000;
+                if (rtt)
+                    count = rtt;
+                if (count > MAXRTT)
+                    count = MAXRTT;
+                if (run(&transports[i], 0, sizes[j], count, lat, &secs) < 0)
+                {
+                    printf(" failed\n");
+                    bad = 1;
+                    continue;
+                }
+                qsort(lat, count, sizeof(*lat), cmp);
+                printf(" %9.2f %9.2f %9.2f %9.2f", lat[count / 2] / 1e3,
+                       lat[(long)(count * 0.99)] / 1e3, lat[(long)(count * 0.999)] / 1e3,
+                       lat[count - 1] / 1e3);
+            }
+            else
+                printf(" %9s %9s %9s %9s", "-", "-", "-", "-");
+            if (stream)
+            {
+                n = total / sizes[j];
+                if (n > MAXSTREAM)
+                    n = MAXSTREAM;
+                if (n < 1)
+                    n = 1;
+                w = run(&transports[i], 1, sizes[j], n, 0, &secs);
+                if (w < 0)
+                {
+                    printf("  failed\n");
+                    bad = 1;
+                    continue;
+                }
+                printf("  %9.3f %11.0f", n * sizes[j] / secs / 1e9, n / secs);
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+    return bad;
+
+usage:
+    fprintf(stderr, "usage:./a.out [-t pipe,fifo,unix,sysvmq,posixmq,shmfutex,shmefd] [-s 8,4k,1m]\n"
+                    "              [-w pingpong,stream] [-c a,b|any] [-n round trips] [-b MB]\n");
+    return 1;
+}
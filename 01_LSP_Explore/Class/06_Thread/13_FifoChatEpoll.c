@@ -0,0 +1,393 @@
+/*
+ * Full duplex FIFO chat without threads.
+ *
+ * 04-07 give each direction its own thread blocked in read() or scanf(),
+ * so N conversations cost 2N threads.  Here one thread drives stdin and
+ * any number of FIFO pairs through one epoll set:
+ *
+ *   - every fd is O_NONBLOCK (stdin excepted, see below) and epoll_wait
+ *     is the only place the program sleeps, so idle costs no CPU at all
+ *   - conversation i reads <prefix>.i.a and writes <prefix>.i.b; the
+ *     other side runs with -s and has them the other way round
+ *   - the write end is opened when there is something to send or the
+ *     peer has spoken: O_WRONLY|O_NONBLOCK fails with ENXIO while nobody
+ *     reads, so there is no waiting in open() as in 04-07
+ *   - a full FIFO keeps the rest of the message and waits for EPOLLOUT;
+ *     EPIPE (SIGPIPE is ignored) means the peer left
+ *   - when the peer closes its write end our read end would report
+ *     EPOLLHUP for ever, so it is closed and opened again
+ *   - messages end at '\n' or '\0', so 04/05 (which send the NUL) can
+ *     be the peer of conversation 0 with -p f -n 1
+ *
+ * stdin lines:  "3: hello" to conversation 3, "*: hello" to all of them,
+ * "hello" to the last one we heard from.  Incoming lines print as "[i] ...".
+ * stdin itself stays blocking (it is shared with the shell); one read()
+ * per EPOLLIN cannot block, and lines are put together across reads.
+ * A regular file on stdin cannot go into epoll (EPERM) and never makes
+ * a reader wait anyway: then it is read a chunk per loop, between
+ * epoll_wait calls that do not sleep.  At EOF queued messages get
+ * FLUSH_MS to go out; what a stalled peer has not taken by then is
+ * reported and dropped.
+ *
+ * Build: gcc -O2 13_FifoChatEpoll.c -o chat
+ * Run:   ./chat -n 1000          and in another terminal   ./chat -n 1000 -s
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#define LINESZ  4096
+#define STDIN_TAG  (-1)
+#define FLUSH_MS   2000
+
+struct conv {
+    char rname[64], wname[64];
+    int rfd, wfd;
+    int wait_out;           // EPOLLOUT armed on wfd
+    char *in;               // partial incoming line, once it has spoken
+    size_t inlen;
+    char *out;              // not yet written
+    size_t outlen, outcap;
+};
+
+static struct conv *cv;
+static int nconv, ep, last;
+static char line[LINESZ];   // stdin, up to the next '\n'
+static size_t have;
+
+// epoll data: conversation index * 2 + (0 read end, 1 write end)
+static void watch(int fd, int op, unsigned events, int tag)
+{
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.u64 = (unsigned)tag;
+    if (epoll_ctl(ep, op, fd, &ev) < 0)
+        perror("epoll_ctl");
+}
+
+static int open_read(int i)
+{
+    cv[i].rfd = open(cv[i].rname, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (cv[i].rfd < 0)
+    {
+        perror(cv[i].rname);
+        return -1;
+    }
+    watch(cv[i].rfd, EPOLL_CTL_ADD, EPOLLIN, i * 2);
+    return 0;
+}
+
+// the peer left: what it did not read is gone, not kept for the next one
+static void close_write(int i)
+{
+    if (cv[i].wfd < 0)
+        return;
+    if (cv[i].outlen)
+        printf("[%d] peer left, %zu bytes not delivered\n", i, cv[i].outlen);
+    close(cv[i].wfd);       // also takes it out of the epoll set
+    cv[i].wfd = -1;
+    cv[i].wait_out = 0;
+    cv[i].outlen = 0;
+}
+
+// 0 connected, -1 nobody reading yet
+static int open_write(int i)
+{
+    if (cv[i].wfd >= 0)
+        return 0;
+    cv[i].wfd = open(cv[i].wname, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    return cv[i].wfd < 0 ? -1 : 0;
+}
+
+static void flush_conv(int i)
+{
+    struct conv *c = &cv[i];
+    ssize_t n;
+    size_t off = 0;
+
+    while (off < c->outlen)
+    {
+        n = write(c->wfd, c->out + off, c->outlen - off);
+        if (n > 0)
+        {
+            off += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            break;
+        // EPIPE: the peer is gone, and so is what it did not read
+        c->outlen -= off;
+        close_write(i);
+        return;
+    }
+    memmove(c->out, c->out + off, c->outlen - off);
+    c->outlen -= off;
+    if (c->outlen && !c->wait_out)
+        watch(c->wfd, EPOLL_CTL_ADD, EPOLLOUT, i * 2 + 1);
+    else if (!c->outlen && c->wait_out)
+        epoll_ctl(ep, EPOLL_CTL_DEL, c->wfd, 0);
+    c->wait_out = c->outlen != 0;
+}
+
+static void send_line(int i, const char *s, size_t n)
+{
+    struct conv *c = &cv[i];
+
+    if (open_write(i) < 0)
+    {
+        if (nconv == 1 || errno != ENXIO)
+            printf("[%d] not connected (%s)\n", i, strerror(errno));
+        return;
+    }
+    if (c->outlen + n + 1 > c->outcap)
+    {
+        c->outcap = (c->outlen + n + 1) * 2;
+        c->out = realloc(c->out, c->outcap);
+    }
+    memcpy(c->out + c->outlen, s, n);
+    c->out[c->outlen + n] = '\n';
+    c->outlen += n + 1;
+    if (!c->wait_out)
+        flush_conv(i);
+}
+
+static void on_stdin_line(char *s, size_t n)
+{
+    char *colon = memchr(s, ':', n), *end;
+    long to = last;
+    int i;
+
+    if (colon)
+    {
+        if (colon == s + 1 && *s == '*')
+        {
+            for (i = 0, s += 2, n -= 2; i < nconv; i++)
+                send_line(i, s + (n && *s == ' '), n - (n && *s == ' '));
+            return;
+        }
+        to = strtol(s, &end, 10);
+        if (end == colon && end != s)
+        {
+            n -= colon + 1 - s;
+            s = colon + 1;
+            if (n && *s == ' ')
+                s++, n--;
+        }
+        else
+            to = last;
+    }
+    if (to < 0 || to >= nconv)
+    {
+        printf("no conversation %ld\n", to);
+        return;
+    }
+    send_line(to, s, n);
+}
+
+static void on_readable(int i)
+{
+    struct conv *c = &cv[i];
+    char buf[LINESZ];
+    ssize_t n;
+    size_t k;
+
+    while ((n = read(c->rfd, buf, sizeof(buf))) > 0)
+    {
+        if (!c->in)
+            c->in = malloc(LINESZ);
+        last = i;
+        open_write(i);      // the peer is here: it reads its end too
+        for (k = 0; k < (size_t)n; k++)
+        {
+            if (buf[k] != '\n' && buf[k] != '\0' && c->inlen < LINESZ - 1)
+            {
+                c->in[c->inlen++] = buf[k];
+                continue;
+            }
+            if (buf[k] != '\n' && buf[k] != '\0')
+                k--;        // overlong: print what we have, go on
+            c->in[c->inlen] = 0;
+            if (c->inlen)
+                printf("[%d] %s\n", i, c->in);
+            c->inlen = 0;
+        }
+    }
+    if (n == 0)
+    {
+        // every writer has gone: reopen, or EPOLLHUP would fire for ever;
+        // the peer has most likely gone too, so connect afresh next time
+        close(c->rfd);
+        close_write(i);
+        open_read(i);
+    }
+    fflush(stdout);
+}
+
+// one read of stdin; -1 at EOF
+static int on_stdin(void)
+{
+    ssize_t r;
+    char *nl;
+
+    r = read(0, line + have, sizeof(line) - 1 - have);
+    if (r < 0 && errno == EINTR)
+        return 0;
+    if (r <= 0)
+        return -1;
+    have += r;
+    while ((nl = memchr(line, '\n', have)))
+    {
+        on_stdin_line(line, nl - line);
+        have -= nl + 1 - line;
+        memmove(line, nl + 1, have);
+    }
+    if (have == sizeof(line) - 1)
+    {
+        // full and no newline: all of it goes out as one line
+        on_stdin_line(line, have);
+        have = 0;
+    }
+    fflush(stdout);
+    return 0;
+}
+
+static long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int pending(void)
+{
+    int i;
+
+    for (i = 0; i < nconv; i++)
+        if (cv[i].outlen && cv[i].wfd >= 0)
+            return 1;
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *prefix = "chat";
+    struct epoll_event evs[256], ev;
+    struct rlimit rl;
+    long end;
+    int opt, swap = 0, i, k, n, tag, quit = 0, stdin_polled = 1;
+
+    while ((opt = getopt(argc, argv, "n:p:s")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': nconv = atoi(optarg); break;
+        case 'p': prefix = optarg; break;
+        case 's': swap = 1; break;
+        default:
+            fprintf(stderr, "usage:./a.out [-n conversations] [-p prefix] [-s]\n");
+            return 1;
+        }
+    }
+    if (nconv < 1)
+        nconv = 1;
+
+    // two fds per conversation
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    signal(SIGPIPE, SIG_IGN);
+
+    ep = epoll_create1(EPOLL_CLOEXEC);
+    cv = calloc(nconv, sizeof(*cv));
+    for (i = 0; i < nconv; i++)
+    {
+        // -p f -n 1 is 04's pair: f1 and f2
+        if (nconv == 1 && strcmp(prefix, "f") == 0)
+        {
+            strcpy(cv[i].rname, swap ? "f2" : "f1");
+            strcpy(cv[i].wname, swap ? "f1" : "f2");
+        }
+        else
+        {
+            snprintf(cv[i].rname, sizeof(cv[i].rname), "%s.%d.%c", prefix, i, swap ? 'b' : 'a');
+            snprintf(cv[i].wname, sizeof(cv[i].wname), "%s.%d.%c", prefix, i, swap ? 'a' : 'b');
+        }
+        mkfifo(cv[i].rname, 0666);
+        mkfifo(cv[i].wname, 0666);
+        cv[i].wfd = -1;
+        if (open_read(i) < 0)
+            return 1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.u64 = (unsigned)STDIN_TAG;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, 0, &ev) < 0)
+    {
+        if (errno != EPERM)
+        {
+            perror("epoll_ctl stdin");
+            return 1;
+        }
+        stdin_polled = 0;   // a regular file: read it between polls
+    }
+    printf("%d conversations, reading %s..., \"i: text\" to send\n", nconv, cv[0].rname);
+    fflush(stdout);
+
+    while (!quit)
+    {
+        n = epoll_wait(ep, evs, 256, stdin_polled ? -1 : 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            perror("epoll_wait");
+            return 1;
+        }
+        for (k = 0; k < n; k++)
+        {
+            tag = (int)(unsigned)evs[k].data.u64;
+            if (tag == STDIN_TAG)
+                quit |= on_stdin() < 0;
+            else if (tag & 1)
+                flush_conv(tag / 2);
+            else
+                on_readable(tag / 2);
+        }
+        if (!stdin_polled && !quit)
+            quit = on_stdin() < 0;
+    }
+
+    // stdin closed: queued messages get FLUSH_MS, not for ever
+    if (stdin_polled)
+        epoll_ctl(ep, EPOLL_CTL_DEL, 0, 0);     // at EOF it is always ready
+    end = now_ms() + FLUSH_MS;
+    while (pending() && now_ms() < end)
+    {
+        n = epoll_wait(ep, evs, 256, end - now_ms());
+        for (k = 0; k < n; k++)
+        {
+            tag = (int)(unsigned)evs[k].data.u64;
+            if (tag & 1)
+                flush_conv(tag / 2);
+            else
+                on_readable(tag / 2);
+        }
+    }
+    for (i = 0; i < nconv; i++)
+        if (cv[i].outlen && cv[i].wfd >= 0)
+            printf("[%d] peer stalled, %zu bytes not delivered\n", i, cv[i].outlen);
+    return 0;
+}
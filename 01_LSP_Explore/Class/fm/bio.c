@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<limits.h>
+#include<sys/uio.h>
+#include"bio.h"
+
+static ssize_t write_all(int fd,const char *p,size_t n)
+{
+	size_t done=0;
+	ssize_t r;
+
+	while(done<n)
+	{
+		r=write(fd,p+done,n-done);
+		if(r<0&&errno==EINTR)
+			continue;
+		if(r<=0)
+			return -1;
+		done+=r;
+	}
+	return done;
+}
+
+int bio_open(struct bio *b,const char *path,int flags,size_t threshold)
+{
+	int oflags=flags&BIO_WRITE ? O_WRONLY|O_CREAT|O_TRUNC : O_RDONLY;
+
+	memset(b,0,sizeof(*b));
+	if(threshold==0)
+		threshold=64*1024;
+	if(flags&BIO_DIRECT)
+	{
+		threshold=(threshold+BIO_ALIGN-1)&~(size_t)(BIO_ALIGN-1);
+		b->fd=open(path,oflags|O_DIRECT,0644);
+		if(b->fd<0&&errno==EINVAL)	/* e.g. tmpfs: carry on buffered */
+			flags&=~BIO_DIRECT;
+	}
+	if(!(flags&BIO_DIRECT))
+		b->fd=open(path,oflags,0644);
+	if(b->fd<0)
+		return -1;
+	b->flags=flags;
+	b->threshold=threshold;
+	if(posix_memalign((void **)&b->buf,BIO_ALIGN,threshold))
+	{
+		close(b->fd);
+		errno=ENOMEM;
+		return -1;
+	}
+	return 0;
+}
+
+/* O_DIRECT only takes whole blocks, the tail waits for bio_close() */
+static int drain(struct bio *b)
+{
+	size_t n=b->len;
+
+	if(b->flags&BIO_DIRECT)
+		n&=~(size_t)(BIO_ALIGN-1);
+	if(n==0)
+		return 0;
+	if(write_all(b->fd,b->buf,n)<0)
+		return -1;
+	memmove(b->buf,b->buf+n,b->len-n);
+	b->len-=n;
+	return 0;
+}
+
+ssize_t bio_write(struct bio *b,const void *p,size_t n)
+{
+	const char *s=p;
+	size_t c,done=0;
+
+	/* big buffered writes skip the copy */
+	if(b->len==0&&n>=b->threshold&&!(b->flags&BIO_DIRECT))
+		return write_all(b->fd,s,n);
+
+	while(done<n)
+	{
+		c=b->threshold-b->len;
+		if(c>n-done)
+			c=n-done;
+		memcpy(b->buf+b->len,s+done,c);
+		b->len+=c;
+		done+=c;
+		if(b->len==b->threshold&&drain(b)<0)
+			return -1;
+	}
+	return done;
+}
+
+int bio_flush(struct bio *b)
+{
+	if(!(b->flags&BIO_WRITE))
+		return 0;
+	return drain(b);
+}
+
+ssize_t bio_read(struct bio *b,void *p,size_t n)
+{
+	char *d=p;
+	size_t c,done=0;
+	ssize_t r=0;
+
+	while(done<n)
+	{
+		if(b->pos==b->len)
+		{
+			if(n-done>=b->threshold&&!(b->flags&BIO_DIRECT))
+			{
+				r=read(b->fd,d+done,n-done);
+				if(r<0&&errno==EINTR)
+					continue;
+				if(r<=0)
+					break;
+				done+=r;
+				continue;
+			}
+			r=read(b->fd,b->buf,b->threshold);
+			if(r<0&&errno==EINTR)
+				continue;
+			if(r<=0)
+				break;
+			b->pos=0;
+			b->len=r;
+		}
+		c=b->len-b->pos;
+		if(c>n-done)
+			c=n-done;
+		memcpy(d+done,b->buf+b->pos,c);
+		b->pos+=c;
+		done+=c;
+	}
+	if(done==0&&r<0)
+		return -1;
+	return done;
+}
+
+int bio_close(struct bio *b)
+{
+	int r=0;
+
+	if(b->flags&BIO_WRITE)
+	{
+		if(drain(b)<0)
+			r=-1;
+		if(b->len&&r==0)
+		{
+			fcntl(b->fd,F_SETFL,fcntl(b->fd,F_GETFL)&~O_DIRECT);
+			if(write_all(b->fd,b->buf,b->len)<0)
+				r=-1;
+		}
+	}
+	if(close(b->fd)<0)
+		r=-1;
+	free(b->buf);
+	b->buf=0;
+	return r;
+}
+
+//////////////////////////////////////////////////////////////
+static ssize_t xferv(int fd,const struct bio_field *f,int n,int wr)
+{
+	struct iovec stack[64],*iov=stack;
+	ssize_t r,total=0;
+	int i,cnt;
+
+	if(n>64&&(iov=malloc(n*sizeof(*iov)))==0)
+		return -1;
+	for(i=0;i<n;i++)
+	{
+		iov[i].iov_base=f[i].p;
+		iov[i].iov_len=f[i].size;
+	}
+
+	i=0;
+	while(i<n)
+	{
+		cnt=n-i>IOV_MAX ? IOV_MAX : n-i;
+		r=wr ? writev(fd,iov+i,cnt) : readv(fd,iov+i,cnt);
+		if(r<0&&errno==EINTR)
+			continue;
+		if(r<0)
+		{
+			total=total ? total : -1;
+			break;
+		}
+		if(r==0)	/* EOF */
+			break;
+		total+=r;
+		/* step over what went through, resume inside a partial field */
+		while(i<n&&(size_t)r>=iov[i].iov_len)
+			r-=iov[i++].iov_len;
+		if(i<n)
+		{
+			iov[i].iov_base=(char *)iov[i].iov_base+r;
+			iov[i].iov_len-=r;
+		}
+	}
+	if(iov!=stack)
+		free(iov);
+	return total;
+}
+
+ssize_t bio_writev(int fd,const struct bio_field *f,int n)
+{
+	return xferv(fd,f,n,1);
+}
+
+ssize_t bio_readv(int fd,const struct bio_field *f,int n)
+{
+	return xferv(fd,f,n,0);
+}
@@ -0,0 +1,51 @@
+#ifndef BIO_H
+#define BIO_H
+
+#include<stddef.h>
+#include<sys/types.h>
+
+/*
+ * Batch I/O for the read_* / write_* examples.
+ *
+ * A bio is a buffered reader or writer on one fd.  The writer only calls
+ * write() once threshold bytes have piled up (or on bio_flush/bio_close);
+ * the reader refills its buffer with one read() of the same size.  With
+ * BIO_DIRECT the file is opened O_DIRECT, the buffer is page aligned and
+ * only whole blocks go out directly; the unaligned tail is written after
+ * O_DIRECT is switched off at close.
+ *
+ * bio_writev()/bio_readv() move a list of mixed fields (int array, float
+ * array, struct, ...) in as few writev()/readv() calls as IOV_MAX allows,
+ * resuming after short transfers.
+ */
+
+#define BIO_READ	0
+#define BIO_WRITE	1
+#define BIO_DIRECT	2
+
+#define BIO_ALIGN	4096
+
+struct bio {
+	int fd;
+	int flags;
+	char *buf;
+	size_t len;		/* bytes buffered (writer) / valid (reader) */
+	size_t pos;		/* reader: next byte to hand out */
+	size_t threshold;	/* buffer size */
+};
+
+struct bio_field {
+	void *p;
+	size_t size;
+};
+
+int bio_open(struct bio *b, const char *path, int flags, size_t threshold);
+ssize_t bio_write(struct bio *b, const void *p, size_t n);
+ssize_t bio_read(struct bio *b, void *p, size_t n);
+int bio_flush(struct bio *b);
+int bio_close(struct bio *b);
+
+ssize_t bio_writev(int fd, const struct bio_field *f, int n);
+ssize_t bio_readv(int fd, const struct bio_field *f, int n);
+
+#endif
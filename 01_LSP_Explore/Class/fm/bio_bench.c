@@ -0,0 +1,163 @@
+// syscalls and throughput for 1M element arrays:
+// one write()/read() per value (write_int.c style) vs bio.c
+// cc -O2 bio_bench.c bio.c -o bio_bench
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<time.h>
+#include"bio.h"
+
+#define N	1000000
+
+static int ia[N],ib[N];
+static float fa[N],fb[N];
+static char ca[N],cb[N];
+
+struct io { long syscr,syscw; double t; };
+
+/* a scratch file next to the others (same filesystem, so O_DIRECT behaves
+   the same), never the dataint the read_* programs use */
+static char path[]="bio_bench.XXXXXX";
+
+/* read/write syscall counters the kernel keeps per task */
+static void sample(struct io *s)
+{
+	char line[64];
+	struct timespec ts;
+	FILE *fp=fopen("/proc/self/io","r");
+
+	s->syscr=s->syscw=0;
+	while(fp&&fgets(line,sizeof(line),fp))
+	{
+		sscanf(line,"syscr: %ld",&s->syscr);
+		sscanf(line,"syscw: %ld",&s->syscw);
+	}
+	if(fp)
+		fclose(fp);
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	s->t=ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static void report(const char *what,struct io *a,size_t bytes)
+{
+	struct io b;
+
+	sample(&b);
+	/* the fopen/fgets of /proc/self/io itself costs a couple of reads */
+	printf("%-30s %9ld syscalls %9.1f MB/s\n",what,
+	       (b.syscr-a->syscr)+(b.syscw-a->syscw),bytes/(b.t-a->t)/1e6);
+}
+
+static void check(const char *what)
+{
+	if(memcmp(ia,ib,sizeof(ia))||memcmp(fa,fb,sizeof(fa))||memcmp(ca,cb,sizeof(ca)))
+		printf("%s: data mismatch\n",what);
+	memset(ib,0,sizeof(ib));
+	memset(fb,0,sizeof(fb));
+	memset(cb,0,sizeof(cb));
+}
+
+static void buffered(const char *wname,const char *rname,int flags,size_t thr)
+{
+	size_t bytes=sizeof(ia)+sizeof(fa)+sizeof(ca);
+	struct bio b;
+	struct io s;
+	int i;
+
+	sample(&s);
+	if(bio_open(&b,path,BIO_WRITE|flags,thr)<0)
+	{
+		perror("bio_open");
+		exit(1);
+	}
+	for(i=0;i<N;i++)
+		bio_write(&b,&ia[i],sizeof(int));
+	for(i=0;i<N;i++)
+		bio_write(&b,&fa[i],sizeof(float));
+	for(i=0;i<N;i++)
+		bio_write(&b,&ca[i],1);
+	bio_close(&b);
+	report(wname,&s,bytes);
+
+	sample(&s);
+	bio_open(&b,path,BIO_READ|flags,thr);
+	for(i=0;i<N;i++)
+		bio_read(&b,&ib[i],sizeof(int));
+	for(i=0;i<N;i++)
+		bio_read(&b,&fb[i],sizeof(float));
+	for(i=0;i<N;i++)
+		bio_read(&b,&cb[i],1);
+	bio_close(&b);
+	report(rname,&s,bytes);
+	check(rname);
+}
+
+int main()
+{
+	size_t bytes=sizeof(ia)+sizeof(fa)+sizeof(ca);
+	struct bio_field f[3]={{ia,sizeof(ia)},{fa,sizeof(fa)},{ca,sizeof(ca)}};
+	struct bio_field g[3]={{ib,sizeof(ib)},{fb,sizeof(fb)},{cb,sizeof(cb)}};
+	struct io s;
+	int i,fd;
+
+	fd=mkstemp(path);
+	if(fd<0)
+	{
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+	for(i=0;i<N;i++)
+	{
+		ia[i]=i;
+		fa[i]=i*0.5f;
+		ca[i]='A'+i%26;
+	}
+
+	////////////////////////////////// one syscall per value
+	sample(&s);
+	fd=open(path,O_WRONLY|O_CREAT|O_TRUNC,0644);
+	for(i=0;i<N;i++)
+		write(fd,&ia[i],sizeof(int));
+	for(i=0;i<N;i++)
+		write(fd,&fa[i],sizeof(float));
+	for(i=0;i<N;i++)
+		write(fd,&ca[i],1);
+	close(fd);
+	report("write() per value",&s,bytes);
+
+	sample(&s);
+	fd=open(path,O_RDONLY);
+	for(i=0;i<N;i++)
+		read(fd,&ib[i],sizeof(int));
+	for(i=0;i<N;i++)
+		read(fd,&fb[i],sizeof(float));
+	for(i=0;i<N;i++)
+		read(fd,&cb[i],1);
+	close(fd);
+	report("read() per value",&s,bytes);
+	check("read() per value");
+
+	////////////////////////////////// buffered, 64K threshold
+	buffered("bio_write() 64K","bio_read() 64K",0,64*1024);
+	buffered("bio_write() 1M O_DIRECT","bio_read() 1M O_DIRECT",BIO_DIRECT,1024*1024);
+
+	////////////////////////////////// gather/scatter, all three arrays at once
+	sample(&s);
+	fd=open(path,O_WRONLY|O_CREAT|O_TRUNC,0644);
+	bio_writev(fd,f,3);
+	close(fd);
+	report("bio_writev() int+float+char",&s,bytes);
+
+	sample(&s);
+	fd=open(path,O_RDONLY);
+	bio_readv(fd,g,3);
+	close(fd);
+	report("bio_readv() int+float+char",&s,bytes);
+	check("bio_readv()");
+
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,487 @@
+// link_check.c for a whole tree: hard link groups and duplicate contents
+// cc -O2 -pthread -I../practice dupscan.c ../practice/pwalk.c -o dupscan
+//
+// Walks in parallel (practice/pwalk.c) recording (dev, ino, size, path)
+// for every regular file; paths go into per worker arenas, never one
+// malloc per name.  Names sharing (dev, ino) are hard links.  One name per
+// inode then goes through the duplicate stages:
+//   1. same size
+//   2. same hash of the first 4 KiB (pread)
+//   3. same hash of the whole file (mmap)
+// The hash is a 128 bit multiply-accumulate over 64 byte stripes, done
+// with AVX2 or SSE2 when the CPU has it; all variants give the same value.
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<dirent.h>
+#include<pthread.h>
+#include<sys/stat.h>
+#include<sys/mman.h>
+#include<sys/sysmacros.h>
+#if defined(__x86_64__)||defined(__i386__)
+#include<immintrin.h>
+#endif
+#include"pwalk.h"
+
+#define ARENA_CHUNK	(4*1024*1024)
+#define HEAD_BYTES	4096
+
+struct file {
+	uint64_t ino;
+	uint64_t size;
+	uint64_t dev;
+	const char *path;
+	uint64_t h[2];		/* 4 KiB hash, then full hash */
+	int bad;		/* could not be read */
+};
+
+struct arena {
+	struct arena *next;
+	size_t used;
+	char mem[ARENA_CHUNK];
+};
+
+struct wstate {
+	struct file *f;
+	size_t n,cap;
+	struct arena *a;
+} __attribute__((aligned(64)));
+
+static struct wstate *ws;
+static int nthreads;
+
+////////////////////////////////////////////////////////////// hash
+static const uint64_t K1[8]={
+	0x9e3779b185ebca87ull,0xc2b2ae3d27d4eb4full,0x165667b19e3779f9ull,0x85ebca77c2b2ae63ull,
+	0x27d4eb2f165667c5ull,0xd6e8feb86659fd93ull,0xa0761d6478bd642full,0xe7037ed1a0b428dbull};
+static const uint64_t K2[8]={
+	0x8ebc6af09c88c6e3ull,0x589965cc75374cc3ull,0x1d8e4e27c47d124full,0xbf58476d1ce4e5b9ull,
+	0x94d049bb133111ebull,0x2545f4914f6cdd1dull,0xff51afd7ed558ccdull,0xc4ceb9fe1a85ec53ull};
+#define PRIME32	0x9e3779b1u
+#define STRIPE	64
+
+/*
+ * acc[i]   += lo32(d^k) * hi32(d^k)
+ * acc[i^1] += d
+ * every 16 stripes: acc ^= acc>>47, acc ^= K2, acc *= PRIME32
+ */
+static void stripes_scalar(uint64_t *acc,const unsigned char *p,size_t nstripes)
+{
+	uint64_t d,dk;
+	size_t s;
+	int i;
+
+	for(s=0;s<nstripes;s++,p+=STRIPE)
+	{
+		for(i=0;i<8;i++)
+		{
+			memcpy(&d,p+8*i,8);
+			dk=d^K1[i];
+			acc[i^1]+=d;
+			acc[i]+=(dk&0xffffffff)*(dk>>32);
+		}
+		if(s%16==15)
+			for(i=0;i<8;i++)
+				acc[i]=((acc[i]^(acc[i]>>47))^K2[i])*PRIME32;
+	}
+}
+
+#if defined(__x86_64__)
+static void stripes_sse2(uint64_t *acc,const unsigned char *p,size_t nstripes)
+{
+	__m128i a[4],k1[4],k2[4],d,dk,prod,lo,hi;
+	const __m128i prime=_mm_set1_epi32(PRIME32);
+	size_t s;
+	int i;
+
+	for(i=0;i<4;i++)
+	{
+		a[i]=_mm_loadu_si128((const __m128i *)acc+i);
+		k1[i]=_mm_loadu_si128((const __m128i *)K1+i);
+		k2[i]=_mm_loadu_si128((const __m128i *)K2+i);
+	}
+	for(s=0;s<nstripes;s++,p+=STRIPE)
+	{
+		for(i=0;i<4;i++)
+		{
+			d=_mm_loadu_si128((const __m128i *)p+i);
+			dk=_mm_xor_si128(d,k1[i]);
+			prod=_mm_mul_epu32(dk,_mm_srli_epi64(dk,32));
+			a[i]=_mm_add_epi64(a[i],_mm_shuffle_epi32(d,_MM_SHUFFLE(1,0,3,2)));
+			a[i]=_mm_add_epi64(a[i],prod);
+		}
+		if(s%16==15)
+			for(i=0;i<4;i++)
+			{
+				a[i]=_mm_xor_si128(_mm_xor_si128(a[i],_mm_srli_epi64(a[i],47)),k2[i]);
+				lo=_mm_mul_epu32(a[i],prime);
+				hi=_mm_mul_epu32(_mm_srli_epi64(a[i],32),prime);
+				a[i]=_mm_add_epi64(lo,_mm_slli_epi64(hi,32));
+			}
+	}
+	for(i=0;i<4;i++)
+		_mm_storeu_si128((__m128i *)acc+i,a[i]);
+}
+
+__attribute__((target("avx2")))
+static void stripes_avx2(uint64_t *acc,const unsigned char *p,size_t nstripes)
+{
+	__m256i a[2],k1[2],k2[2],d,dk,prod,lo,hi;
+	const __m256i prime=_mm256_set1_epi32(PRIME32);
+	size_t s;
+	int i;
+
+	for(i=0;i<2;i++)
+	{
+		a[i]=_mm256_loadu_si256((const __m256i *)acc+i);
+		k1[i]=_mm256_loadu_si256((const __m256i *)K1+i);
+		k2[i]=_mm256_loadu_si256((const __m256i *)K2+i);
+	}
+	for(s=0;s<nstripes;s++,p+=STRIPE)
+	{
+		for(i=0;i<2;i++)
+		{
+			d=_mm256_loadu_si256((const __m256i *)p+i);
+			dk=_mm256_xor_si256(d,k1[i]);
+			prod=_mm256_mul_epu32(dk,_mm256_srli_epi64(dk,32));
+			a[i]=_mm256_add_epi64(a[i],_mm256_shuffle_epi32(d,_MM_SHUFFLE(1,0,3,2)));
+			a[i]=_mm256_add_epi64(a[i],prod);
+		}
+		if(s%16==15)
+			for(i=0;i<2;i++)
+			{
+				a[i]=_mm256_xor_si256(_mm256_xor_si256(a[i],_mm256_srli_epi64(a[i],47)),k2[i]);
+				lo=_mm256_mul_epu32(a[i],prime);
+				hi=_mm256_mul_epu32(_mm256_srli_epi64(a[i],32),prime);
+				a[i]=_mm256_add_epi64(lo,_mm256_slli_epi64(hi,32));
+			}
+	}
+	for(i=0;i<2;i++)
+		_mm256_storeu_si256((__m256i *)acc+i,a[i]);
+}
+#endif
+
+static void (*stripes)(uint64_t *,const unsigned char *,size_t)=stripes_scalar;
+
+static void hash_init(void)
+{
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		stripes=stripes_avx2;
+	else
+		stripes=stripes_sse2;
+#endif
+}
+
+static uint64_t fmix(uint64_t h)
+{
+	h^=h>>33;
+	h*=0xff51afd7ed558ccdull;
+	h^=h>>33;
+	h*=0xc4ceb9fe1a85ec53ull;
+	h^=h>>33;
+	return h;
+}
+
+static void hash128(const void *data,size_t len,uint64_t *out)
+{
+	const unsigned char *p=data;
+	unsigned char tail[STRIPE];
+	uint64_t acc[8];
+	size_t full=len/STRIPE;
+	int i;
+
+	for(i=0;i<8;i++)
+		acc[i]=K1[i]^K2[7-i];
+	stripes(acc,p,full);
+	if(len%STRIPE)
+	{
+		memset(tail,0,sizeof(tail));
+		memcpy(tail,p+full*STRIPE,len%STRIPE);
+		stripes_scalar(acc,tail,1);
+	}
+	out[0]=fmix(len*PRIME32);
+	out[1]=fmix(len^K2[0]);
+	for(i=0;i<8;i++)
+	{
+		out[0]=fmix(out[0]^acc[i]);
+		out[1]=fmix(out[1]+acc[7-i]*K1[i]);
+	}
+}
+
+////////////////////////////////////////////////////////////// walk
+static const char *save_path(struct wstate *w,struct pw_dir *d,const char *name)
+{
+	struct arena *a=w->a;
+	int n;
+
+	if(a==0||ARENA_CHUNK-a->used<PATH_MAX)
+	{
+		a=malloc(sizeof(*a));
+		if(a==0)
+			return 0;
+		a->next=w->a;
+		a->used=0;
+		w->a=a;
+	}
+	n=pw_path(d,name,a->mem+a->used,PATH_MAX);
+	if(n<0)
+		return 0;
+	a->used+=n+1;
+	return a->mem+a->used-n-1;
+}
+
+static int entry(struct pw_worker *pw,struct pw_dir *d,int dfd,const char *name,unsigned char type)
+{
+	struct wstate *w=&ws[pw->id];
+	struct statx x;
+	struct file *f;
+	void *p;
+
+	if(type!=DT_REG)
+		return 1;
+	if(statx(dfd,name,AT_SYMLINK_NOFOLLOW|AT_STATX_DONT_SYNC,STATX_INO|STATX_SIZE,&x)<0)
+		return 0;
+	if(w->n==w->cap)
+	{
+		p=realloc(w->f,(w->cap ? w->cap*2 : 4096)*sizeof(*w->f));
+		if(p==0)
+			return 0;
+		w->f=p;
+		w->cap=w->cap ? w->cap*2 : 4096;
+	}
+	f=&w->f[w->n];
+	f->ino=x.stx_ino;
+	f->size=x.stx_size;
+	f->dev=makedev(x.stx_dev_major,x.stx_dev_minor);
+	f->path=save_path(w,d,name);
+	if(f->path)
+		w->n++;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////// hashing pool
+static struct file **work;
+static size_t nwork,next_work;
+static int stage;
+
+static void hash_file(struct file *f)
+{
+	unsigned char buf[HEAD_BYTES];
+	struct stat st;
+	ssize_t n;
+	void *m;
+	int fd;
+
+	f->bad=1;
+	fd=open(f->path,O_RDONLY|O_NOATIME|O_CLOEXEC);
+	if(fd<0)
+		fd=open(f->path,O_RDONLY|O_CLOEXEC);
+	if(fd<0)
+		return;
+	/* changed since the walk: its size no longer groups it, and mapping
+	   the old size of a file that shrank would SIGBUS.  Skip it */
+	if(fstat(fd,&st)<0||(uint64_t)st.st_size!=f->size)
+	{
+		close(fd);
+		return;
+	}
+	if(stage==2)
+	{
+		n=pread(fd,buf,sizeof(buf),0);
+		if(n>=0)
+		{
+			hash128(buf,n,f->h);
+			f->bad=0;
+		}
+	}
+	else
+	{
+		m=mmap(0,f->size,PROT_READ,MAP_PRIVATE,fd,0);
+		if(m!=MAP_FAILED)
+		{
+			madvise(m,f->size,MADV_SEQUENTIAL);
+			hash128(m,f->size,f->h);
+			munmap(m,f->size);
+			f->bad=0;
+		}
+	}
+	close(fd);
+}
+
+static void *hasher(void *arg)
+{
+	size_t i;
+
+	(void)arg;
+	while((i=__atomic_fetch_add(&next_work,1,__ATOMIC_RELAXED))<nwork)
+		hash_file(work[i]);
+	return 0;
+}
+
+static void hash_all(int which)
+{
+	pthread_t *t=malloc(nthreads*sizeof(*t));
+	int i;
+
+	stage=which;
+	next_work=0;
+	for(i=0;i<nthreads;i++)
+		pthread_create(&t[i],0,hasher,0);
+	for(i=0;i<nthreads;i++)
+		pthread_join(t[i],0);
+	free(t);
+}
+
+////////////////////////////////////////////////////////////// grouping
+static int by_inode(const void *a,const void *b)
+{
+	const struct file *x=a,*y=b;
+
+	if(x->dev!=y->dev)
+		return x->dev<y->dev ? -1 : 1;
+	if(x->ino!=y->ino)
+		return x->ino<y->ino ? -1 : 1;
+	return 0;
+}
+
+static int by_content(const void *a,const void *b)
+{
+	const struct file *x=*(struct file *const *)a,*y=*(struct file *const *)b;
+
+	if(x->size!=y->size)
+		return x->size<y->size ? -1 : 1;
+	if(x->h[0]!=y->h[0])
+		return x->h[0]<y->h[0] ? -1 : 1;
+	if(x->h[1]!=y->h[1])
+		return x->h[1]<y->h[1] ? -1 : 1;
+	return 0;
+}
+
+/* keep only members of runs (by cmp) longer than one */
+static size_t keep_groups(struct file **v,size_t n)
+{
+	size_t i,j,k=0;
+
+	for(i=0;i<n;i++)
+		if(!v[i]->bad)
+			v[k++]=v[i];
+	n=k;
+	k=0;
+	qsort(v,n,sizeof(*v),by_content);
+	for(i=0;i<n;i=j)
+	{
+		for(j=i+1;j<n&&by_content(&v[i],&v[j])==0;j++)
+			;
+		if(j-i>1)
+			while(i<j)
+				v[k++]=v[i++];
+	}
+	return k;
+}
+
+static size_t print_groups(struct file **v,size_t n)
+{
+	size_t i,j,k,groups=0;
+
+	for(i=0;i<n;i=j)
+	{
+		for(j=i+1;j<n&&by_content(&v[i],&v[j])==0;j++)
+			;
+		printf("duplicate (size %llu), %zu files:\n",(unsigned long long)v[i]->size,j-i);
+		for(k=i;k<j;k++)
+			printf("\t%s\n",v[k]->path);
+		groups++;
+	}
+	return groups;
+}
+
+int main(int argc,char **argv)
+{
+	struct pw_ops ops={0};
+	struct file *all,**big;
+	size_t n=0,i,j,k,m,links=0,dups=0;
+	int opt;
+
+	nthreads=pw_ncpu();
+	while((opt=getopt(argc,argv,"j:"))!=-1)
+	{
+		if(opt!='j')
+		{
+			printf("usage:./a.out [-j threads] dir\n");
+			return 1;
+		}
+		nthreads=atoi(optarg);
+	}
+	if(argc-optind!=1||nthreads<1)
+	{
+		printf("usage:./a.out [-j threads] dir\n");
+		return 1;
+	}
+	hash_init();
+
+	ws=aligned_alloc(64,nthreads*sizeof(*ws));
+	memset(ws,0,nthreads*sizeof(*ws));
+	ops.entry=entry;
+	if(pw_run(argv[optind],nthreads,&ops,0)<0)
+		return 1;
+
+	for(i=0;i<(size_t)nthreads;i++)
+		n+=ws[i].n;
+	all=malloc((n ? n : 1)*sizeof(*all));
+	for(i=0,k=0;i<(size_t)nthreads;i++)
+	{
+		memcpy(all+k,ws[i].f,ws[i].n*sizeof(*all));
+		k+=ws[i].n;
+		free(ws[i].f);
+	}
+
+	/* hard links: same (dev, ino) */
+	qsort(all,n,sizeof(*all),by_inode);
+	work=malloc((n ? n : 1)*sizeof(*work));
+	for(i=0,m=0;i<n;i=j)
+	{
+		for(j=i+1;j<n&&by_inode(&all[i],&all[j])==0;j++)
+			;
+		if(j-i>1)
+		{
+			printf("hard link (dev %u:%u ino %llu), %zu names:\n",major(all[i].dev),
+			       minor(all[i].dev),(unsigned long long)all[i].ino,j-i);
+			for(k=i;k<j;k++)
+				printf("\t%s\n",all[k].path);
+			links++;
+		}
+		if(all[i].size>0)
+		{
+			all[i].h[0]=all[i].h[1]=0;
+			all[i].bad=0;
+			work[m++]=&all[i];	/* one name per inode */
+		}
+	}
+
+	/* duplicates: size, then first 4 KiB, then everything */
+	nwork=keep_groups(work,m);
+	hash_all(2);
+	nwork=keep_groups(work,nwork);
+
+	/* up to 4 KiB the head hash already covers the whole file */
+	big=malloc((nwork ? nwork : 1)*sizeof(*big));
+	for(i=0,k=0,m=0;i<nwork;i++)
+		if(work[i]->size>HEAD_BYTES)
+			big[k++]=work[i];
+		else
+			work[m++]=work[i];
+	dups=print_groups(work,m);
+	work=big;
+	nwork=k;
+	hash_all(3);
+	dups+=print_groups(big,keep_groups(big,k));
+
+	printf("%zu files, %zu hard link groups, %zu duplicate groups\n",n,links,dups);
+	return 0;
+}
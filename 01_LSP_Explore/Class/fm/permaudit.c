@@ -0,0 +1,376 @@
+// check_permission.c for a whole tree: report only what breaks a rule
+// cc -O2 -pthread -I../practice permaudit.c ../practice/pwalk.c -o permaudit
+//
+//   ./a.out [-j threads] [-r rule]... [-l] dir
+//
+// A rule is  name:cond,cond,...  and matches when every cond holds:
+//   type=fdlcbps     file type is one of these (ls -l letters, f = regular)
+//   any=OCT          at least one of these mode bits is set
+//   all=OCT          all of these mode bits are set
+//   none=OCT         none of these mode bits are set
+//   uid=N uid!=N gid=N gid!=N
+//   uid!=dir gid!=dir   owner / group differs from the containing directory
+//   (at most one uid and one gid condition per rule)
+// Without -r the built-in rules below are used; -l lists them.
+//
+// Rules are compiled once into masks and compares.  The statx mask asked
+// for is the union of what the rules look at, and entries whose d_type no
+// rule cares about are not stat'ed at all.  Output is one line per
+// violation, "rule mode uid gid path", buffered per worker.
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<limits.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<dirent.h>
+#include<time.h>
+#include<sys/stat.h>
+#include"pwalk.h"
+
+#define MAXRULES	32
+#define OUTSZ		(64*1024)
+
+#define C_UID		1	/* uid == / != value */
+#define C_GID		2
+#define C_UID_DIR	4	/* uid != directory's */
+#define C_GID_DIR	8
+#define C_UID_NOT	16	/* C_UID compares with != */
+#define C_GID_NOT	32	/* C_GID compares with != */
+
+struct rule {
+	char name[32];
+	uint32_t types;		/* bit (mode>>12) per S_IFMT value */
+	uint16_t any,all,none;
+	int flags;
+	uint32_t uid,gid;
+};
+
+struct dstat {
+	uint32_t uid,gid;
+	int ok;			/* the directory's statx worked */
+};
+
+struct wstate {
+	uint64_t seen,stats,hits;
+	char buf[OUTSZ];
+	int len;
+} __attribute__((aligned(64)));
+
+static const char *presets[]={
+	"world-writable:type=f,any=0002",
+	"world-writable-dir:type=d,any=0002,none=01000",
+	"setuid:type=f,any=04000",
+	"setgid:type=f,any=02000",
+	"group-mismatch:type=fd,gid!=dir",
+	0
+};
+
+static struct rule rules[MAXRULES];
+static int nrules;
+static uint32_t want_types;	/* union of rules[].types */
+static unsigned want_mask;	/* statx mask */
+static int need_dir;		/* some rule looks at the directory's owner */
+static struct wstate *ws;
+
+//////////////////////////////////////////////////////////////
+static uint32_t type_bit(const char c)
+{
+	switch(c)
+	{
+	case 'f': return 1u<<(S_IFREG>>12);
+	case 'd': return 1u<<(S_IFDIR>>12);
+	case 'l': return 1u<<(S_IFLNK>>12);
+	case 'c': return 1u<<(S_IFCHR>>12);
+	case 'b': return 1u<<(S_IFBLK>>12);
+	case 'p': return 1u<<(S_IFIFO>>12);
+	case 's': return 1u<<(S_IFSOCK>>12);
+	}
+	return 0;
+}
+
+static uint32_t dt_bit(unsigned char t)
+{
+	/* DT_* is S_IFMT>>12 */
+	return 1u<<t;
+}
+
+/* all of v a number in base, at most max; strtoul alone takes "-1" as ULONG_MAX */
+static int number(const char *v,int base,unsigned long max,unsigned long *n)
+{
+	char *end;
+
+	if(*v<'0'||*v>'9')
+		return -1;
+	errno=0;
+	*n=strtoul(v,&end,base);
+	if(*end||errno==ERANGE||*n>max)
+		return -1;
+	return 0;
+}
+
+static int id_cond(struct rule *r,const char *v,int not,int is_uid)
+{
+	unsigned long id;
+
+	/* one condition per field: a second would silently replace the first */
+	if(r->flags&(is_uid ? C_UID|C_UID_DIR : C_GID|C_GID_DIR))
+		return -1;
+	if(strcmp(v,"dir")==0)
+	{
+		if(!not)
+			return -1;
+		r->flags|=is_uid ? C_UID_DIR : C_GID_DIR;
+		need_dir=1;
+		return 0;
+	}
+	/* (uid_t)-1 is "no id" to the kernel, never an owner */
+	if(number(v,10,UINT32_MAX-1,&id)<0)
+		return -1;
+	if(is_uid)
+	{
+		r->uid=id;
+		r->flags|=C_UID;
+	}
+	else
+	{
+		r->gid=id;
+		r->flags|=C_GID;
+	}
+	if(not)
+		r->flags|=is_uid ? C_UID_NOT : C_GID_NOT;
+	return 0;
+}
+
+static int compile(const char *src)
+{
+	struct rule *r=&rules[nrules];
+	char buf[256],*name,*cond,*v;
+	const char *p;
+	unsigned long m;
+
+	if(nrules==MAXRULES)
+		return -1;
+	snprintf(buf,sizeof(buf),"%s",src);
+	memset(r,0,sizeof(*r));
+	name=buf;
+	cond=strchr(buf,':');
+	if(cond==0)
+		return -1;
+	*cond++=0;
+	snprintf(r->name,sizeof(r->name),"%.31s",name);
+	r->types=~0u;
+
+	for(cond=strtok(cond,",");cond;cond=strtok(0,","))
+	{
+		v=strchr(cond,'=');
+		if(v==0)
+			return -1;
+		*v++=0;
+		if(strcmp(cond,"type")==0)
+		{
+			r->types=0;
+			for(p=v;*p;p++)
+			{
+				if(type_bit(*p)==0)
+					return -1;
+				r->types|=type_bit(*p);
+			}
+			continue;
+		}
+		if(strcmp(cond,"uid")==0||strcmp(cond,"uid!")==0)
+		{
+			if(id_cond(r,v,cond[3]=='!',1)<0)
+				return -1;
+			continue;
+		}
+		if(strcmp(cond,"gid")==0||strcmp(cond,"gid!")==0)
+		{
+			if(id_cond(r,v,cond[3]=='!',0)<0)
+				return -1;
+			continue;
+		}
+		if(number(v,8,07777,&m)<0)
+			return -1;
+		if(strcmp(cond,"any")==0)
+			r->any|=m;
+		else if(strcmp(cond,"all")==0)
+			r->all|=m;
+		else if(strcmp(cond,"none")==0)
+			r->none|=m;
+		else
+			return -1;
+	}
+
+	want_types|=r->types;
+	want_mask|=STATX_TYPE;
+	if(r->any||r->all||r->none)
+		want_mask|=STATX_MODE;
+	if(r->flags&(C_UID|C_UID_DIR))
+		want_mask|=STATX_UID;
+	if(r->flags&(C_GID|C_GID_DIR))
+		want_mask|=STATX_GID;
+	nrules++;
+	return 0;
+}
+
+static int match(const struct rule *r,const struct statx *x,const struct dstat *ds)
+{
+	unsigned mode=x->stx_mode&07777;
+
+	if(!(r->types&(1u<<(x->stx_mode>>12))))
+		return 0;
+	if(r->any&&!(mode&r->any))
+		return 0;
+	if((mode&r->all)!=r->all)
+		return 0;
+	if(mode&r->none)
+		return 0;
+	if((r->flags&C_UID)&&(x->stx_uid==r->uid)==!!(r->flags&C_UID_NOT))
+		return 0;
+	if((r->flags&C_GID)&&(x->stx_gid==r->gid)==!!(r->flags&C_GID_NOT))
+		return 0;
+	/* without the directory's owner there is nothing to differ from */
+	if((r->flags&C_UID_DIR)&&(!ds||!ds->ok||x->stx_uid==ds->uid))
+		return 0;
+	if((r->flags&C_GID_DIR)&&(!ds||!ds->ok||x->stx_gid==ds->gid))
+		return 0;
+	return 1;
+}
+
+//////////////////////////////////////////////////////////////
+static void flush(struct wstate *s)
+{
+	if(s->len)
+		write(1,s->buf,s->len);
+	s->len=0;
+}
+
+static void report(struct wstate *s,const struct rule *r,const struct statx *x,
+		   struct pw_dir *d,const char *name)
+{
+	int n;
+
+	if(OUTSZ-s->len<PATH_MAX+96)
+		flush(s);
+	n=sprintf(s->buf+s->len,"%s\t%04o\t%u\t%u\t",r->name,x->stx_mode&07777,x->stx_uid,x->stx_gid);
+	if(pw_path(d,name,s->buf+s->len+n,OUTSZ-s->len-n-1)<0)
+		return;
+	s->len+=n+strlen(s->buf+s->len+n);
+	s->buf[s->len++]='\n';
+	s->hits++;
+}
+
+static int entry(struct pw_worker *w,struct pw_dir *d,int dfd,const char *name,unsigned char type)
+{
+	struct wstate *s=&ws[w->id];
+	struct statx x;
+	int i;
+
+	s->seen++;
+	if(want_types&dt_bit(type))
+	{
+		s->stats++;
+		if(statx(dfd,name,AT_SYMLINK_NOFOLLOW|AT_STATX_DONT_SYNC,want_mask,&x)==0)
+			for(i=0;i<nrules;i++)
+				if(match(&rules[i],&x,d->priv))
+					report(s,&rules[i],&x,d,name);
+	}
+	return type==DT_DIR;
+}
+
+static void dir_enter(struct pw_worker *w,struct pw_dir *d,int dfd)
+{
+	struct dstat *ds=d->priv;
+	struct statx x;
+
+	(void)w;
+	ds->ok=statx(dfd,"",AT_EMPTY_PATH|AT_STATX_DONT_SYNC,STATX_UID|STATX_GID,&x)==0;
+	if(ds->ok)
+	{
+		ds->uid=x.stx_uid;
+		ds->gid=x.stx_gid;
+	}
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+int main(int argc,char **argv)
+{
+	struct pw_ops ops={0};
+	uint64_t seen=0,stats=0,hits=0;
+	double t;
+	int opt,i,list=0,nthreads=pw_ncpu();
+
+	while((opt=getopt(argc,argv,"j:r:l"))!=-1)
+	{
+		switch(opt)
+		{
+		case 'j':
+			nthreads=atoi(optarg);
+			break;
+		case 'r':
+			if(compile(optarg)<0)
+			{
+				fprintf(stderr,"bad rule: %s\n",optarg);
+				return 1;
+			}
+			break;
+		case 'l':
+			list=1;
+			break;
+		default:
+			printf("usage:./a.out [-j threads] [-r name:cond,...]... [-l] dir\n");
+			return 1;
+		}
+	}
+	if(list)
+	{
+		for(i=0;presets[i];i++)
+			printf("%s\n",presets[i]);
+		return 0;
+	}
+	if(argc-optind!=1||nthreads<1)
+	{
+		printf("usage:./a.out [-j threads] [-r name:cond,...]... [-l] dir\n");
+		return 1;
+	}
+	if(nrules==0)
+		for(i=0;presets[i];i++)
+			compile(presets[i]);
+
+	ws=aligned_alloc(64,nthreads*sizeof(*ws));
+	memset(ws,0,nthreads*sizeof(*ws));
+	ops.entry=entry;
+	if(need_dir)
+	{
+		ops.dir_enter=dir_enter;
+		ops.dir_size=sizeof(struct dstat);
+	}
+
+	t=now();
+	if(pw_run(argv[optind],nthreads,&ops,0)<0)
+		return 1;
+	t=now()-t;
+
+	for(i=0;i<nthreads;i++)
+	{
+		flush(&ws[i]);
+		seen+=ws[i].seen;
+		stats+=ws[i].stats;
+		hits+=ws[i].hits;
+	}
+	fprintf(stderr,"%llu entries, %llu stat'ed, %llu violations, %.2fs, %.0f entries/s\n",
+		(unsigned long long)seen,(unsigned long long)stats,(unsigned long long)hits,
+		t,t>0 ? seen/t : 0);
+	return 0;
+}
@@ -1,20 +1,23 @@
+// cc read_array.c bio.c
 #include<stdio.h>
 #include<sys/types.h>
 #include<sys/stat.h>
 #include<fcntl.h>
+#include"bio.h"
 main()
 {
-	int fd,i;
+	int i;
+	struct bio b;
 	char a[10];
 
-	fd=open("dataint",O_RDONLY);
-	if(fd<0)
+	if(bio_open(&b,"dataint",BIO_READ,0)<0)
 	{
 		perror("open");
 		return;
 	}
 
-	read(fd,&a,sizeof(a));
+	bio_read(&b,&a,sizeof(a));
+	bio_close(&b);
 	for(i=0; i<5; i++)
 	printf("%d\n",a[i]);
 }
@@ -1,19 +1,21 @@
+// cc read_float.c bio.c
 #include<stdio.h>
 #include<sys/types.h>
 #include<sys/stat.h>
 #include<fcntl.h>
+#include"bio.h"
 main()
 {
-	int fd;
+	struct bio b;
 	float f;
 
-	fd=open("dataint",O_RDONLY);
-	if(fd<0)
+	if(bio_open(&b,"dataint",BIO_READ,0)<0)
 	{
 		perror("open");
 		return;
 	}
 
-	read(fd,&f,sizeof(f));
+	bio_read(&b,&f,sizeof(f));
+	bio_close(&b);
 	printf("%f\n",f);
 }
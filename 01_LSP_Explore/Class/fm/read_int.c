@@ -1,18 +1,21 @@
+// cc read_int.c bio.c
 #include<stdio.h>
 #include<sys/types.h>
 #include<sys/stat.h>
 #include<fcntl.h>
+#include"bio.h"
 main()
 {
-	int fd,i;
+	int i;
+	struct bio b;
 
-	fd=open("dataint",O_RDONLY);
-	if(fd<0)
+	if(bio_open(&b,"dataint",BIO_READ,0)<0)
 	{
 		perror("open");
 		return;
 	}
 
-	read(fd,&i,sizeof(i));
+	bio_read(&b,&i,sizeof(i));
+	bio_close(&b);
 	printf("%d\n",i);
 }
@@ -1,19 +1,21 @@
+// cc read_string.c bio.c
 #include<stdio.h>
 #include<sys/types.h>
 #include<sys/stat.h>
 #include<fcntl.h>
+#include"bio.h"
 main()
 {
-	int fd;
+	struct bio b;
 	char s[20];
 
-	fd=open("dataint",O_RDONLY);
-	if(fd<0)
+	if(bio_open(&b,"dataint",BIO_READ,0)<0)
 	{
 		perror("open");
 		return;
 	}
 
-	read(fd,s,sizeof(s));
+	bio_read(&b,s,sizeof(s));
+	bio_close(&b);
 	printf("%s\n",s);
 }
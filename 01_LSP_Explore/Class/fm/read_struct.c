@@ -1,7 +1,9 @@
+// cc read_struct.c bio.c
 #include<stdio.h>
 #include<sys/types.h>
 #include<sys/stat.h>
 #include<fcntl.h>
+#include"bio.h"
 struct st
 {
 int no;
@@ -15,14 +17,14 @@ main()
 typedef struct st ST;
 
 ST s1;	
-int fd;
-	fd=open("dataint",O_RDONLY);
-	if(fd<0)
+struct bio b;
+	if(bio_open(&b,"dataint",BIO_READ,0)<0)
 	{
 		perror("open");
 		return;
 	}
 
-	read(fd,&s1,sizeof(ST));
+	bio_read(&b,&s1,sizeof(ST));
+	bio_close(&b);
 	printf("%d %s %f\n",s1.no,s1.name,s1.marks);
 }
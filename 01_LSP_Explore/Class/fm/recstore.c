@@ -0,0 +1,158 @@
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/stat.h>
+#include<sys/mman.h>
+#include"recstore.h"
+
+#define RS_EXTENT	(64*1024*1024)	/* grow by at least this many bytes */
+
+int rs_open(struct recstore *rs,const char *path,size_t rec_size,int flags)
+{
+	struct rs_hdr h;
+	struct stat v;
+	int oflags;
+
+	memset(rs,0,sizeof(*rs));
+	rs->flags=flags;
+	rs->rec_size=rec_size;
+	if(flags&RS_RDONLY)
+		oflags=O_RDONLY;
+	else
+		oflags=O_RDWR|(flags&RS_CREAT ? O_CREAT : 0)|(flags&RS_TRUNC ? O_TRUNC : 0);
+	rs->fd=open(path,oflags|O_CLOEXEC,0644);
+	if(rs->fd<0)
+		return -1;
+	if(fstat(rs->fd,&v)<0)
+		goto fail;
+
+	if(v.st_size==0&&!(flags&RS_RDONLY))
+	{
+		memset(&h,0,sizeof(h));
+		memcpy(h.magic,RS_MAGIC,8);
+		h.version=RS_VERSION;
+		h.rec_size=rec_size;
+		if(ftruncate(rs->fd,RS_DATA_OFF)<0||pwrite(rs->fd,&h,sizeof(h),0)!=sizeof(h))
+			goto fail;
+		v.st_size=RS_DATA_OFF;
+	}
+	else
+	{
+		if(pread(rs->fd,&h,sizeof(h),0)!=sizeof(h)||memcmp(h.magic,RS_MAGIC,8)||
+		   h.version!=RS_VERSION||h.rec_size!=rec_size||v.st_size<RS_DATA_OFF)
+		{
+			errno=EINVAL;
+			goto fail;
+		}
+	}
+
+	rs->map_len=v.st_size;
+	rs->cap=(v.st_size-RS_DATA_OFF)/rec_size;
+	rs->map=mmap(0,rs->map_len,flags&RS_RDONLY ? PROT_READ : PROT_READ|PROT_WRITE,
+		     MAP_SHARED,rs->fd,0);
+	if(rs->map==MAP_FAILED)
+		goto fail;
+	if(rs_count(rs)>rs->cap)
+	{
+		munmap(rs->map,rs->map_len);
+		errno=EINVAL;
+		goto fail;
+	}
+	return 0;
+fail:
+	oflags=errno;
+	close(rs->fd);
+	errno=oflags;
+	return -1;
+}
+
+/* make room for n more records past count */
+int rs_reserve(struct recstore *rs,uint64_t n)
+{
+	uint64_t need=rs_count(rs)+n,cap=rs->cap;
+	uint64_t extent=RS_EXTENT/rs->rec_size;
+	size_t len;
+	char *m;
+
+	if(need<=rs->cap)
+		return 0;
+	if(rs->flags&RS_RDONLY)
+	{
+		errno=EBADF;
+		return -1;
+	}
+	if(extent==0)
+		extent=1;	/* a record bigger than RS_EXTENT: grow one at a time */
+	if(cap<extent)
+		cap=extent;
+	while(cap<need)
+		cap*=2;
+	len=RS_DATA_OFF+cap*rs->rec_size;
+
+	/* real blocks, not a sparse hole, so stores into the map can't SIGBUS on ENOSPC */
+	if(fallocate(rs->fd,0,rs->map_len,len-rs->map_len)<0)
+	{
+		if(errno!=EOPNOTSUPP||ftruncate(rs->fd,len)<0)
+			return -1;
+	}
+	m=mremap(rs->map,rs->map_len,len,MREMAP_MAYMOVE);
+	if(m==MAP_FAILED)
+		return -1;
+	rs->map=m;
+	rs->map_len=len;
+	rs->cap=cap;
+	return 0;
+}
+
+void *rs_append(struct recstore *rs)
+{
+	struct rs_hdr *h;
+
+	if(rs_reserve(rs,1)<0)
+		return 0;
+	h=(struct rs_hdr *)rs->map;
+	return rs_get(rs,h->count++);
+}
+
+int rs_put(struct recstore *rs,const void *rec)
+{
+	void *p=rs_append(rs);
+
+	if(p==0)
+		return -1;
+	memcpy(p,rec,rs->rec_size);
+	return 0;
+}
+
+int rs_foreach(struct recstore *rs,int (*fn)(void *,uint64_t,void *),void *arg)
+{
+	uint64_t i,n=rs_count(rs);
+	int r;
+
+	madvise(rs->map,rs->map_len,MADV_SEQUENTIAL);
+	for(i=0;i<n;i++)
+		if((r=fn(rs_get(rs,i),i,arg)))
+			return r;
+	return 0;
+}
+
+int rs_sync(struct recstore *rs)
+{
+	return msync(rs->map,rs->map_len,MS_SYNC);
+}
+
+int rs_close(struct recstore *rs)
+{
+	uint64_t n=rs_count(rs);
+	int r=0;
+
+	munmap(rs->map,rs->map_len);
+	if(!(rs->flags&RS_RDONLY)&&ftruncate(rs->fd,RS_DATA_OFF+n*rs->rec_size)<0)
+		r=-1;
+	if(close(rs->fd)<0)
+		r=-1;
+	return r;
+}
@@ -0,0 +1,62 @@
+#ifndef RECSTORE_H
+#define RECSTORE_H
+
+#include<stdint.h>
+#include<stddef.h>
+
+/*
+ * Fixed size record file, e.g. the struct st of write_structure.c.
+ *
+ * The file starts with a versioned header (one page) followed by the
+ * records back to back.  The whole file is mmap'd: rs_get() and
+ * rs_append() hand out pointers straight into the mapping, nothing is
+ * copied.  Appends grow the file in large extents (fallocate + mremap), so
+ * a pointer from rs_get()/rs_append() is only good until the next append.
+ * rs_close() trims the file back to the records actually written.
+ */
+
+#define RS_MAGIC	"RECSTOR1"
+#define RS_VERSION	1
+#define RS_DATA_OFF	4096
+
+#define RS_CREAT	1
+#define RS_TRUNC	2
+#define RS_RDONLY	4
+
+struct rs_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t rec_size;
+	uint64_t count;		/* records written */
+};
+
+struct recstore {
+	int fd;
+	int flags;
+	size_t rec_size;
+	char *map;		/* header at 0, records at RS_DATA_OFF */
+	size_t map_len;
+	uint64_t cap;		/* records that fit in the mapping */
+};
+
+int rs_open(struct recstore *rs, const char *path, size_t rec_size, int flags);
+void *rs_append(struct recstore *rs);
+int rs_put(struct recstore *rs, const void *rec);
+int rs_reserve(struct recstore *rs, uint64_t n);
+int rs_sync(struct recstore *rs);
+int rs_close(struct recstore *rs);
+
+static inline uint64_t rs_count(const struct recstore *rs)
+{
+	return ((const struct rs_hdr *)rs->map)->count;
+}
+
+static inline void *rs_get(const struct recstore *rs, uint64_t i)
+{
+	return rs->map + RS_DATA_OFF + i * rs->rec_size;
+}
+
+/* calls fn on every record in order, stops early if fn returns non zero */
+int rs_foreach(struct recstore *rs, int (*fn)(void *rec, uint64_t i, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,152 @@
+// one write()/read() per struct st (write_structure.c, read_struct.c)
+// against recstore.c
+// cc -O2 recstore_bench.c recstore.c -o recstore_bench
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<time.h>
+#include"recstore.h"
+
+struct st
+{
+	int rollno;
+	char name[128];
+	float marks;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static void report(const char *what,long n,double t)
+{
+	printf("%-28s %10.3f s %14.0f rec/s %10.1f MB/s\n",what,t,n/t,
+	       n*sizeof(struct st)/t/1e6);
+}
+
+static int sum_marks(void *rec,uint64_t i,void *arg)
+{
+	(void)i;
+	*(double *)arg+=((struct st *)rec)->marks;
+	return 0;
+}
+
+int main(int argc,char **argv)
+{
+	long i,n=10000000,lookups=1000000;
+	struct recstore rs;
+	struct st s1,*p;
+	double t,sum1=0,sum2=0;
+	unsigned seed=1;
+	int fd;
+	/* scratch files, never the dataint the read_* programs use */
+	char path[]="recstore_bench.XXXXXX",rspath[]="recstore_bench.rs.XXXXXX";
+
+	if(argc>2)
+	{
+		printf("usage:./a.out [records]\n");
+		return 1;
+	}
+	if(argc==2)
+		n=atol(argv[1]);
+	if(lookups>n)
+		lookups=n;
+	memset(&s1,0,sizeof(s1));
+	strcpy(s1.name,"abcd");
+
+	fd=mkstemp(rspath);
+	if(fd<0)
+	{
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+
+	////////////////////////////////// per record syscalls
+	fd=mkstemp(path);
+	if(fd<0)
+	{
+		perror("mkstemp");
+		unlink(rspath);
+		return 1;
+	}
+	t=now();
+	for(i=0;i<n;i++)
+	{
+		s1.rollno=i;
+		s1.marks=i%100;
+		write(fd,&s1,sizeof(s1));
+	}
+	fsync(fd);
+	report("write() per record",n,now()-t);
+	close(fd);
+
+	fd=open(path,O_RDONLY);
+	t=now();
+	for(i=0;i<n;i++)
+	{
+		read(fd,&s1,sizeof(s1));
+		sum1+=s1.marks;
+	}
+	report("read() per record",n,now()-t);
+
+	t=now();
+	for(i=0;i<lookups;i++)
+	{
+		pread(fd,&s1,sizeof(s1),(rand_r(&seed)%n)*sizeof(s1));
+		sum1+=s1.rollno;
+	}
+	report("pread() random",lookups,now()-t);
+	close(fd);
+	unlink(path);
+
+	////////////////////////////////// record store
+	if(rs_open(&rs,rspath,sizeof(struct st),RS_CREAT|RS_TRUNC)<0)
+	{
+		perror("rs_open");
+		return 1;
+	}
+	t=now();
+	for(i=0;i<n;i++)
+	{
+		p=rs_append(&rs);
+		if(p==0)
+		{
+			perror("rs_append");
+			return 1;
+		}
+		p->rollno=i;
+		strcpy(p->name,"abcd");
+		p->marks=i%100;
+	}
+	rs_sync(&rs);
+	report("rs_append()",n,now()-t);
+	rs_close(&rs);
+
+	if(rs_open(&rs,rspath,sizeof(struct st),RS_RDONLY)<0)
+	{
+		perror("rs_open");
+		return 1;
+	}
+	t=now();
+	rs_foreach(&rs,sum_marks,&sum2);
+	report("rs_foreach()",n,now()-t);
+
+	seed=1;
+	t=now();
+	for(i=0;i<lookups;i++)
+		sum2+=((struct st *)rs_get(&rs,rand_r(&seed)%n))->rollno;
+	report("rs_get() random",lookups,now()-t);
+	rs_close(&rs);
+	unlink(rspath);
+
+	if(sum1!=sum2)
+		printf("checksum mismatch %f %f\n",sum1,sum2);
+	return 0;
+}
@@ -1,20 +1,22 @@
+// cc write_char.c bio.c
 #include<stdio.h>
 #include<sys/types.h>
 #include<sys/stat.h>
 #include<fcntl.h>
+#include"bio.h"
 main()
 {
 	char ch='D';
 
-	int fd;
+	struct bio b;
 
-	fd=open("dataint",O_WRONLY|O_CREAT|O_TRUNC,0644);
-	if(fd<0)
+	if(bio_open(&b,"dataint",BIO_WRITE,0)<0)
 	{
 		perror("open");
 		return;
 	}
-	write(fd,&ch,sizeof(ch));
+	bio_write(&b,&ch,sizeof(ch));
+	bio_close(&b);
 
 
 }
@@ -1,20 +1,22 @@
+// cc write_int.c bio.c
 #include<stdio.h>
 #include<sys/types.h>
 #include<sys/stat.h>
 #include<fcntl.h>
+#include"bio.h"
 main()
 {
 	int i=10;
 
-	int fd;
+	struct bio b;
 
-	fd=open("dataint",O_WRONLY|O_CREAT|O_TRUNC,0644);
-	if(fd<0)
+	if(bio_open(&b,"dataint",BIO_WRITE,0)<0)
 	{
 		perror("open");
 		return;
 	}
-	write(fd,&i,sizeof(i));
+	bio_write(&b,&i,sizeof(i));
+	bio_close(&b);
 
 
 }
@@ -1,5 +1,7 @@
+// cc write_structure.c bio.c
 #include<stdio.h>
 #include<fcntl.h>
+#include"bio.h"
 #include<sys/types.h>
 #include<sys/stat.h>
 struct st
@@ -14,13 +16,14 @@ main()
 typedef struct st ST;
 
 	ST s1={10,"abcd",22.66};
-	int fd;
+	struct bio b;
 
-	fd=open("dataint",O_WRONLY|O_CREAT|O_TRUNC,0644);
-	if(fd<0)
+	if(bio_open(&b,"dataint",BIO_WRITE,0)<0)
 	{
 	perror("open");
+	return;
 	}
 	
-	write(fd,&s1,sizeof(ST));
+	bio_write(&b,&s1,sizeof(ST));
+	bio_close(&b);
 }
@@ -0,0 +1,129 @@
+#include<string.h>
+#include"calrpc.h"
+
+static void put16(char *p,uint16_t v)
+{
+	p[0]=v;
+	p[1]=v>>8;
+}
+
+static void put32(char *p,uint32_t v)
+{
+	p[0]=v;
+	p[1]=v>>8;
+	p[2]=v>>16;
+	p[3]=v>>24;
+}
+
+static uint16_t get16(const char *p)
+{
+	const unsigned char *u=(const unsigned char *)p;
+
+	return u[0]|u[1]<<8;
+}
+
+static uint32_t get32(const char *p)
+{
+	const unsigned char *u=(const unsigned char *)p;
+
+	return u[0]|u[1]<<8|u[2]<<16|(uint32_t)u[3]<<24;
+}
+
+int cal_put_req(char *buf,size_t len,const struct cal_req *r)
+{
+	size_t n=strlen(r->name),i,need;
+	char *p;
+
+	need=CAL_REQ_HDR+n+(size_t)r->count*CAL_OP_SIZE;
+	if(n>CAL_MAXNAME||r->count<1||r->count>CAL_MAXOPS||need>len||need>PIPE_BUF)
+		return -1;
+	put16(buf,CAL_REQ_MAGIC);
+	buf[2]=CAL_VERSION;
+	buf[3]=r->count;
+	put32(buf+4,r->id);
+	buf[8]=n;
+	memcpy(buf+CAL_REQ_HDR,r->name,n);
+	p=buf+CAL_REQ_HDR+n;
+	for(i=0;i<(size_t)r->count;i++,p+=CAL_OP_SIZE)
+	{
+		p[0]=r->ops[i].op;
+		put32(p+1,r->ops[i].a);
+		put32(p+5,r->ops[i].b);
+	}
+	return need;
+}
+
+int cal_get_req(const char *buf,size_t len,struct cal_req *r)
+{
+	size_t n,need;
+	const char *p;
+	int i;
+
+	if(len<CAL_REQ_HDR)
+		return 0;
+	if(get16(buf)!=CAL_REQ_MAGIC||buf[2]!=CAL_VERSION)
+		return -1;
+	n=(unsigned char)buf[8];
+	r->count=(unsigned char)buf[3];
+	if(n==0||n>CAL_MAXNAME||r->count<1||r->count>CAL_MAXOPS)
+		return -1;
+	need=CAL_REQ_HDR+n+(size_t)r->count*CAL_OP_SIZE;
+	if(len<need)
+		return 0;
+	r->id=get32(buf+4);
+	memcpy(r->name,buf+CAL_REQ_HDR,n);
+	r->name[n]=0;
+	p=buf+CAL_REQ_HDR+n;
+	for(i=0;i<r->count;i++,p+=CAL_OP_SIZE)
+	{
+		r->ops[i].op=p[0];
+		r->ops[i].a=get32(p+1);
+		r->ops[i].b=get32(p+5);
+	}
+	return need;
+}
+
+int cal_put_rsp(char *buf,size_t len,uint32_t id,const struct cal_res *res,int count)
+{
+	size_t need=CAL_RSP_HDR+(size_t)count*CAL_RES_SIZE;
+	char *p;
+	int i;
+
+	if(count<1||count>255||need>len)
+		return -1;
+	put16(buf,CAL_RSP_MAGIC);
+	buf[2]=CAL_VERSION;
+	buf[3]=count;
+	put32(buf+4,id);
+	for(i=0,p=buf+CAL_RSP_HDR;i<count;i++,p+=CAL_RES_SIZE)
+	{
+		p[0]=res[i].status;
+		put32(p+1,res[i].v);
+	}
+	return need;
+}
+
+int cal_get_rsp(const char *buf,size_t len,uint32_t *id,struct cal_res *res,int max)
+{
+	size_t need;
+	const char *p;
+	int i,count;
+
+	if(len<CAL_RSP_HDR)
+		return 0;
+	if(get16(buf)!=CAL_RSP_MAGIC||buf[2]!=CAL_VERSION)
+		return -1;
+	count=(unsigned char)buf[3];
+	if(count<1||count>max)
+		return -1;
+	need=CAL_RSP_HDR+(size_t)count*CAL_RES_SIZE;
+	if(len<need)
+		return 0;
+	*id=get32(buf+4);
+	for(i=0,p=buf+CAL_RSP_HDR;i<count;i++,p+=CAL_RES_SIZE)
+	{
+		res[i].status=p[0];
+		res[i].v=get32(p+1);
+	}
+	return need;
+}
@@ -0,0 +1,73 @@
+#ifndef CALRPC_H
+#define CALRPC_H
+
+#include<stdint.h>
+#include<stddef.h>
+#include<limits.h>
+
+/*
+ * Wire format of the FIFO calculator, byte by byte, little endian; no
+ * struct is ever written as is, so padding and the compiler do not matter
+ * (p1.c/p2.c sent struct st, 12 bytes of which 3 were padding).
+ *
+ * request   0  u16  magic 'C','Q'
+ *           2  u8   version
+ *           3  u8   count of ops
+ *           4  u32  batch id (echoed back)
+ *           8  u8   name length n
+ *           9  n    response FIFO path, no NUL
+ *         9+n  count x { u8 op, i32 a, i32 b }
+ *
+ * response  0  u16  magic 'C','R'
+ *           2  u8   version
+ *           3  u8   count
+ *           4  u32  batch id
+ *           8  count x { u8 status, i32 result }
+ *
+ * Many clients write the one request FIFO, so a request must go in one
+ * write() of at most PIPE_BUF bytes to arrive in one piece.
+ */
+
+#define CAL_REQ_MAGIC	0x5143		/* "CQ" */
+#define CAL_RSP_MAGIC	0x5243		/* "CR" */
+#define CAL_VERSION	1
+#define CAL_REQ_HDR	9
+#define CAL_RSP_HDR	8
+#define CAL_OP_SIZE	9
+#define CAL_RES_SIZE	5
+#define CAL_MAXNAME	64
+/* what fits one atomic FIFO write, and what the u8 count can say */
+#define CAL_FITOPS	((PIPE_BUF-CAL_REQ_HDR-CAL_MAXNAME)/CAL_OP_SIZE)
+#define CAL_MAXOPS	(CAL_FITOPS<255 ? CAL_FITOPS : 255)
+
+enum { CAL_OK, CAL_BADOP, CAL_DIV0, CAL_OVERFLOW };
+
+struct cal_op {
+	char op;
+	int32_t a,b;
+};
+
+struct cal_res {
+	uint8_t status;
+	int32_t v;
+};
+
+struct cal_req {
+	uint32_t id;
+	int count;
+	char name[CAL_MAXNAME+1];
+	struct cal_op ops[CAL_MAXOPS];
+};
+
+/* bytes written to buf, -1 when it does not fit */
+int cal_put_req(char *buf,size_t len,const struct cal_req *r);
+int cal_put_rsp(char *buf,size_t len,uint32_t id,const struct cal_res *res,int count);
+
+/*
+ * Parse one message at the start of buf.  Returns its size, 0 when buf
+ * holds only part of it, -1 when it is not a valid message.
+ */
+int cal_get_req(const char *buf,size_t len,struct cal_req *r);
+int cal_get_rsp(const char *buf,size_t len,uint32_t *id,struct cal_res *res,int max);
+
+#endif
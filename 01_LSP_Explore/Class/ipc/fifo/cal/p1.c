@@ -1,40 +1,263 @@
+// p1.c: the calculator client; start ./p2 first, from the same directory
+// cc -O2 p1.c calrpc.c -o p1
+//
+//   ./p1 [-f request fifo]		ask for one a op b, like before
+//   ./p1 -b 1,16,128 [-n batches] [-k ops] [-f request fifo]
+//					benchmark with that many clients
+//
+// Each client answers on its own FIFO, "calrsp.<pid>", named in every
+// request.  It holds that FIFO open for writing too, so its read blocks
+// until the server answers instead of seeing EOF before the server opened
+// it.  An answer that takes more than TIMEOUT ms counts as lost, so a
+// client never hangs on a server that dropped it.
+//
+// In the benchmark every client sends -n batches of -k random ops, one
+// batch at a time (send, wait for the answer), and checks every result.
+// Requests/s counts ops, so -k 1 is one round trip per request.
 #include<stdio.h>
-#include<sys/types.h>
-#include<sys/stat.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<errno.h>
 #include<fcntl.h>
-struct st
-{
-	int a;
-	char ch;
-	int b;
+#include<unistd.h>
+#include<time.h>
+#include<poll.h>
+#include<sys/stat.h>
+#include<sys/wait.h>
+#include"calrpc.h"
+
+#define MAXLIST	16
+#define TIMEOUT	5000		/* ms to wait for an answer */
+
+struct conn {
+	int req,rsp,keep;
+	char name[CAL_MAXNAME+1];
+	char in[PIPE_BUF];
+	size_t have;
 };
-main()
+
+static double now(void)
 {
+	struct timespec ts;
 
-	
-	struct st s1;
-	int fd,fd1,s;
-	
-	mkfifo("f1",0666);
-	perror("mkfifo");
-	mkfifo("f2",0666);
-	perror("mkfifo");
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
 
-	fd=open("f1",O_WRONLY);
-	perror("open fd");
-	fd1=open("f2",O_RDONLY);
-	perror("open fd1");
+static int conn_open(struct conn *c,const char *req)
+{
+	snprintf(c->name,sizeof(c->name),"calrsp.%d",getpid());
+	c->have=0;
+	unlink(c->name);
+	if(mkfifo(c->name,0600)<0)
+		return -1;
+	/* both ends, read first so the O_WRONLY open does not block */
+	c->rsp=open(c->name,O_RDONLY|O_NONBLOCK);
+	c->keep=open(c->name,O_WRONLY);
+	/* O_NONBLOCK: fail at once when no server holds the request FIFO */
+	c->req=open(req,O_WRONLY|O_NONBLOCK);
+	if(c->rsp<0||c->keep<0||c->req<0)
+		return -1;
+	fcntl(c->rsp,F_SETFL,0);
+	fcntl(c->req,F_SETFL,0);
+	return 0;
+}
 
+static void conn_close(struct conn *c)
+{
+	close(c->req);
+	close(c->rsp);
+	close(c->keep);
+	unlink(c->name);
+}
+
+/* one batch there and back; 0 ok */
+static int call(struct conn *c,struct cal_req *r,struct cal_res *res)
+{
+	char buf[PIPE_BUF];
+	struct pollfd p={ .fd=c->rsp, .events=POLLIN };
+	uint32_t id;
+	ssize_t n;
+	int len,used;
+
+	strcpy(r->name,c->name);
+	len=cal_put_req(buf,sizeof(buf),r);
+	/* one write of <= PIPE_BUF: never mixed with other clients' requests */
+	if(len<0||write(c->req,buf,len)!=len)
+		return -1;
+	for(;;)
+	{
+		used=cal_get_rsp(c->in,c->have,&id,res,r->count);
+		if(used<0)
+			return -1;
+		if(used>0)
+			break;
+		n=poll(&p,1,TIMEOUT);
+		if(n<0&&errno==EINTR)
+			continue;
+		if(n<=0)
+			return -1;
+		n=read(c->rsp,c->in+c->have,sizeof(c->in)-c->have);
+		if(n<0&&errno==EINTR)
+			continue;
+		if(n<=0)
+			return -1;
+		c->have+=n;
+	}
+	memmove(c->in,c->in+used,c->have-used);
+	c->have-=used;
+	return id==r->id ? 0 : -1;
+}
+
+/* what the server must say; the benchmark never overflows or divides by 0 */
+static int32_t expect(const struct cal_op *o)
+{
+	switch(o->op)
+	{
+	case '+': return o->a+o->b;
+	case '-': return o->a-o->b;
+	case '*': return o->a*o->b;
+	case '/': return o->a/o->b;
+	}
+	return o->a%o->b;
+}
+
+//////////////////////////////////////////////////////////////
+/* one benchmark client; exit status = number of wrong answers, capped */
+static void client(const char *req,int gate,int batches,int k)
+{
+	static const char ops[]="+-*/%";
+	struct cal_res res[CAL_MAXOPS];
+	struct cal_req r;
+	struct conn c;
+	char x;
+	int i,j,bad=0;
+
+	srand(getpid());
+	if(conn_open(&c,req)<0)
+	{
+		perror(req);
+		_exit(255);
+	}
+	read(gate,&x,1);		/* EOF when the parent says go */
+	r.count=k;
+	for(i=0;i<batches;i++)
+	{
+		r.id=i;
+		for(j=0;j<k;j++)
+		{
+			r.ops[j].op=ops[rand()%5];
+			r.ops[j].a=rand()%20000-10000;
+			r.ops[j].b=rand()%100+1;
+		}
+		if(call(&c,&r,res)<0)
+		{
+			bad=254;
+			break;
+		}
+		for(j=0;j<k;j++)
+			if(res[j].status!=CAL_OK||res[j].v!=expect(&r.ops[j]))
+				bad++;
+	}
+	conn_close(&c);
+	_exit(bad>253 ? 253 : bad);
+}
+
+static int bench(const char *req,int nc,int batches,int k)
+{
+	int gate[2],i,st,bad=0;
+	double t;
+
+	pipe(gate);
+	for(i=0;i<nc;i++)
+		if(fork()==0)
+		{
+			close(gate[1]);
+			client(req,gate[0],batches,k);
+		}
+	close(gate[0]);
+	/* let them all make their FIFOs before the clock starts */
+	usleep(100000+nc*1000);
+	t=now();
+	close(gate[1]);
+	while(wait(&st)>0)
+		if(!WIFEXITED(st)||WEXITSTATUS(st))
+			bad++;
+	t=now()-t;
+	printf("%4d clients x %d batches x %d ops: %10.0f req/s %9.0f batches/s %7.1f us/round trip%s\n",
+	       nc,batches,k,(double)nc*batches*k/t,nc*batches/t,t/batches*1e6,
+	       bad ? "  (errors)" : "");
+	return bad ? -1 : 0;
+}
+
+int main(int argc,char **argv)
+{
+	const char *req="calreq",*name[]={"ok","bad operator","divide by zero","overflow"};
+	long nc[MAXLIST];
+	int opt,n=0,batches=2000,k=1,i,r=0;
+	char *tok,*list=0;
+	struct cal_res res;
+	struct cal_req q;
+	struct conn c;
+
+	while((opt=getopt(argc,argv,"f:b:n:k:"))!=-1)
+	{
+		switch(opt)
+		{
+		case 'f':
+			req=optarg;
+			break;
+		case 'b':
+			list=optarg;
+			break;
+		case 'n':
+			batches=atoi(optarg);
+			break;
+		case 'k':
+			k=atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if(optind!=argc||batches<1||k<1||k>CAL_MAXOPS)
+		goto usage;
+
+	if(list)
+	{
+		for(tok=strtok(list,",");tok&&n<MAXLIST;tok=strtok(0,","))
+			if((nc[n++]=atol(tok))<1)
+				goto usage;
+		for(i=0;i<n;i++)
+			if(bench(req,nc[i],batches,k)<0)
+				r=1;
+		return r;
+	}
+
+	if(conn_open(&c,req)<0)
+	{
+		perror(errno==ENXIO ? "server not running" : req);
+		return 1;
+	}
 	printf("enter the first oprand..\n");
-	scanf("%d",&s1.a);
+	scanf("%d",&q.ops[0].a);
 	printf("enter the oprator..\n");
-	scanf(" %c",&s1.ch);
+	scanf(" %c",&q.ops[0].op);
 	printf("enter the second oprand..\n");
-	scanf("%d",&s1.b);
-
-	write(fd,&s1,sizeof(s1));
-	read(fd1,&s,sizeof(s));
-
-	printf("total is=%d\n",s);
+	scanf("%d",&q.ops[0].b);
+	q.id=1;
+	q.count=1;
+	if(call(&c,&q,&res)<0)
+		printf("no answer\n");
+	else if(res.status!=CAL_OK)
+		printf("error: %s\n",res.status<4 ? name[res.status] : "?");
+	else
+		printf("total is=%d\n",res.v);
+	conn_close(&c);
+	return 0;
 
+usage:
+	printf("usage:./a.out [-f request fifo]\n       ./a.out -b 1,16,128 [-n batches] [-k ops] [-f request fifo]\n");
+	return 1;
 }
@@ -1,33 +1,365 @@
+// p2.c: the calculator server, now a long running FIFO RPC server
+// cc -O2 p2.c calrpc.c -o p2
+//
+//   ./p2 [request fifo]		(default "calreq", created if missing)
+//
+// Every client writes batches of { op, a, b } to the one request FIFO and
+// names its own response FIFO in the request header (see calrpc.h for the
+// bytes).  One epoll loop serves all of them:
+//  - the request FIFO is also held open for writing here, so it never
+//    reads EOF when the last client goes away
+//  - everything readable is read at once and parsed request by request;
+//    the answers pile up per client and go out in one write per client
+//    per pass, so a client sending many batches gets few write() calls
+//  - response FIFOs are opened O_NONBLOCK on first use and kept open; a
+//    full one keeps its answers and waits for EPOLLOUT, so one slow client
+//    cannot stall the others
+//  - every response FIFO sits in the epoll set, with no events asked for
+//    while nothing is queued: EPOLLERR still comes when its reader closes,
+//    so a client that exits is forgotten at once, not at the next write
+//  - a client that stops reading gets at most OUTMAX bytes of answers
+//    queued; batches past that are dropped and counted lost
+//  - SIGPIPE is ignored: EPIPE means the client exited, its FIFO is closed
+//    (and opened once more, in case a new client took the same name)
+// Ctrl-C prints the counters and removes the request FIFO.
 #include<stdio.h>
-#include<sys/types.h>
-#include<sys/stat.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<errno.h>
 #include<fcntl.h>
-struct st 
+#include<signal.h>
+#include<unistd.h>
+#include<sys/stat.h>
+#include<sys/epoll.h>
+#include"calrpc.h"
+
+#define INSZ	(64*1024)
+#define NHASH	256
+#define OUTMAX	(256*1024)
+
+struct client {
+	char name[CAL_MAXNAME+1];
+	int fd;
+	int dirty;		/* on the dirty list */
+	int wait_out;		/* EPOLLOUT armed */
+	char *out;
+	size_t len,cap;
+	struct client *next;	/* hash chain */
+};
+
+typedef int (*calc_fn)(int32_t a,int32_t b,int32_t *r);
+
+static int add(int32_t a,int32_t b,int32_t *r) { return __builtin_add_overflow(a,b,r) ? CAL_OVERFLOW : CAL_OK; }
+static int sub(int32_t a,int32_t b,int32_t *r) { return __builtin_sub_overflow(a,b,r) ? CAL_OVERFLOW : CAL_OK; }
+static int mul(int32_t a,int32_t b,int32_t *r) { return __builtin_mul_overflow(a,b,r) ? CAL_OVERFLOW : CAL_OK; }
+
+static int dvd(int32_t a,int32_t b,int32_t *r)
+{
+	if(b==0)
+		return CAL_DIV0;
+	if(a==INT32_MIN&&b==-1)
+		return CAL_OVERFLOW;
+	*r=a/b;
+	return CAL_OK;
+}
+
+static int mod(int32_t a,int32_t b,int32_t *r)
 {
-	int a;
-	char ch;
-	int b;
+	if(b==0)
+		return CAL_DIV0;
+	*r=b==-1 ? 0 : a%b;
+	return CAL_OK;
+}
+
+/* adding an operator is one line here */
+static const calc_fn optab[256]={
+	['+']=add, ['-']=sub, ['*']=mul, ['/']=dvd, ['%']=mod,
 };
-main()
+
+static struct client *hash[NHASH];
+static struct client **dirty;
+static int ndirty,maxdirty,ep;
+static long long nreq,nbatch,nbad,nlost,nclients;
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig)
+{
+	stop=sig;
+}
+
+static unsigned hname(const char *s)
+{
+	unsigned h=2166136261u;
+
+	while(*s)
+		h=(h^(unsigned char)*s++)*16777619u;
+	return h%NHASH;
+}
+
+/* open a response FIFO; only FIFOs, the name comes from the wire */
+static int open_rsp(const char *name)
+{
+	struct stat sb;
+	int fd=open(name,O_WRONLY|O_NONBLOCK|O_CLOEXEC);
+
+	if(fd<0)
+		return -1;
+	if(fstat(fd,&sb)<0||!S_ISFIFO(sb.st_mode))
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* (re)arm c->fd; 0 still reports EPOLLERR when the reader closes */
+static void watch(struct client *c,int op,uint32_t events)
+{
+	struct epoll_event ev;
+
+	ev.events=events;
+	ev.data.ptr=c;
+	epoll_ctl(ep,op,c->fd,&ev);
+}
+
+static struct client *lookup(const char *name)
+{
+	unsigned h=hname(name);
+	struct client *c;
+
+	for(c=hash[h];c;c=c->next)
+		if(strcmp(c->name,name)==0)
+			return c;
+	c=calloc(1,sizeof(*c));
+	strcpy(c->name,name);
+	c->fd=open_rsp(name);
+	if(c->fd<0)
+	{
+		/* no such FIFO or nobody reading it: nowhere to answer */
+		free(c);
+		return 0;
+	}
+	watch(c,EPOLL_CTL_ADD,0);
+	c->next=hash[h];
+	hash[h]=c;
+	nclients++;
+	return c;
+}
+
+static void drop(struct client *c)
+{
+	struct client **pp=&hash[hname(c->name)];
+	int i;
+
+	while(*pp!=c)
+		pp=&(*pp)->next;
+	*pp=c->next;
+	for(i=0;i<ndirty;i++)
+		if(dirty[i]==c)
+			dirty[i]=0;
+	if(c->fd>=0)
+		close(c->fd);		/* leaves the epoll set with it */
+	free(c->out);
+	free(c);
+}
+
+/* write what is queued; -1 when the client is gone */
+static int flush_client(struct client *c)
+{
+	ssize_t n;
+	int retried=0;
+
+	while(c->len)
+	{
+		n=write(c->fd,c->out,c->len);
+		if(n>0)
+		{
+			memmove(c->out,c->out+n,c->len-n);
+			c->len-=n;
+			continue;
+		}
+		if(n<0&&errno==EINTR)
+			continue;
+		if(n<0&&errno==EAGAIN)
+		{
+			if(!c->wait_out)
+			{
+				watch(c,EPOLL_CTL_MOD,EPOLLOUT);
+				c->wait_out=1;
+			}
+			return 0;
+		}
+		/* EPIPE: the reader went away; a new one may sit on the same name */
+		close(c->fd);
+		c->wait_out=0;
+		c->fd=retried ? -1 : open_rsp(c->name);
+		retried=1;
+		if(c->fd<0)
+		{
+			nlost++;
+			drop(c);
+			return -1;
+		}
+		watch(c,EPOLL_CTL_ADD,0);
+	}
+	if(c->wait_out)
+	{
+		watch(c,EPOLL_CTL_MOD,0);
+		c->wait_out=0;
+	}
+	return 0;
+}
+
+static void serve(const struct cal_req *r)
 {
-	struct st s1;
-	int fd,fd1,s;
+	struct cal_res res[CAL_MAXOPS];
+	struct client *c;
+	calc_fn fn;
+	int i,n;
 
-	mkfifo("f1",0666);
-	mkfifo("f2",0666);
+	for(i=0;i<r->count;i++)
+	{
+		fn=optab[(unsigned char)r->ops[i].op];
+		res[i].v=0;
+		res[i].status=fn ? fn(r->ops[i].a,r->ops[i].b,&res[i].v) : CAL_BADOP;
+	}
+	nreq+=r->count;
+	nbatch++;
 
+	c=lookup(r->name);
+	if(c==0)
+	{
+		nlost++;
+		return;
+	}
+	if(c->len>=OUTMAX)
+	{
+		/* not reading its FIFO: do not let it grow this process */
+		nlost++;
+		return;
+	}
+	if(c->cap-c->len<CAL_RSP_HDR+CAL_MAXOPS*CAL_RES_SIZE)
+	{
+		c->cap=c->cap ? c->cap*2 : 4096;
+		c->out=realloc(c->out,c->cap);
+	}
+	n=cal_put_rsp(c->out+c->len,c->cap-c->len,r->id,res,r->count);
+	c->len+=n;
+	if(!c->dirty)
+	{
+		if(ndirty==maxdirty)
+		{
+			maxdirty=maxdirty ? maxdirty*2 : 64;
+			dirty=realloc(dirty,maxdirty*sizeof(*dirty));
+		}
+		c->dirty=1;
+		dirty[ndirty++]=c;
+	}
+}
+
+//////////////////////////////////////////////////////////////
+int main(int argc,char **argv)
+{
+	const char *req=argc>1 ? argv[1] : "calreq";
+	static char in[INSZ];
+	struct epoll_event ev,evs[64];
+	struct sigaction sa;
+	struct cal_req r;
+	struct client *c;
+	size_t have=0;
+	int rfd,keep,n,i,k,used;
+	ssize_t got;
+
+	if(argc>2)
+	{
+		printf("usage:./a.out [request fifo]\n");
+		return 1;
+	}
+	if(mkfifo(req,0666)<0&&errno!=EEXIST)
+	{
+		perror("mkfifo");
+		return 1;
+	}
+	rfd=open(req,O_RDONLY|O_NONBLOCK|O_CLOEXEC);
+	keep=open(req,O_WRONLY|O_CLOEXEC);
+	if(rfd<0||keep<0)
+	{
+		perror("open");
+		return 1;
+	}
 
-	fd=open("f1",O_RDONLY);
-	fd1=open("f2",O_WRONLY);
+	signal(SIGPIPE,SIG_IGN);
+	memset(&sa,0,sizeof(sa));
+	sa.sa_handler=on_signal;
+	sigaction(SIGINT,&sa,0);
+	sigaction(SIGTERM,&sa,0);
 
-	read(fd,&s1,sizeof(s1));
+	ep=epoll_create1(EPOLL_CLOEXEC);
+	ev.events=EPOLLIN;
+	ev.data.ptr=0;			/* 0 is the request FIFO */
+	epoll_ctl(ep,EPOLL_CTL_ADD,rfd,&ev);
+	printf("serving on %s\n",req);
+	fflush(stdout);
 
-	if(s1.ch=='+')
+	while(!stop)
 	{
-		s=s1.a+s1.b;
+		n=epoll_wait(ep,evs,64,-1);
+		if(n<0)
+		{
+			if(errno==EINTR)
+				continue;
+			perror("epoll_wait");
+			break;
+		}
+		for(k=0;k<n;k++)
+		{
+			if(evs[k].data.ptr)
+			{
+				c=evs[k].data.ptr;
+				/*
+				 * EPOLLERR with nothing queued: the client is gone.
+				 * With answers queued the write sees EPIPE and tries
+				 * the name once more, as it always did.
+				 */
+				if(evs[k].events&EPOLLERR&&c->len==0)
+					drop(c);
+				else
+					flush_client(c);
+				continue;
+			}
+			/* drain the request FIFO, request by request */
+			while((got=read(rfd,in+have,INSZ-have))>0)
+			{
+				have+=got;
+				for(i=0;(used=cal_get_req(in+i,have-i,&r))>0;i+=used)
+					serve(&r);
+				if(used<0)
+				{
+					/*
+					 * Writes of <= PIPE_BUF never interleave, so this is
+					 * a client sending garbage; there is no resyncing
+					 * in a byte stream, drop what we have.
+					 */
+					nbad++;
+					i=have;
+				}
+				memmove(in,in+i,have-i);
+				have-=i;
+			}
+		}
+		for(i=0;i<ndirty;i++)
+			if(dirty[i])
+			{
+				dirty[i]->dirty=0;
+				flush_client(dirty[i]);
+			}
+		ndirty=0;
 	}
-	else
-		printf("not data\n");
 
-	write(fd1,&s,sizeof(s));
+	fprintf(stderr,"\n%lld requests in %lld batches from %lld clients, %lld answers lost, %lld bad\n",
+		nreq,nbatch,nclients,nlost,nbad);
+	unlink(req);
+	close(keep);
+	return 0;
 }
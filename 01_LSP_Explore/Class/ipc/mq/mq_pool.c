@@ -0,0 +1,299 @@
+// mq_sr1.c/mq_sr2.c as a service: a fixed pool of receivers, forked once
+// cc -O2 mq_pool.c -o mq_pool
+//
+//   ./a.out [-w 8,16,32,64] [-r types] [-n messages] [-s size] [-c crash] [-1]
+//
+// Message types 1..w*r are routed: worker i owns types i*r+1..(i+1)*r.
+// One shared queue cannot do that: msgrcv() with a negative msgtyp -t
+// takes the lowest type <= t, which includes every lower worker's range.
+// So each worker has its own queue, a message of type t goes to worker
+// (t-1)/r as mtype (t-1)%r+1, and the worker receives with msgtyp -r: its
+// own range, lowest type (highest priority) first.
+//
+// The sender batches: messages for one (worker, type) collect in a buffer
+// and go as one msgsnd() of up to msgmax bytes, records { u16 len, data }.
+// -1 sends every message on its own, for comparison.
+// After the last message every worker gets an empty message of its lowest
+// priority type, which it sees only when everything else is done.
+//
+// The parent only supervises: it sleeps in wait(), and a worker that dies
+// is forked again on the same queue.  -c N makes every worker _exit()
+// after N batches, to show it.  Memory is the PSS of every process (shared
+// pages split between the sharers) of an idle pool of the same size.
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<errno.h>
+#include<signal.h>
+#include<unistd.h>
+#include<time.h>
+#include<sys/ipc.h>
+#include<sys/msg.h>
+#include<sys/mman.h>
+#include<sys/wait.h>
+
+#define MAXW		1024
+#define MAXLIST		16
+
+struct batch {
+	long mtype;
+	char data[];
+};
+
+struct wstat {
+	long long msgs,batches;
+	char pad[48];		/* one cache line per worker */
+};
+
+static int nw,ntypes,msgmax,crash,limit;
+static int qid[MAXW];
+static pid_t wpid[MAXW];
+static struct wstat *ws;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static long pss_kb(pid_t pid)
+{
+	char path[64],line[128];
+	long v=0;
+	FILE *fp;
+
+	snprintf(path,sizeof(path),"/proc/%d/smaps_rollup",pid);
+	fp=fopen(path,"r");
+	if(fp==0)
+		return 0;
+	while(fgets(line,sizeof(line),fp))
+		if(sscanf(line,"Pss: %ld",&v)==1)
+			break;
+	fclose(fp);
+	return v;
+}
+
+//////////////////////////////////////////////////////////////
+static void worker(int w)
+{
+	struct batch *b=malloc(sizeof(long)+msgmax);
+	unsigned sum=0;
+	ssize_t n,off;
+	uint16_t len;
+
+	for(;;)
+	{
+		n=msgrcv(qid[w],b,msgmax,-ntypes,0);
+		if(n<0)
+		{
+			if(errno==EINTR)
+				continue;
+			_exit(1);
+		}
+		if(n==0)
+			_exit(0);		/* the stop message */
+		for(off=0;off+2<=n;off+=2+len)
+		{
+			memcpy(&len,b->data+off,2);
+			sum+=(unsigned char)b->data[off+2];	/* the "work" */
+			ws[w].msgs++;
+		}
+		ws[w].batches++;
+		if(crash&&ws[w].batches%crash==0)
+			_exit(2);
+	}
+	(void)sum;
+}
+
+static pid_t spawn(int w)
+{
+	pid_t pid=fork();
+
+	if(pid==0)
+		worker(w);
+	return pid;
+}
+
+static void sender(long n,int size)
+{
+	struct batch **buf=calloc(nw*ntypes,sizeof(*buf));
+	size_t *used=calloc(nw*ntypes,sizeof(*used));
+	char *msg=malloc(size);
+	long i,t,k;
+	uint16_t len=size;
+	int w;
+
+	for(k=0;k<nw*ntypes;k++)
+	{
+		buf[k]=malloc(sizeof(long)+msgmax);
+		buf[k]->mtype=k%ntypes+1;
+	}
+	memset(msg,'m',size);
+	srand(1);
+	for(i=0;i<n;i++)
+	{
+		t=rand()%(nw*ntypes);		/* type t+1: worker t/ntypes */
+		if(used[t]+2+size>(size_t)limit)
+		{
+			if(msgsnd(qid[t/ntypes],buf[t],used[t],0)<0)
+				_exit(1);
+			used[t]=0;
+		}
+		memcpy(buf[t]->data+used[t],&len,2);
+		memcpy(buf[t]->data+used[t]+2,msg,size);
+		used[t]+=2+size;
+	}
+	for(t=0;t<nw*ntypes;t++)
+		if(used[t]&&msgsnd(qid[t/ntypes],buf[t],used[t],0)<0)
+			_exit(1);
+	/* lowest priority, so it comes after everything else */
+	for(w=0;w<nw;w++)
+	{
+		buf[0]->mtype=ntypes;
+		msgsnd(qid[w],buf[0],0,0);
+	}
+	_exit(0);
+}
+
+static int run(int workers,long n,int size)
+{
+	long long msgs=0,batches=0;
+	long pss=0,self;
+	int w,st,respawns=0,alive;
+	pid_t spid,pid;
+	double t;
+
+	nw=workers;
+	for(w=0;w<nw;w++)
+	{
+		qid[w]=msgget(IPC_PRIVATE,IPC_CREAT|0600);
+		if(qid[w]<0)
+		{
+			perror("msgget");
+			return -1;
+		}
+	}
+	memset(ws,0,MAXW*sizeof(*ws));
+	for(w=0;w<nw;w++)
+		wpid[w]=spawn(w);
+
+	t=now();
+	spid=fork();
+	if(spid==0)
+		sender(n,size);
+
+	alive=nw;
+	while(alive&&(pid=wait(&st))>0)
+	{
+		if(pid==spid)
+		{
+			if(!WIFEXITED(st)||WEXITSTATUS(st))
+				fprintf(stderr,"sender failed\n");
+			continue;
+		}
+		for(w=0;w<nw&&wpid[w]!=pid;w++)
+			;
+		if(w==nw)
+			continue;
+		if(WIFEXITED(st)&&WEXITSTATUS(st)==0)
+		{
+			wpid[w]=0;		/* got its stop message */
+			alive--;
+			continue;
+		}
+		wpid[w]=spawn(w);
+		respawns++;
+	}
+	t=now()-t;
+
+	/* the workers have exited by now: measure a fresh, idle pool */
+	for(w=0;w<nw;w++)
+	{
+		msgs+=ws[w].msgs;
+		batches+=ws[w].batches;
+		msgctl(qid[w],IPC_RMID,0);
+		qid[w]=msgget(IPC_PRIVATE,IPC_CREAT|0600);
+		wpid[w]=spawn(w);
+	}
+	usleep(200000);
+	self=pss_kb(getpid());
+	for(w=0;w<nw;w++)
+	{
+		pss+=pss_kb(wpid[w]);
+		kill(wpid[w],SIGKILL);
+	}
+	while(wait(&st)>0)
+		;
+	for(w=0;w<nw;w++)
+		msgctl(qid[w],IPC_RMID,0);
+
+	printf("%7d %10.0f %9.0f %8.1f %8d %9.1f %9.0f%s\n",nw,msgs/t,batches/t,
+	       (double)msgs/batches,respawns,(pss+self)/1024.0,(double)pss/nw,
+	       msgs==n ? "" : "  (lost messages)");
+	fflush(stdout);
+	return 0;
+}
+
+int main(int argc,char **argv)
+{
+	long list[MAXLIST]={8,16,32,64},n=2000000;
+	int opt,nl=4,size=32,i;
+	char *tok;
+	FILE *fp;
+
+	ntypes=4;
+	while((opt=getopt(argc,argv,"w:r:n:s:c:1"))!=-1)
+	{
+		switch(opt)
+		{
+		case 'w':
+			for(nl=0,tok=strtok(optarg,",");tok&&nl<MAXLIST;tok=strtok(0,","))
+				if((list[nl++]=atol(tok))<1||list[nl-1]>MAXW)
+					goto usage;
+			break;
+		case 'r':
+			ntypes=atoi(optarg);
+			break;
+		case 'n':
+			n=atol(optarg);
+			break;
+		case 's':
+			size=atoi(optarg);
+			break;
+		case 'c':
+			crash=atoi(optarg);
+			break;
+		case '1':
+			limit=1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	msgmax=8192;
+	if((fp=fopen("/proc/sys/kernel/msgmax","r")))
+	{
+		if(fscanf(fp,"%d",&msgmax)!=1)
+			msgmax=8192;
+		fclose(fp);
+	}
+	if(optind!=argc||nl<1||ntypes<1||n<1||size<1||size+2>msgmax||size>65535)
+		goto usage;
+
+	limit=limit ? size+2 : msgmax;
+	ws=mmap(0,MAXW*sizeof(*ws),PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANONYMOUS,-1,0);
+	printf("%ld messages of %d bytes, %d types per worker, batches up to %d bytes\n",
+	       n,size,ntypes,limit);
+	printf("%7s %10s %9s %8s %8s %9s %9s\n","workers","msgs/s","batches/s",
+	       "msg/batch","respawns","PSS MB","KB/worker");
+	for(i=0;i<nl;i++)
+		run(list[i],n,size);
+	return 0;
+
+usage:
+	printf("usage:./a.out [-w 8,16,32,64] [-r types] [-n messages] [-s size] [-c crash after N batches] [-1]\n");
+	return 1;
+}
@@ -14,23 +14,25 @@ int id;
 struct msgbuf v;
 main(int argc,char** argv)
 {
-
-while(1)
+/* one receiver, forked once: a fork per message grew without bound */
+if(fork()==0)
 {
-	if(fork()==0)
-	{
-		
 	id=msgget(5,IPC_CREAT|0644);
 	if(id<0)
 	{
 	perror("msgget");
 	return;
 	}
-	msgrcv(id,&v,sizeof(v),3,0);
+	while(1)
+	{
+	if(msgrcv(id,&v,sizeof(v.data),3,0)<0)
+		return;
 	printf("data=%s\n",v.data);
-	
 	}
-	else
+}
+
+while(1)
+{
 	{/*
 
 		if(argc!=2)
@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<signal.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/wait.h>
+#include<sys/epoll.h>
+#include"dispatch.h"
+
+#define DONE_STRIDE	(64/sizeof(uint64_t))	/* own cache line per worker */
+#define RBUF		(64*1024)
+
+static void worker(struct dp *d,int id,int fd,dp_fn fn,void *arg)
+{
+	static char b[RBUF];
+	uint64_t *done=&d->done[id*DONE_STRIDE],count=0;
+	size_t have=0,off;
+	uint32_t len;
+	ssize_t n;
+
+	for(;;)
+	{
+		n=read(fd,b+have,sizeof(b)-have);
+		if(n<0&&errno==EINTR)
+			continue;
+		if(n<=0)
+			break;
+		have+=n;
+		off=0;
+		while(have-off>=sizeof(len))
+		{
+			memcpy(&len,b+off,sizeof(len));
+			if(have-off<sizeof(len)+len)
+				break;		/* rest of the frame is still in the pipe */
+			fn(id,b+off+sizeof(len),len,arg);
+			off+=sizeof(len)+len;
+			count++;
+		}
+		memmove(b,b+off,have-off);
+		have-=off;
+		/* one store per read, not per frame */
+		__atomic_store_n(done,count,__ATOMIC_RELEASE);
+	}
+	_exit(n<0||have);
+}
+
+/* dp_start() failed part way: undo it, workers included; errno is kept */
+static struct dp *unwind(struct dp *d,int nworkers)
+{
+	int i,e=errno;
+
+	for(i=0;i<d->n;i++)
+	{
+		close(d->w[i].fd);
+		kill(d->w[i].pid,SIGKILL);
+		waitpid(d->w[i].pid,0,0);
+	}
+	if(d->ep>=0)
+		close(d->ep);
+	if(d->done!=MAP_FAILED)
+		munmap(d->done,nworkers*64);
+	free(d->w);
+	free(d);
+	errno=e;
+	return 0;
+}
+
+struct dp *dp_start(int nworkers,dp_fn fn,void *arg)
+{
+	struct epoll_event ev;
+	struct dp *d;
+	int i,j,p[2];
+
+	d=calloc(1,sizeof(*d));
+	if(d==0)
+		return 0;
+	d->w=calloc(nworkers,sizeof(*d->w));
+	d->done=mmap(0,nworkers*64,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANONYMOUS,-1,0);
+	d->ep=epoll_create1(EPOLL_CLOEXEC);
+	if(d->w==0||d->done==MAP_FAILED||d->ep<0)
+		return unwind(d,nworkers);
+	/* a worker that died shows up as EPIPE, not as the end of the parent */
+	signal(SIGPIPE,SIG_IGN);
+
+	for(i=0;i<nworkers;i++)
+	{
+		if(pipe2(p,O_CLOEXEC)<0)
+			return unwind(d,nworkers);
+		d->w[i].pid=fork();
+		if(d->w[i].pid==0)
+		{
+			/* keep no write end open, or EOF would never come */
+			close(p[1]);
+			for(j=0;j<i;j++)
+				close(d->w[j].fd);
+			close(d->ep);
+			worker(d,i,p[0],fn,arg);
+		}
+		close(p[0]);
+		if(d->w[i].pid<0)
+		{
+			close(p[1]);
+			return unwind(d,nworkers);
+		}
+		fcntl(p[1],F_SETFL,O_NONBLOCK);
+		d->w[i].fd=p[1];
+		d->n=i+1;
+
+		ev.events=0;		/* armed by push() once it is full */
+		ev.data.u32=i;
+		if(epoll_ctl(d->ep,EPOLL_CTL_ADD,p[1],&ev)<0)
+			return unwind(d,nworkers);
+	}
+	return d;
+}
+
+static int arm(struct dp *d,int i,unsigned events)
+{
+	struct epoll_event ev;
+
+	ev.events=events;
+	ev.data.u32=i;
+	return epoll_ctl(d->ep,EPOLL_CTL_MOD,d->w[i].fd,&ev);
+}
+
+/* the worker is gone: drop it and what it still had coming */
+static void bury(struct dp *d,int i)
+{
+	struct dp_worker *w=&d->w[i];
+
+	epoll_ctl(d->ep,EPOLL_CTL_DEL,w->fd,0);
+	close(w->fd);
+	w->fd=-1;
+	w->dead=1;
+	w->full=0;
+	w->len=0;
+}
+
+/* 1 written (or worker gone), 0 pipe full, -1 error */
+static int push(struct dp *d,int i)
+{
+	struct dp_worker *w=&d->w[i];
+	ssize_t r;
+
+	if(w->len==0)
+		return 1;
+	do
+		r=write(w->fd,w->buf,w->len);
+	while(r<0&&errno==EINTR);
+	if(r<0&&errno==EPIPE)
+	{
+		bury(d,i);
+		return 1;
+	}
+	if(r<0&&errno==EAGAIN)
+	{
+		if(!w->full&&arm(d,i,EPOLLOUT)<0)
+			return -1;
+		w->full=1;
+		return 0;
+	}
+	if(r!=(ssize_t)w->len)	/* <= PIPE_BUF is all or nothing */
+		return -1;
+	if(w->full&&arm(d,i,0)<0)
+		return -1;
+	w->len=0;
+	w->full=0;
+	w->written=w->sent;
+	return 1;
+}
+
+/* wait until at least one full pipe has room again (or its worker died) */
+static int drain(struct dp *d)
+{
+	struct epoll_event ev[64];
+	int i,n;
+
+	do
+		n=epoll_wait(d->ep,ev,64,-1);
+	while(n<0&&errno==EINTR);
+	if(n<0)
+		return -1;
+	for(i=0;i<n;i++)
+	{
+		/* EPOLLERR comes unasked: the read end is closed */
+		if(ev[i].events&EPOLLERR)
+			bury(d,ev[i].data.u32);
+		else if(push(d,ev[i].data.u32)<0)
+			return -1;
+	}
+	return 0;
+}
+
+static int alive(struct dp *d)
+{
+	int i;
+
+	for(i=0;i<d->n;i++)
+		if(!d->w[i].dead)
+			return 1;
+	return 0;
+}
+
+/* send the held batches of workers that have caught up */
+static int sweep(struct dp *d)
+{
+	struct dp_worker *w;
+	int i;
+
+	for(i=0;i<d->n;i++)
+	{
+		w=&d->w[i];
+		if(w->len&&!w->full&&__atomic_load_n(&d->done[i*DONE_STRIDE],__ATOMIC_ACQUIRE)==w->written&&
+		   push(d,i)<0)
+			return -1;
+	}
+	return 0;
+}
+
+static int pick(struct dp *d)
+{
+	uint64_t load,best=~0ull;
+	int i,b=-1;
+
+	for(i=0;i<d->n;i++)
+	{
+		if(d->w[i].full||d->w[i].dead)
+			continue;
+		load=d->w[i].sent-__atomic_load_n(&d->done[i*DONE_STRIDE],__ATOMIC_ACQUIRE);
+		if(load<best)
+		{
+			best=load;
+			b=i;
+		}
+	}
+	return b;
+}
+
+/* 1 framed into worker i's batch, 0 its pipe filled up or it died, -1 error */
+static int queue(struct dp *d,int i,const void *msg,size_t len)
+{
+	struct dp_worker *w=&d->w[i];
+	uint32_t l=len;
+
+	if(w->len+sizeof(l)+len>PIPE_BUF)
+	{
+		/* frames never straddle two writes */
+		if(push(d,i)<0)
+			return -1;
+		if(w->full||w->dead)
+			return 0;
+	}
+	memcpy(w->buf+w->len,&l,sizeof(l));
+	memcpy(w->buf+w->len+sizeof(l),msg,len);
+	w->len+=sizeof(l)+len;
+	w->sent++;
+	/* a worker that has run dry should not wait for a batch to fill,
+	   this one or one held back by an earlier call */
+	return sweep(d)<0 ? -1 : 1;
+}
+
+int dp_send(struct dp *d,const void *msg,size_t len)
+{
+	int i,r;
+
+	if(len>DP_MAXMSG)
+	{
+		errno=EMSGSIZE;
+		return -1;
+	}
+	for(;;)
+	{
+		if(!alive(d))
+		{
+			errno=EPIPE;
+			return -1;
+		}
+		i=pick(d);
+		if(i<0)
+		{
+			if(drain(d)<0)
+				return -1;
+			continue;
+		}
+		r=queue(d,i,msg,len);
+		if(r<0)
+			return -1;
+		if(r)
+			return i;
+	}
+}
+
+int dp_send_to(struct dp *d,int i,const void *msg,size_t len)
+{
+	int r;
+
+	if(i<0||i>=d->n)
+	{
+		errno=EINVAL;
+		return -1;
+	}
+	if(len>DP_MAXMSG)
+	{
+		errno=EMSGSIZE;
+		return -1;
+	}
+	for(;;)
+	{
+		if(d->w[i].dead)
+		{
+			errno=EPIPE;
+			return -1;
+		}
+		if(d->w[i].full)
+		{
+			if(drain(d)<0)
+				return -1;
+			continue;
+		}
+		r=queue(d,i,msg,len);
+		if(r)
+			return r<0 ? -1 : i;
+	}
+}
+
+int dp_flush(struct dp *d)
+{
+	int i,left;
+
+	for(;;)
+	{
+		left=0;
+		for(i=0;i<d->n;i++)
+		{
+			if(d->w[i].len&&!d->w[i].full&&push(d,i)<0)
+				return -1;
+			left+=d->w[i].len!=0;
+		}
+		if(left==0)
+			return 0;
+		if(drain(d)<0)
+			return -1;
+	}
+}
+
+int dp_stop(struct dp *d)
+{
+	int i,st,r=dp_flush(d);
+
+	for(i=0;i<d->n;i++)
+		if(!d->w[i].dead)
+			close(d->w[i].fd);
+	for(i=0;i<d->n;i++)
+		if(waitpid(d->w[i].pid,&st,0)<0||!WIFEXITED(st)||WEXITSTATUS(st)||d->w[i].dead)
+			r=-1;
+	close(d->ep);
+	munmap(d->done,d->n*64);
+	free(d->w);
+	free(d);
+	return r;
+}
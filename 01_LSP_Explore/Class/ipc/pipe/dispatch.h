@@ -0,0 +1,62 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include<stddef.h>
+#include<stdint.h>
+#include<limits.h>
+#include<sys/types.h>
+
+/*
+ * Framed pipe dispatcher: one parent, N worker children, one pipe each.
+ *
+ * A message travels as a frame, a 4 byte length then the payload.  Frames
+ * are packed into writes of at most PIPE_BUF bytes and never split across
+ * writes, so every write is atomic and a worker always sees whole frames.
+ *
+ * dp_send() gives the message to the worker with the fewest messages
+ * outstanding (queued + unread + being handled); workers count what they
+ * have finished in shared memory.  While a worker is busy its frames are
+ * batched; as soon as it has caught up with everything written the batch
+ * goes out.  Every dp_send() looks at all held batches, not only the
+ * picked worker's, but nothing happens between calls: a caller that stops
+ * sending for a while calls dp_flush() first.  Pipes are non-blocking: a
+ * full pipe is skipped, and when every pipe is full dp_send() waits in
+ * epoll (EPOLLOUT armed only on the full ones) for one of them to drain.
+ * dp_send_to() skips the choice and queues for worker i, waiting for
+ * that one pipe when it is full; the batching is the same.
+ *
+ * dp_start() ignores SIGPIPE.  A worker that exits early (EPIPE, or
+ * EPOLLERR while waiting) is dropped with whatever was queued for it, the
+ * others carry on, dp_send() fails with EPIPE once none is left, and
+ * dp_stop() reports the loss.
+ */
+
+#define DP_MAXMSG	(PIPE_BUF-sizeof(uint32_t))
+
+typedef void (*dp_fn)(int id,const void *msg,size_t len,void *arg);
+
+struct dp_worker {
+	pid_t pid;
+	int fd;			/* write end, O_NONBLOCK */
+	int full;		/* last write hit EAGAIN, waiting for EPOLLOUT */
+	int dead;		/* read end gone, fd closed */
+	uint64_t sent;		/* frames handed to this worker */
+	uint64_t written;	/* of those, frames already in the pipe */
+	size_t len;		/* bytes in buf not yet written */
+	char buf[PIPE_BUF];
+};
+
+struct dp {
+	int n;
+	int ep;			/* epoll on the write ends */
+	uint64_t *done;		/* shared, one cache line per worker */
+	struct dp_worker *w;
+};
+
+struct dp *dp_start(int nworkers,dp_fn fn,void *arg);
+int dp_send(struct dp *d,const void *msg,size_t len);	/* worker id, -1 */
+int dp_send_to(struct dp *d,int i,const void *msg,size_t len);
+int dp_flush(struct dp *d);
+int dp_stop(struct dp *d);	/* 0 when every worker exited 0 */
+
+#endif
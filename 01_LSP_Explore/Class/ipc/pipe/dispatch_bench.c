@@ -0,0 +1,99 @@
+// messages/s through dispatch.c as the worker count grows
+// cc -O2 dispatch_bench.c dispatch.c -o dispatch_bench
+//
+//   ./a.out [-n messages] [-s size] [-w spin_ns]
+//
+// With -w each worker burns spin_ns per message so the least-loaded
+// scheduling has something to balance.  A short frame makes the worker
+// exit non zero; the others get the rest and dp_stop() reports it.
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<time.h>
+#include"dispatch.h"
+
+static long spin_ns;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static void work(int id,const void *msg,size_t len,void *arg)
+{
+	double end;
+
+	(void)id;
+	(void)msg;
+	(void)arg;
+	if(len<sizeof(uint64_t))
+		_exit(2);
+	if(spin_ns)
+		for(end=now()+spin_ns/1e9;now()<end;)
+			;
+}
+
+int main(int argc,char **argv)
+{
+	static const int nw[]={1,2,4,8,16,32,64};
+	char msg[PIPE_BUF];
+	long i,n=2000000;
+	size_t size=64;
+	struct dp *d;
+	double t;
+	int opt,k,r;
+
+	while((opt=getopt(argc,argv,"n:s:w:"))!=-1)
+	{
+		switch(opt)
+		{
+		case 'n':
+			n=atol(optarg);
+			break;
+		case 's':
+			size=atol(optarg);
+			break;
+		case 'w':
+			spin_ns=atol(optarg);
+			break;
+		default:
+			printf("usage:./a.out [-n messages] [-s size] [-w spin_ns]\n");
+			return 1;
+		}
+	}
+	if(size<sizeof(uint64_t)||size>DP_MAXMSG||n<1)
+	{
+		printf("size must be %zu..%zu\n",sizeof(uint64_t),(size_t)DP_MAXMSG);
+		return 1;
+	}
+	memset(msg,'x',size);
+
+	printf("%8s %14s %10s\n","workers","msgs/s","MB/s");
+	for(k=0;k<7;k++)
+	{
+		d=dp_start(nw[k],work,0);
+		if(d==0)
+		{
+			perror("dp_start");
+			return 1;
+		}
+		t=now();
+		for(i=0;i<n;i++)
+		{
+			memcpy(msg,&i,sizeof(i));	/* sequence number */
+			if(dp_send(d,msg,size)<0)
+			{
+				perror("dp_send");	/* EPIPE: every worker died */
+				break;
+			}
+		}
+		r=dp_stop(d);	/* includes waiting for the workers to finish */
+		t=now()-t;
+		printf("%8d %14.0f %10.1f%s\n",nw[k],n/t,n*size/t/1e6,r ? "  worker failed" : "");
+	}
+	return 0;
+}
@@ -1,53 +1,55 @@
+// cc divide_data_pipe.c dispatch.c
+// The two children used to race read() on one shared pipe, so which child
+// got which 5 bytes depended on scheduling.  Now each child has its own
+// pipe and the parent sends one framed 5 byte piece to each: the first
+// always to child 1, the second always to child 2.  The two children
+// still print in whatever order they run.
 #include<stdio.h>
 #include<unistd.h>
 #include<fcntl.h>
 #include<string.h>
-main()
+#include"dispatch.h"
+
+static void child(int id,const void *msg,size_t len,void *arg)
 {
-	int p[2];
-	pipe(p);
+	char a[6];
 
-	if(fork()==0)
-	{
-		char a1[6];
-		read(p[0],a1,5);
-		a1[5]='\0';
+	(void)arg;
+	memcpy(a,msg,len);
+	a[len]='\0';
+	printf("In child %d : %s\n",id+1,a);
+	fflush(stdout);
+}
 
-		printf("In child 1 : %s\n",a1);
+int main(void)
+{
+	struct dp *d;
+	char s[128];
+	int n;
 
+	printf("Enter 10 bytes of data : ");
+	fflush(stdout);
+	if(scanf("%127s",s)!=1)
+		return 1;
 
-	}
-	else
+	if(strlen(s)>10)
 	{
-		if(fork()==0)
-		{
-			char a2[6];
-			read(p[0],a2,5);
-			a2[5]='\0';
-
-			printf("In child 2 : %s\n",a2);
-
-
-		}
-		else
-		{
-
-			char s[128];
-
-			printf("Enter 10 bytes of data : ");
-			scanf("%s",s);
-
-			if(strlen(s)>10)
-			{
-			printf("Length is grether then 10 bytes\n");
-			return 0;
-			}		
-			printf("size is %d\n",strlen(s));
-			write(p[1],s,sizeof(s));	
-		}
-
-
+		printf("Length is grether then 10 bytes\n");
+		return 0;
 	}
+	printf("size is %zu\n",strlen(s));
+	fflush(stdout);
 
-
+	d=dp_start(2,child,0);
+	if(d==0)
+	{
+		perror("dp_start");
+		return 1;
+	}
+	/* a fixed split, not least loaded: which child gets what never varies */
+	n=strlen(s);
+	dp_send_to(d,0,s,n<5 ? n : 5);
+	if(n>5)
+		dp_send_to(d,1,s+5,n-5);
+	return dp_stop(d)<0;
 }
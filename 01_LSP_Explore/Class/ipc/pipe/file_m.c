@@ -1,30 +1,31 @@
+// cc -I../../05_IPC/01_pipe file_m.c ../../05_IPC/01_pipe/caseconv.c
 #include<stdio.h>
 #include<sys/types.h>
 #include<sys/stat.h>
 #include<string.h>
 #include<fcntl.h>
+#include"caseconv.h"
 main()
 {
 
-	int fd,p[2];
+	int fd,p[2],n;
 	pipe(p);
 
 	if(!fork())
 	{
 		char s1[128];
-		int i;
 		bzero(s1,128);
 
-		read(p[0],s1,sizeof(s1));
+		n=read(p[0],s1,sizeof(s1));
 
 		//puts(s1);
 
-		for(i=0;s1[i];i++)
-			if(s1[i]>='a' && s1[i]<='z')
-				s1[i]-=32;
+		if(n>0)
+			case_upper(s1,s1,n);
 
 		fd=open("data2",O_CREAT|O_TRUNC|O_WRONLY,0644);
-		write(fd,s1,sizeof(s1));
+		if(n>0)
+			write(fd,s1,n);
 	//	close(fd);
 	}
 	else
@@ -33,11 +34,12 @@ main()
 		bzero(s,128);
 		fd=open("data",O_RDONLY);
 
-		read(fd,s,sizeof(s));
+		n=read(fd,s,sizeof(s));
 
 		//	puts(s);
 
-		write(p[1],s,sizeof(s));
+		if(n>0)
+			write(p[1],s,n);
 	//	close(fd);	
 
 	}
@@ -1,12 +1,14 @@
+// cc -I../../05_IPC/01_pipe pipe_between_file.c ../../05_IPC/01_pipe/caseconv.c
 #include<stdio.h>
 #include<unistd.h>
 #include<fcntl.h>
 #include<sys/stat.h>
 #include<sys/types.h>
 #include<string.h>
+#include"caseconv.h"
 main()
 {
-	int fd,fd1,i;
+	int fd,fd1,n;
 	int p[2];
 	pipe(p);
 
@@ -15,14 +17,12 @@ main()
 		char a[128];
 		bzero(a,sizeof(a));
 		printf("in the child ...\n");
-		read(p[0],a,sizeof(a));
-		for(i=0;a[i]; i++)
-		{
-			if(a[i]>='a'&&a[i]<='z')
-			a[i]=a[i]-32;		
-		}
+		n=read(p[0],a,sizeof(a));
+		if(n>0)
+			case_upper(a,a,n);
 		fd=open("data2",O_WRONLY|O_CREAT|O_TRUNC,0644);
-		write(fd,a,sizeof(a));
+		if(n>0)
+			write(fd,a,n);
 
 	}
 	else
@@ -37,9 +37,10 @@ main()
 			return;
 		}
 
-		read(fd,s,sizeof(s));
+		n=read(fd,s,sizeof(s)-1);
 		printf("%s\n",s);
-		write(p[1],s,sizeof(s));
+		if(n>0)
+			write(p[1],s,n);
 
 	}
 
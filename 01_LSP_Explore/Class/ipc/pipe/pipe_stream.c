@@ -0,0 +1,311 @@
+// pipe_between_file.c / file_m.c for files of any size:
+// parent moves src into a pipe, child moves the pipe into dst
+// cc -O2 -I../../05_IPC/01_pipe pipe_stream.c ../../05_IPC/01_pipe/caseconv.c -o pipe_stream
+//
+//   ./a.out [-m copy|splice] [-b bufsize] [-u] [src [dst]]   (data -> data2)
+//   ./a.out -B MB                                            throughput table
+//
+// copy    read()/write() loop through a bufsize user buffer on both sides,
+//         128 bytes by default like the original demos.  -u uppercases in
+//         the child.
+// splice  src -> pipe and pipe -> dst with splice(), the data never enters
+//         user space.  With -u the parent read()s each chunk into one of a
+//         ring of page aligned buffers, uppercases it there and vmsplice()s
+//         the pages into the pipe, still no copy on the way out.
+//
+// A vmsplice'd page is only referenced by the pipe, so its buffer must not
+// be reused before the child has written it out.  The pipe holds at most
+// capacity/4096 pages however few bytes each carries, so every chunk but
+// the last is filled completely before it goes in (a FIFO or a terminal
+// returns short reads); then a ring of capacity/CHUNK+2 chunks is never
+// overwritten while still in flight.
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<time.h>
+#include<sys/uio.h>
+#include<sys/wait.h>
+#include<sys/stat.h>
+#include"caseconv.h"
+
+#define CHUNK		(256*1024)
+#define PIPE_SZ		(1024*1024)
+
+static int write_all(int fd,const char *p,size_t n)
+{
+	ssize_t r;
+
+	while(n)
+	{
+		r=write(fd,p,n);
+		if(r<0&&errno==EINTR)
+			continue;
+		if(r<0)
+			return -1;
+		p+=r;
+		n-=r;
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////
+static int copy_out(int in,int out,size_t bufsize,int up)
+{
+	char *b=malloc(bufsize);
+	ssize_t n;
+
+	while((n=read(in,b,bufsize))!=0)
+	{
+		if(n<0&&errno==EINTR)
+			continue;
+		if(n<0)
+			break;
+		if(up)
+			case_upper(b,b,n);
+		if(write_all(out,b,n)<0)	/* only what was read */
+			break;
+	}
+	free(b);
+	return n==0 ? 0 : -1;
+}
+
+static int splice_out(int in,int out)
+{
+	ssize_t n;
+
+	while((n=splice(in,0,out,0,CHUNK,SPLICE_F_MOVE|SPLICE_F_MORE))!=0)
+	{
+		if(n<0&&errno==EINTR)
+			continue;
+		if(n<0)
+			return -1;
+	}
+	return 0;
+}
+
+/* a whole CHUNK unless the input ends first */
+static ssize_t read_chunk(int in,char *b)
+{
+	size_t got=0;
+	ssize_t n;
+
+	while(got<CHUNK)
+	{
+		n=read(in,b+got,CHUNK-got);
+		if(n<0&&errno==EINTR)
+			continue;
+		if(n<0)
+			return -1;
+		if(n==0)
+			break;
+		got+=n;
+	}
+	return got;
+}
+
+static int vmsplice_upper(int in,int pfd,char *ring,int nring)
+{
+	struct iovec iov;
+	int slot=0;
+	ssize_t n,r;
+
+	for(;;)
+	{
+		iov.iov_base=ring+(size_t)slot*CHUNK;
+		n=read_chunk(in,iov.iov_base);
+		if(n<=0)
+			break;
+		case_upper(iov.iov_base,iov.iov_base,n);
+		iov.iov_len=n;
+		while(iov.iov_len)
+		{
+			r=vmsplice(pfd,&iov,1,0);
+			if(r<0&&errno==EINTR)
+				continue;
+			if(r<0)
+				return -1;
+			iov.iov_base=(char *)iov.iov_base+r;
+			iov.iov_len-=r;
+		}
+		slot=(slot+1)%nring;
+	}
+	return n==0 ? 0 : -1;
+}
+
+/* 0 ok, -1 error; the child's status decides for the write side */
+static int stream(const char *src,const char *dst,int mode_splice,size_t bufsize,int up)
+{
+	char *ring=0;
+	int p[2],in,out,st,r,nring=0;
+	pid_t pid;
+
+	in=open(src,O_RDONLY);
+	if(in<0)
+	{
+		perror(src);
+		return -1;
+	}
+	if(pipe(p)<0)
+	{
+		perror("pipe");
+		return -1;
+	}
+	fcntl(p[1],F_SETPIPE_SZ,PIPE_SZ);	/* fewer wakeups; not fatal */
+	if(mode_splice&&up)
+	{
+		nring=fcntl(p[1],F_GETPIPE_SZ)/CHUNK+2;
+		if(posix_memalign((void **)&ring,4096,(size_t)nring*CHUNK))
+			return -1;
+	}
+
+	pid=fork();
+	if(pid==0)
+	{
+		close(p[1]);
+		close(in);
+		out=open(dst,O_WRONLY|O_CREAT|O_TRUNC,0644);
+		if(out<0)
+		{
+			perror(dst);
+			_exit(1);
+		}
+		if(mode_splice)
+			r=splice_out(p[0],out);
+		else
+			r=copy_out(p[0],out,bufsize,up);
+		if(r<0)
+			perror("child");
+		_exit(close(out)<0||r<0);
+	}
+	if(pid<0)
+	{
+		perror("fork");
+		return -1;
+	}
+	close(p[0]);
+
+	if(mode_splice&&up)
+		r=vmsplice_upper(in,p[1],ring,nring);
+	else if(mode_splice)
+		r=splice_out(in,p[1]);
+	else
+		r=copy_out(in,p[1],bufsize,0);
+	if(r<0)
+		perror("parent");
+	close(p[1]);
+	close(in);
+	if(waitpid(pid,&st,0)==pid&&!(WIFEXITED(st)&&WEXITSTATUS(st)==0))
+		r=-1;
+	free(ring);	/* only now is nothing in the pipe pointing at it */
+	return r;
+}
+
+//////////////////////////////////////////////////////////////
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static unsigned long sum(const char *path)
+{
+	static char b[CHUNK];
+	unsigned long h=5381;
+	ssize_t n,i;
+	int fd=open(path,O_RDONLY);
+
+	while((n=read(fd,b,sizeof(b)))>0)
+		for(i=0;i<n;i++)
+			h=h*33+(unsigned char)b[i];
+	close(fd);
+	return h;
+}
+
+static int bench(long mb)
+{
+	static const struct { const char *name; int sp; size_t buf; int up; } t[]={
+		{"read/write 128 B",	0,128,0},
+		{"read/write 64 KiB",	0,64*1024,0},
+		{"splice",		1,0,0},
+		{"read/write 64 KiB -u",0,64*1024,1},
+		{"vmsplice -u",		1,0,1},
+	};
+	static char b[CHUNK];
+	unsigned long plain,up;
+	double s;
+	long i;
+	int fd,k;
+
+	fd=open("pipe_stream.in",O_WRONLY|O_CREAT|O_TRUNC,0644);
+	for(i=0;i<CHUNK;i++)
+		b[i]="The quick brown fox jumps over the lazy dog\n"[i%44];
+	for(i=0;i<mb*(1024*1024/CHUNK);i++)
+		write_all(fd,b,CHUNK);
+	close(fd);
+
+	/* reference outputs */
+	plain=sum("pipe_stream.in");
+	stream("pipe_stream.in","pipe_stream.out",0,64*1024,1);
+	up=sum("pipe_stream.out");
+
+	for(k=0;k<5;k++)
+	{
+		s=now();
+		if(stream("pipe_stream.in","pipe_stream.out",t[k].sp,t[k].buf,t[k].up)<0)
+			return 1;
+		s=now()-s;
+		printf("%-22s %8.1f MB/s %s\n",t[k].name,mb/s*1.048576,
+		       sum("pipe_stream.out")==(t[k].up ? up : plain) ? "" : "MISMATCH");
+	}
+	unlink("pipe_stream.in");
+	unlink("pipe_stream.out");
+	return 0;
+}
+
+int main(int argc,char **argv)
+{
+	const char *src="data",*dst="data2";
+	size_t bufsize=128;
+	int opt,sp=0,up=0;
+
+	while((opt=getopt(argc,argv,"m:b:uB:"))!=-1)
+	{
+		switch(opt)
+		{
+		case 'm':
+			sp=strcmp(optarg,"splice")==0;
+			if(!sp&&strcmp(optarg,"copy"))
+				goto usage;
+			break;
+		case 'b':
+			bufsize=atol(optarg);
+			if(bufsize==0)
+				goto usage;
+			break;
+		case 'u':
+			up=1;
+			break;
+		case 'B':
+			return bench(atol(optarg)>0 ? atol(optarg) : 256);
+		default:
+			goto usage;
+		}
+	}
+	if(optind<argc)
+		src=argv[optind++];
+	if(optind<argc)
+		dst=argv[optind++];
+	if(optind<argc)
+		goto usage;
+	return stream(src,dst,sp,bufsize,up)<0;
+
+usage:
+	printf("usage:./a.out [-m copy|splice] [-b bufsize] [-u] [src [dst]]\n       ./a.out -B MB\n");
+	return 1;
+}
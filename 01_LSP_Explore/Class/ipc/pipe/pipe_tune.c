@@ -0,0 +1,311 @@
+// sizeof_pipe.c without 65536 write() calls, plus a throughput/latency
+// sweep to pick the pipe size for a producer/consumer pair
+// cc -O2 pipe_tune.c -o pipe_tune
+//
+//   ./a.out                     capacity of a new pipe and the system limits
+//   ./a.out -S bytes            set a capacity, show what the kernel gave
+//   ./a.out -s [-b MB] [-p sizes] [-m sizes] [-c same,split,any]
+//                               sweep pipe size x message size x placement
+//
+// sizes are comma separated, with optional k/m suffix.  Placement: "same"
+// pins writer and reader to one CPU, "split" to two different CPUs, "any"
+// leaves it to the scheduler.
+//
+// Every message starts with the CLOCK_MONOTONIC time it was written; the
+// reader stores now-minus-that per message in a shared array, and the
+// parent sorts it for the percentiles once the reader is gone.
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sched.h>
+#include<signal.h>
+#include<time.h>
+#include<sys/mman.h>
+#include<sys/wait.h>
+
+#define MAXLIST		16
+#define MAXSAMPLES	(1<<20)
+
+static cpu_set_t allowed;	/* affinity we started with */
+
+static uint64_t ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*1000000000ull+ts.tv_nsec;
+}
+
+static long limit(const char *path)
+{
+	long v=-1;
+	FILE *fp=fopen(path,"r");
+
+	if(fp)
+	{
+		if(fscanf(fp,"%ld",&v)!=1)
+			v=-1;
+		fclose(fp);
+	}
+	return v;
+}
+
+static int parse_list(char *s,long *v)
+{
+	char *tok,*end;
+	int n=0;
+
+	for(tok=strtok(s,",");tok&&n<MAXLIST;tok=strtok(0,","))
+	{
+		v[n]=strtol(tok,&end,10);
+		if(*end=='k'||*end=='K')
+			v[n]<<=10;
+		else if(*end=='m'||*end=='M')
+			v[n]<<=20;
+		if(v[n]<=0)
+			return -1;
+		n++;
+	}
+	return n;
+}
+
+/* cpu<0 goes back to the starting affinity */
+static void pin(int cpu)
+{
+	cpu_set_t set;
+
+	if(cpu<0)
+	{
+		sched_setaffinity(0,sizeof(allowed),&allowed);
+		return;
+	}
+	CPU_ZERO(&set);
+	CPU_SET(cpu,&set);
+	sched_setaffinity(0,sizeof(set),&set);
+}
+
+/* the first n CPUs this process may run on */
+static int cpus(int *c,int n)
+{
+	int i,k=0;
+
+	sched_getaffinity(0,sizeof(allowed),&allowed);
+	for(i=0;i<CPU_SETSIZE&&k<n;i++)
+		if(CPU_ISSET(i,&allowed))
+			c[k++]=i;
+	return k;
+}
+
+static int xfer(int fd,char *p,size_t n,int wr)
+{
+	ssize_t r;
+
+	while(n)
+	{
+		r=wr ? write(fd,p,n) : read(fd,p,n);
+		if(r<0&&errno==EINTR)
+			continue;
+		if(r<=0)
+			return -1;
+		p+=r;
+		n-=r;
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////
+static int cmp(const void *a,const void *b)
+{
+	uint32_t x=*(const uint32_t *)a,y=*(const uint32_t *)b;
+
+	return x<y ? -1 : x>y;
+}
+
+static uint32_t pct(const uint32_t *s,long n,double p)
+{
+	long i=(long)(p*(n-1));
+
+	return s[i];
+}
+
+/* one run; 0 ok */
+static int run(long psize,long msize,long total,int wcpu,int rcpu,const char *place,uint32_t *lat)
+{
+	char *buf=malloc(msize);
+	long i,nmsg=total/msize,nsamp;
+	uint64_t t0,t;
+	int p[2],st;
+	pid_t pid;
+
+	if(nmsg<1000)
+		nmsg=1000;
+	nsamp=nmsg<MAXSAMPLES ? nmsg : MAXSAMPLES;
+	if(pipe(p)<0)
+		return -1;
+	if(fcntl(p[1],F_SETPIPE_SZ,psize)<0)
+	{
+		printf("%9ld  F_SETPIPE_SZ: %s\n",psize,strerror(errno));
+		close(p[0]);
+		close(p[1]);
+		free(buf);
+		return 0;
+	}
+	psize=fcntl(p[1],F_GETPIPE_SZ);
+	memset(buf,'x',msize);
+
+	pid=fork();
+	if(pid==0)
+	{
+		close(p[1]);
+		pin(rcpu);
+		for(i=0;i<nmsg;i++)
+		{
+			if(xfer(p[0],buf,msize,0)<0)
+				_exit(1);
+			memcpy(&t,buf,sizeof(t));
+			/* with more messages than samples, keep the last ones */
+			lat[i%nsamp]=ns()-t;
+		}
+		_exit(0);
+	}
+	close(p[0]);
+	pin(wcpu);
+
+	t0=ns();
+	for(i=0;i<nmsg;i++)
+	{
+		t=ns();
+		memcpy(buf,&t,sizeof(t));
+		if(xfer(p[1],buf,msize,1)<0)
+			break;
+	}
+	close(p[1]);
+	waitpid(pid,&st,0);
+	t=ns()-t0;
+	pin(-1);
+	free(buf);
+	if(i<nmsg||!WIFEXITED(st)||WEXITSTATUS(st))
+		return -1;
+
+	qsort(lat,nsamp,sizeof(*lat),cmp);
+	printf("%9ld %9ld  %-5s %10.1f %10.0f %9.1f %9.1f %9.1f %9.1f\n",
+	       psize,msize,place,(double)nmsg*msize/t*1e3,nmsg/(t/1e9),
+	       pct(lat,nsamp,0.5)/1e3,pct(lat,nsamp,0.99)/1e3,pct(lat,nsamp,0.999)/1e3,
+	       lat[nsamp-1]/1e3);
+	fflush(stdout);
+	return 0;
+}
+
+static int sweep(long *ps,int nps,long *ms,int nms,char *places,long total)
+{
+	static const char *names[]={"same","split","any"};
+	uint32_t *lat;
+	char *tok;
+	int c[2],nc,pl[3],npl=0,i,j,k,w,r;
+
+	for(tok=strtok(places,",");tok&&npl<3;tok=strtok(0,","))
+	{
+		for(k=0;k<3&&strcmp(tok,names[k]);k++)
+			;
+		if(k==3)
+			return -1;
+		pl[npl++]=k;
+	}
+	nc=cpus(c,2);
+	lat=mmap(0,MAXSAMPLES*sizeof(*lat),PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANONYMOUS,-1,0);
+	if(lat==MAP_FAILED)
+		return -1;
+
+	printf("%9s %9s  %-5s %10s %10s %9s %9s %9s %9s\n","pipe","msg","cpu",
+	       "MB/s","msgs/s","p50 us","p99 us","p99.9 us","max us");
+	for(k=0;k<npl;k++)
+	{
+		if(pl[k]==1&&nc<2)
+		{
+			printf("split: only one CPU available, skipped\n");
+			continue;
+		}
+		w=pl[k]==2 ? -1 : c[0];
+		r=pl[k]==2 ? -1 : pl[k]==1 ? c[1] : c[0];
+		for(i=0;i<nps;i++)
+			for(j=0;j<nms;j++)
+				if(run(ps[i],ms[j],total,w,r,names[pl[k]],lat)<0)
+					printf("%9ld %9ld  %-5s failed\n",ps[i],ms[j],names[pl[k]]);
+	}
+	munmap(lat,MAXSAMPLES*sizeof(*lat));
+	return 0;
+}
+
+int main(int argc,char **argv)
+{
+	long ps[MAXLIST]={4096,16384,65536,262144,1048576},ms[MAXLIST]={64,512,4096,65536};
+	char places[64]="same,split,any";
+	int opt,p[2],nps=5,nms=4,do_sweep=0,i;
+	long set=0,total=64<<20;
+
+	while((opt=getopt(argc,argv,"S:sb:p:m:c:"))!=-1)
+	{
+		switch(opt)
+		{
+		case 'S':
+			set=atol(optarg);
+			break;
+		case 's':
+			do_sweep=1;
+			break;
+		case 'b':
+			total=atol(optarg)<<20;
+			break;
+		case 'p':
+			nps=parse_list(optarg,ps);
+			break;
+		case 'm':
+			nms=parse_list(optarg,ms);
+			break;
+		case 'c':
+			snprintf(places,sizeof(places),"%s",optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if(optind!=argc||nps<1||nms<1||total<=0)
+		goto usage;
+	/* every message carries a uint64_t timestamp */
+	for(i=0;i<nms;i++)
+		if(ms[i]<(long)sizeof(uint64_t))
+			goto usage;
+	/* a reader that dies mid-run is an EPIPE and a "failed" row, not our end */
+	signal(SIGPIPE,SIG_IGN);
+
+	if(do_sweep)
+	{
+		if(sweep(ps,nps,ms,nms,places,total)<0)
+			goto usage;
+		return 0;
+	}
+
+	pipe(p);
+	printf("default capacity      %d\n",fcntl(p[1],F_GETPIPE_SZ));
+	printf("pipe-max-size         %ld\n",limit("/proc/sys/fs/pipe-max-size"));
+	printf("pipe-user-pages-soft  %ld\n",limit("/proc/sys/fs/pipe-user-pages-soft"));
+	printf("pipe-user-pages-hard  %ld\n",limit("/proc/sys/fs/pipe-user-pages-hard"));
+	if(set)
+	{
+		/* the kernel rounds up to a power of two number of pages */
+		if(fcntl(p[1],F_SETPIPE_SZ,set)<0)
+			perror("F_SETPIPE_SZ");
+		else
+			printf("asked %ld, got %d\n",set,fcntl(p[1],F_GETPIPE_SZ));
+	}
+	return 0;
+
+usage:
+	printf("usage:./a.out [-S bytes]\n       ./a.out -s [-b MB] [-p 4k,64k,...] [-m 64,4k,... (>=8)] [-c same,split,any]\n");
+	return 1;
+}
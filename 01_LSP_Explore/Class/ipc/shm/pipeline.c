@@ -0,0 +1,442 @@
+// implement_cmd.c for any "cmd1 | cmd2 | ... | cmdN"
+// cc -O2 pipeline.c -o pipeline
+//
+//   ./a.out [-m spawn|vfork|fork] [-r] [-q] [-n times] [-M MB] 'ps -el | grep pts/0'
+//
+// -m  how stages are started.  spawn (default) is posix_spawnp(), which
+//     glibc runs as clone(CLONE_VM|CLONE_VFORK): no copy of the parent's
+//     page tables, so the cost does not grow with the parent's size.  vfork
+//     is the same by hand; fork is the implement_cmd.c way, for comparison.
+// -r  put a splice() relay in this process between every two stages, so
+//     the bytes each stage writes are counted.  The data still never
+//     enters user space.
+// -q  no per stage report
+// -n  run the pipeline this many times and report pipelines/s and the
+//     mean time the parent spends starting each stage (with spawn/vfork
+//     that includes the child's exec, with fork it does not)
+// -M  touch this much memory first, to see fork slow down with a big
+//     parent while spawn/vfork do not
+//
+// The per stage report (stderr) has wall time from start to exit and the
+// user/sys CPU time wait4() returns for that stage.  A stage spawn could
+// not start gets "failed to start" and counts as exit 127, like in sh.
+//
+// At most MAXSTAGES (32) stages of MAXARGS-1 words each; more is a usage
+// error, not a longer pipeline:
+//
+//   ./a.out "$(yes true | head -32 | paste -sd'|')"	runs
+//   ./a.out "$(yes true | head -33 | paste -sd'|')"	usage, exit 1
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<poll.h>
+#include<signal.h>
+#include<spawn.h>
+#include<unistd.h>
+#include<time.h>
+#include<sys/mman.h>
+#include<sys/wait.h>
+#include<sys/resource.h>
+
+#define MAXSTAGES	32
+#define MAXARGS		64
+#define RELAY_CHUNK	(64*1024)
+
+extern char **environ;
+
+struct stage {
+	char *argv[MAXARGS];
+	pid_t pid;
+	double start,end;	/* seconds */
+	struct rusage ru;
+	int status;
+	long long bytes;	/* written to the next stage, with -r */
+};
+
+struct relay {
+	int in,out;		/* from stage i, to stage i+1 */
+	int wait_out;		/* last splice hit a full output pipe */
+	long long *bytes;
+};
+
+static struct stage st[MAXSTAGES];
+static int nst;
+static int mode;		/* 0 spawn, 1 vfork, 2 fork */
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+/* split on '|' then on blanks; 'single' and "double" quotes group words */
+static int parse(char *s)
+{
+	char *o,c;
+	int a=0,q;
+
+	nst=0;
+	memset(st,0,sizeof(st));
+	for(;;)
+	{
+		while(*s==' '||*s=='\t')
+			s++;
+		if(*s=='|'||*s==0)
+		{
+			if(a==0||nst==MAXSTAGES)
+				return -1;		/* empty stage */
+			st[nst++].argv[a]=0;
+			a=0;
+			if(*s++==0)
+				return 0;
+			continue;
+		}
+		/* a word after the last '|' that fits opens one stage too many */
+		if(nst==MAXSTAGES||a==MAXARGS-1)
+			return -1;
+		st[nst].argv[a++]=o=s;
+		q=0;
+		while(*s&&(q||(*s!=' '&&*s!='\t'&&*s!='|')))
+		{
+			if(q==0&&(*s=='\''||*s=='"'))
+				q=*s++;
+			else if(q&&*s==q)
+			{
+				q=0;
+				s++;
+			}
+			else
+				*o++=*s++;
+		}
+		if(q)
+			return -1;
+		/* the terminator may be overwritten by the word's own NUL */
+		c=*s;
+		*o=0;
+		if(c==0)
+			continue;
+		s++;
+		if(c=='|')
+		{
+			if(nst==MAXSTAGES)
+				return -1;
+			st[nst++].argv[a]=0;
+			a=0;
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////
+/* start argv with stdin=in, stdout=out; all pipes are O_CLOEXEC */
+static pid_t start(char **argv,int in,int out)
+{
+	posix_spawn_file_actions_t fa;
+	posix_spawnattr_t at;
+	sigset_t pipeset;
+	pid_t pid;
+	int r;
+
+	/* the runner ignores SIGPIPE; the stages get the default back */
+	sigemptyset(&pipeset);
+	sigaddset(&pipeset,SIGPIPE);
+	if(mode==0)
+	{
+		posix_spawnattr_init(&at);
+		posix_spawnattr_setsigdefault(&at,&pipeset);
+		posix_spawnattr_setflags(&at,POSIX_SPAWN_SETSIGDEF);
+		posix_spawn_file_actions_init(&fa);
+		if(in!=0)
+			posix_spawn_file_actions_adddup2(&fa,in,0);
+		if(out!=1)
+			posix_spawn_file_actions_adddup2(&fa,out,1);
+		r=posix_spawnp(&pid,argv[0],&fa,&at,argv,environ);
+		posix_spawn_file_actions_destroy(&fa);
+		posix_spawnattr_destroy(&at);
+		if(r)
+		{
+			errno=r;
+			return -1;
+		}
+		return pid;
+	}
+
+	/* only async-signal-safe calls between vfork() and exec */
+	pid=mode==1 ? vfork() : fork();
+	if(pid==0)
+	{
+		struct sigaction sa={.sa_handler=SIG_DFL};
+
+		sigaction(SIGPIPE,&sa,0);
+		if(in!=0)
+			dup2(in,0);
+		if(out!=1)
+			dup2(out,1);
+		execvp(argv[0],argv);
+		_exit(127);
+	}
+	return pid;
+}
+
+/* move bytes between stages until every input has hit EOF */
+static void relay_loop(struct relay *r,int n)
+{
+	struct pollfd pf[MAXSTAGES];
+	ssize_t k;
+	int i,left=n;
+
+	while(left)
+	{
+		for(i=0;i<n;i++)
+		{
+			pf[i].fd=r[i].in<0 ? -1 : r[i].wait_out ? r[i].out : r[i].in;
+			pf[i].events=r[i].wait_out ? POLLOUT : POLLIN;
+		}
+		if(poll(pf,n,-1)<0)
+		{
+			if(errno==EINTR)
+				continue;
+			perror("poll");
+			return;
+		}
+		for(i=0;i<n;i++)
+		{
+			if(r[i].in<0||!pf[i].revents)
+				continue;
+			k=splice(r[i].in,0,r[i].out,0,RELAY_CHUNK,SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+			if(k>0)
+			{
+				*r[i].bytes+=k;
+				r[i].wait_out=0;
+				continue;
+			}
+			if(k<0&&errno==EAGAIN)
+			{
+				/*
+				 * Polled the input and it had data: the output is
+				 * full.  Polled the output and it had room: the input
+				 * is empty.  Either way, wait on the other end.
+				 */
+				r[i].wait_out=!r[i].wait_out;
+				continue;
+			}
+			/*
+			 * EOF, or EPIPE: the next stage closed its input (yes |
+			 * head -1).  Either way this link is done; closing the
+			 * input passes that on upstream.
+			 */
+			close(r[i].in);
+			close(r[i].out);
+			r[i].in=-1;
+			left--;
+		}
+	}
+}
+
+/* 0 when every stage exited 0 */
+static int run(int use_relay,double *spawn_time)
+{
+	struct relay rl[MAXSTAGES];
+	struct rusage ru;
+	int fds[4*MAXSTAGES],nfd=0,in=0,i,j,p[2],q[2],bad=0,s;
+	int sin[MAXSTAGES],sout[MAXSTAGES];
+	double t;
+	pid_t pid;
+
+	/* all pipes first: O_CLOEXEC keeps every stage from holding the others */
+	for(i=0;i<nst;i++)
+	{
+		st[i].bytes=0;
+		sin[i]=in;
+		if(i==nst-1)
+		{
+			sout[i]=1;
+			break;
+		}
+		if(pipe2(p,O_CLOEXEC)<0)
+			goto fail;
+		fds[nfd++]=p[0];
+		fds[nfd++]=p[1];
+		sout[i]=p[1];
+		in=p[0];
+		if(use_relay)
+		{
+			if(pipe2(q,O_CLOEXEC)<0)
+				goto fail;
+			fds[nfd++]=q[0];
+			fds[nfd++]=q[1];
+			rl[i].in=p[0];
+			rl[i].out=q[1];
+			rl[i].wait_out=0;
+			rl[i].bytes=&st[i].bytes;
+			in=q[0];
+		}
+	}
+
+	for(i=0;i<nst;i++)
+	{
+		t=now();
+		st[i].start=t;
+		pid=start(st[i].argv,sin[i],sout[i]);
+		*spawn_time+=now()-t;
+		st[i].pid=pid;
+		if(pid<0)
+		{
+			fprintf(stderr,"%s: %s\n",st[i].argv[0],strerror(errno));
+			/* what a shell reports for a command it could not run */
+			st[i].end=st[i].start;
+			st[i].status=127<<8;
+			memset(&st[i].ru,0,sizeof(st[i].ru));
+			bad=1;
+		}
+	}
+	/* our copies of the stage ends go, or nobody would ever see EOF */
+	for(i=0;i<nfd;i++)
+	{
+		for(j=0;use_relay&&j<nst-1;j++)
+			if(fds[i]==rl[j].in||fds[i]==rl[j].out)
+				break;
+		if(!use_relay||j==nst-1)
+			close(fds[i]);
+	}
+	if(use_relay&&nst>1)
+		relay_loop(rl,nst-1);
+
+	for(i=0;i<nst;i++)
+	{
+		if(st[i].pid<=0)
+			continue;
+		pid=wait4(-1,&s,0,&ru);
+		if(pid<0)
+		{
+			if(errno==EINTR)
+			{
+				i--;
+				continue;
+			}
+			/* ECHILD: nothing left to wait for, whatever st[] says */
+			perror("wait4");
+			return -1;
+		}
+		for(j=0;j<nst&&st[j].pid!=pid;j++)
+			;
+		if(j==nst)
+		{
+			i--;
+			continue;
+		}
+		st[j].end=now();
+		st[j].ru=ru;
+		st[j].status=s;
+		if(!WIFEXITED(s)||WEXITSTATUS(s))
+			bad=1;
+	}
+	return bad ? -1 : 0;
+
+fail:
+	perror("pipe2");
+	for(i=0;i<nfd;i++)
+		close(fds[i]);
+	/* nothing was started: report it that way */
+	for(i=0;i<nst;i++)
+	{
+		st[i].pid=-1;
+		st[i].status=127<<8;
+	}
+	return -1;
+}
+
+static void report(int use_relay)
+{
+	int i,k;
+
+	for(i=0;i<nst;i++)
+	{
+		fprintf(stderr,"[%d] ",i);
+		for(k=0;st[i].argv[k];k++)
+			fprintf(stderr,"%s%s",k ? " " : "",st[i].argv[k]);
+		if(st[i].pid<0)
+		{
+			fprintf(stderr,"\n    failed to start  exit 127\n");
+			continue;
+		}
+		fprintf(stderr,"\n    wall %.3f ms  user %.3f ms  sys %.3f ms  exit %d",
+			(st[i].end-st[i].start)*1e3,
+			st[i].ru.ru_utime.tv_sec*1e3+st[i].ru.ru_utime.tv_usec/1e3,
+			st[i].ru.ru_stime.tv_sec*1e3+st[i].ru.ru_stime.tv_usec/1e3,
+			WIFEXITED(st[i].status) ? WEXITSTATUS(st[i].status) : 128+WTERMSIG(st[i].status));
+		if(use_relay&&i<nst-1)
+			fprintf(stderr,"  out %lld bytes",st[i].bytes);
+		fprintf(stderr,"\n");
+	}
+}
+
+int main(int argc,char **argv)
+{
+	int opt,use_relay=0,quiet=0,times=1,i,r=0;
+	double t,spawn=0;
+	long big=0;
+	char *mem;
+
+	while((opt=getopt(argc,argv,"m:rqn:M:"))!=-1)
+	{
+		switch(opt)
+		{
+		case 'm':
+			mode=strcmp(optarg,"spawn")==0 ? 0 : strcmp(optarg,"vfork")==0 ? 1 :
+			     strcmp(optarg,"fork")==0 ? 2 : -1;
+			if(mode<0)
+				goto usage;
+			break;
+		case 'r':
+			use_relay=1;
+			break;
+		case 'q':
+			quiet=1;
+			break;
+		case 'n':
+			times=atoi(optarg);
+			break;
+		case 'M':
+			big=atol(optarg)<<20;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if(argc-optind!=1||times<1||parse(argv[optind])<0)
+		goto usage;
+	/* a stage that exits early must not take the relay and the report with it */
+	signal(SIGPIPE,SIG_IGN);
+	if(big>0)
+	{
+		/* 4 KiB pages, like a long running heap; THP would hide the cost */
+		mem=mmap(0,big,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+		if(mem!=MAP_FAILED)
+		{
+			madvise(mem,big,MADV_NOHUGEPAGE);
+			memset(mem,1,big);
+		}
+	}
+
+	t=now();
+	for(i=0;i<times;i++)
+		if(run(use_relay,&spawn)<0)
+			r=1;
+	t=now()-t;
+
+	if(!quiet)
+		report(use_relay);
+	if(times>1)
+		fprintf(stderr,"%d pipelines in %.3f s: %.0f/s, %.1f us to start a stage\n",
+			times,t,times/t,spawn/(times*nst)*1e6);
+	return r;
+
+usage:
+	printf("usage:./a.out [-m spawn|vfork|fork] [-r] [-q] [-n times] [-M MB] 'cmd1 | cmd2 | ...'\n");
+	return 1;
+}
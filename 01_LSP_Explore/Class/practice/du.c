@@ -0,0 +1,325 @@
+// file_size.c for a whole tree: du style totals per directory
+// cc -O2 -pthread du.c pwalk.c -o du
+//
+//   ./a.out [-j threads] [-b] [-s] [-n N] path
+//     -b    apparent size (st_size) instead of allocated blocks
+//     -s    only the grand total
+//     -n N  only the N biggest directories
+//
+// Each directory's totals live in its pwalk node.  When a directory and
+// everything below it is done its totals are added atomically into the
+// parent and the node is freed, so no lock is taken and only the part of
+// the tree still being walked is in memory.  Grand totals and the top-N
+// heaps are per worker and merged at the end.  Hard linked inodes go
+// into a set split in LINK_SHARDS pieces, each with its own lock and
+// growing as it fills, so a tree with millions of them still counts each
+// once.
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<limits.h>
+#include<unistd.h>
+#include<fcntl.h>
+#include<dirent.h>
+#include<sys/stat.h>
+#include<pthread.h>
+#include<sys/sysmacros.h>
+#include"pwalk.h"
+
+#define OUTSZ		(64*1024)
+#define LINK_SHARDS	256
+#define LINK_SLOTS	1024		/* per shard to start with, doubled when 3/4 full */
+
+struct tot {
+	uint64_t blocks;	/* 512 byte units */
+	uint64_t bytes;
+};
+
+struct top {
+	uint64_t val;
+	char *path;
+};
+
+struct wstate {
+	struct tot sum;
+	uint64_t files,dirs;
+	struct top *heap;	/* min-heap of the biggest dirs seen */
+	int nheap;
+	char buf[OUTSZ];
+	int len;
+} __attribute__((aligned(64)));
+
+static struct wstate *ws;
+struct ikey {
+	uint64_t dev;		/* dev+1: 0 is an empty slot */
+	uint64_t ino;
+};
+
+/* inodes with nlink>1 already counted */
+static struct lshard {
+	pthread_mutex_t lock;
+	struct ikey *slot;
+	size_t cap,n;
+} __attribute__((aligned(64))) links[LINK_SHARDS];
+
+static int apparent,summary,topn;
+
+static uint64_t val(const struct tot *t)
+{
+	return apparent ? t->bytes : t->blocks*512;
+}
+
+static uint64_t khash(uint64_t dev,uint64_t ino)
+{
+	return (ino*0x9e3779b97f4a7c15ull)^(dev*0xc2b2ae3d27d4eb4full);
+}
+
+/* open addressing in s; the slot holding k or the empty one where it goes */
+static struct ikey *slot_of(struct ikey *slot,size_t cap,uint64_t dev,uint64_t ino)
+{
+	size_t h=(khash(dev,ino)>>8)&(cap-1);
+
+	while(slot[h].dev&&(slot[h].dev!=dev||slot[h].ino!=ino))
+		h=(h+1)&(cap-1);
+	return &slot[h];
+}
+
+static int grow(struct lshard *s)
+{
+	size_t cap=s->cap ? s->cap*2 : LINK_SLOTS,i;
+	struct ikey *n=calloc(cap,sizeof(*n));
+
+	if(n==0)
+		return -1;
+	for(i=0;i<s->cap;i++)
+		if(s->slot[i].dev)
+			*slot_of(n,cap,s->slot[i].dev,s->slot[i].ino)=s->slot[i];
+	free(s->slot);
+	s->slot=n;
+	s->cap=cap;
+	return 0;
+}
+
+/* count a hard linked inode only the first time it is seen */
+static int first_link(uint64_t dev,uint64_t ino)
+{
+	struct lshard *s=&links[khash(dev,ino)&(LINK_SHARDS-1)];
+	struct ikey *k;
+	int r=0;
+
+	dev++;
+	pthread_mutex_lock(&s->lock);
+	if(4*(s->n+1)>3*s->cap&&grow(s)<0)
+	{
+		/* a wrong total is worse than none */
+		fprintf(stderr,"du: out of memory for the hard link set\n");
+		exit(1);
+	}
+	k=slot_of(s->slot,s->cap,dev,ino);
+	if(k->dev==0)
+	{
+		k->dev=dev;
+		k->ino=ino;
+		s->n++;
+		r=1;
+	}
+	pthread_mutex_unlock(&s->lock);
+	return r;
+}
+
+static void add(struct tot *t,const struct statx *x)
+{
+	if((x->stx_mask&STATX_NLINK)&&x->stx_nlink>1&&!S_ISDIR(x->stx_mode)&&
+	   !first_link(makedev(x->stx_dev_major,x->stx_dev_minor),x->stx_ino))
+		return;
+	__atomic_add_fetch(&t->blocks,x->stx_blocks,__ATOMIC_RELAXED);
+	__atomic_add_fetch(&t->bytes,x->stx_size,__ATOMIC_RELAXED);
+}
+
+static int entry(struct pw_worker *w,struct pw_dir *d,int dfd,const char *name,unsigned char type)
+{
+	struct statx x;
+
+	if(type==DT_DIR)
+		return 1;	/* counted by dir_enter() from its own fd */
+	if(statx(dfd,name,AT_SYMLINK_NOFOLLOW|AT_STATX_DONT_SYNC,
+		 STATX_BLOCKS|STATX_SIZE|STATX_NLINK|STATX_INO|STATX_TYPE,&x)<0)
+		return 0;
+	add(d->priv,&x);
+	ws[w->id].files++;
+	return 0;
+}
+
+static void dir_enter(struct pw_worker *w,struct pw_dir *d,int dfd)
+{
+	struct statx x;
+
+	if(statx(dfd,"",AT_EMPTY_PATH|AT_STATX_DONT_SYNC,STATX_BLOCKS|STATX_SIZE|STATX_TYPE,&x)==0)
+		add(d->priv,&x);
+	ws[w->id].dirs++;
+}
+
+//////////////////////////////////////////////////////////////
+static void heap_swap(struct top *h,int a,int b)
+{
+	struct top t=h[a];
+
+	h[a]=h[b];
+	h[b]=t;
+}
+
+static void heap_offer(struct wstate *s,struct pw_dir *d,uint64_t v)
+{
+	char path[PATH_MAX];
+	struct top *h=s->heap;
+	int i,c;
+
+	if(s->nheap==topn&&v<=h[0].val)
+		return;
+	if(pw_path(d,0,path,sizeof(path))<0)
+		return;
+	if(s->nheap<topn)
+	{
+		i=s->nheap++;
+		h[i].val=v;
+		h[i].path=strdup(path);
+		for(;i&&h[(i-1)/2].val>h[i].val;i=(i-1)/2)
+			heap_swap(h,i,(i-1)/2);
+		return;
+	}
+	free(h[0].path);
+	h[0].val=v;
+	h[0].path=strdup(path);
+	for(i=0;(c=2*i+1)<s->nheap;i=c)
+	{
+		if(c+1<s->nheap&&h[c+1].val<h[c].val)
+			c++;
+		if(h[i].val<=h[c].val)
+			break;
+		heap_swap(h,i,c);
+	}
+}
+
+static void flush(struct wstate *s)
+{
+	if(s->len)
+		write(1,s->buf,s->len);
+	s->len=0;
+}
+
+static void dir_done(struct pw_worker *w,struct pw_dir *d)
+{
+	struct wstate *s=&ws[w->id];
+	struct tot *t=d->priv,*p;
+	uint64_t v=val(t);
+	int n;
+
+	if(d->parent)
+	{
+		p=d->parent->priv;
+		__atomic_add_fetch(&p->blocks,t->blocks,__ATOMIC_RELAXED);
+		__atomic_add_fetch(&p->bytes,t->bytes,__ATOMIC_RELAXED);
+	}
+	else
+		s->sum=*t;
+
+	if(topn)
+		heap_offer(s,d,v);
+	else if(!summary||!d->parent)
+	{
+		if(OUTSZ-s->len<PATH_MAX+32)
+			flush(s);
+		n=sprintf(s->buf+s->len,"%llu\t",(unsigned long long)(apparent ? v : v/1024));
+		if(pw_path(d,0,s->buf+s->len+n,OUTSZ-s->len-n-1)>=0)
+		{
+			s->len+=n+strlen(s->buf+s->len+n);
+			s->buf[s->len++]='\n';
+		}
+	}
+}
+
+static int by_val(const void *a,const void *b)
+{
+	const struct top *x=a,*y=b;
+
+	return x->val<y->val ? 1 : x->val>y->val ? -1 : 0;
+}
+
+int main(int argc,char **argv)
+{
+	struct pw_ops ops={0};
+	struct tot grand={0,0};
+	struct top *all;
+	uint64_t files=0,dirs=0;
+	int opt,i,j,n=0,nthreads=pw_ncpu();
+
+	while((opt=getopt(argc,argv,"j:bsn:"))!=-1)
+	{
+		switch(opt)
+		{
+		case 'j':
+			nthreads=atoi(optarg);
+			break;
+		case 'b':
+			apparent=1;
+			break;
+		case 's':
+			summary=1;
+			break;
+		case 'n':
+			topn=atoi(optarg);
+			break;
+		default:
+			printf("usage:./a.out [-j threads] [-b] [-s] [-n N] path\n");
+			return 1;
+		}
+	}
+	if(argc-optind!=1||nthreads<1||topn<0)
+	{
+		printf("usage:./a.out [-j threads] [-b] [-s] [-n N] path\n");
+		return 1;
+	}
+
+	for(i=0;i<LINK_SHARDS;i++)
+		pthread_mutex_init(&links[i].lock,0);
+	ws=aligned_alloc(64,nthreads*sizeof(*ws));
+	memset(ws,0,nthreads*sizeof(*ws));
+	for(i=0;topn&&i<nthreads;i++)
+		ws[i].heap=malloc(topn*sizeof(struct top));
+
+	ops.entry=entry;
+	ops.dir_enter=dir_enter;
+	ops.dir_done=dir_done;
+	ops.dir_size=sizeof(struct tot);
+	if(pw_run(argv[optind],nthreads,&ops,0)<0)
+		return 1;
+
+	for(i=0;i<nthreads;i++)
+	{
+		flush(&ws[i]);
+		files+=ws[i].files;
+		dirs+=ws[i].dirs;
+		grand.blocks+=ws[i].sum.blocks;	/* only the root's worker has it */
+		grand.bytes+=ws[i].sum.bytes;
+	}
+
+	if(topn)
+	{
+		for(i=0;i<nthreads;i++)
+			n+=ws[i].nheap;
+		all=malloc((n ? n : 1)*sizeof(*all));
+		for(i=0,n=0;i<nthreads;i++)
+			for(j=0;j<ws[i].nheap;j++)
+				all[n++]=ws[i].heap[j];
+		qsort(all,n,sizeof(*all),by_val);
+		for(i=0;i<n&&i<topn;i++)
+			printf("%llu\t%s\n",(unsigned long long)(apparent ? all[i].val : all[i].val/1024),
+			       all[i].path);
+	}
+	fprintf(stderr,"%llu files, %llu dirs, %llu KiB allocated, %llu bytes\n",
+		(unsigned long long)files,(unsigned long long)dirs,
+		(unsigned long long)grand.blocks/2,(unsigned long long)grand.bytes);
+	return 0;
+}
@@ -0,0 +1,100 @@
+// sync statx vs io_uring statx over one directory, cold and warm cache
+// cc -O2 lsbench.c lsdir.c lsdir_uring.c -o lsbench
+// cold runs need root (they write /proc/sys/vm/drop_caches)
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<time.h>
+#include"lsdir.h"
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static int drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd=open("/proc/sys/vm/drop_caches",O_WRONLY);
+	if(fd<0)
+		return -1;
+	if(write(fd,"3",1)!=1)
+	{
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+/* returns seconds, -1 if cold was asked for and not possible */
+static double run(const char *path,unsigned qd,int cold,int *n,int *fell_back)
+{
+	struct ls_dir d;
+	double t;
+
+	if(cold&&drop_caches()<0)
+		return -1;
+	t=now();
+	if(lsd_open(&d,path,1)<0)
+		exit(1);
+	if(qd)
+		*fell_back=lsd_stat_uring(&d,qd);
+	else
+		lsd_stat(&d);
+	t=now()-t;
+	*n=d.n;
+	lsd_close(&d);
+	return t;
+}
+
+int main(int argc,char **argv)
+{
+	unsigned qd=128;
+	int rounds=5,cold,async,i,n=0,fb=0;
+	double t,best;
+
+	if(argc<2||argc>4)
+	{
+		printf("usage:./a.out dir [queue depth] [rounds]\n");
+		return 1;
+	}
+	if(argc>2)
+		qd=atoi(argv[2]);
+	if(argc>3)
+		rounds=atoi(argv[3]);
+
+	printf("%-6s %-5s %8s %10s %12s\n","cache","path","entries","best ms","entries/s");
+	for(cold=1;cold>=0;cold--)
+	{
+		for(async=0;async<2;async++)
+		{
+			best=-1;
+			for(i=0;i<rounds;i++)
+			{
+				t=run(argv[1],async ? qd : 0,cold,&n,&fb);
+				if(t<0)
+					break;
+				if(best<0||t<best)
+					best=t;
+			}
+			if(best<0)
+			{
+				printf("%-6s %-5s   skipped (drop_caches needs root)\n",
+				       cold ? "cold" : "warm",async ? "uring" : "sync");
+				continue;
+			}
+			printf("%-6s %-5s %8d %10.3f %12.0f%s\n",cold ? "cold" : "warm",
+			       async ? "uring" : "sync",n,best*1e3,n/best,
+			       async&&fb ? "  (io_uring unavailable, sync fallback)" : "");
+		}
+	}
+	return 0;
+}
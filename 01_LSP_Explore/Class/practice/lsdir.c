@@ -0,0 +1,432 @@
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<dirent.h>
+#include<pwd.h>
+#include<grp.h>
+#include<time.h>
+#include<sys/stat.h>
+#include<sys/syscall.h>
+#include"lsdir.h"
+
+#define ARENA_CHUNK	(1024*1024)
+#define DENTS_BUF	(64*1024)
+#define OUT_BUF		(1024*1024)
+
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+struct ls_arena {
+	struct ls_arena *next;
+	size_t used, size;
+	char mem[];
+};
+
+static char *arena_dup(struct ls_dir *d,const char *s,size_t l)
+{
+	struct ls_arena *a=d->arena;
+	size_t sz;
+	char *p;
+
+	if(a==0||a->size-a->used<l+1)
+	{
+		sz=l+1>ARENA_CHUNK ? l+1 : ARENA_CHUNK;
+		a=malloc(sizeof(*a)+sz);
+		if(a==0)
+			return 0;
+		a->next=d->arena;
+		a->used=0;
+		a->size=sz;
+		d->arena=a;
+	}
+	p=a->mem+a->used;
+	memcpy(p,s,l+1);
+	a->used+=l+1;
+	return p;
+}
+
+//////////////////////////////////////////////////////////////
+int lsd_open(struct ls_dir *d,const char *path,int all)
+{
+	struct linux_dirent64 *e;
+	struct ls_ent *ne;
+	char *buf;
+	long n,off;
+
+	memset(d,0,sizeof(*d));
+	d->fd=open(path,O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if(d->fd<0)
+	{
+		perror("opendir");
+		return -1;
+	}
+	buf=malloc(DENTS_BUF);
+	if(buf==0)
+		goto nomem;
+	while((n=syscall(SYS_getdents64,d->fd,buf,DENTS_BUF))>0)
+	{
+		for(off=0;off<n;off+=e->d_reclen)
+		{
+			e=(struct linux_dirent64 *)(buf+off);
+			if(e->d_name[0]=='.'&&!all)
+				continue;
+			if(d->n==d->cap)
+			{
+				ne=realloc(d->e,(d->cap ? d->cap*2 : 1024)*sizeof(*d->e));
+				if(ne==0)
+					goto nomem;
+				d->e=ne;
+				d->cap=d->cap ? d->cap*2 : 1024;
+			}
+			memset(&d->e[d->n],0,sizeof(d->e[0]));
+			d->e[d->n].name=arena_dup(d,e->d_name,strlen(e->d_name));
+			if(d->e[d->n].name==0)
+				goto nomem;
+			d->e[d->n].type=e->d_type;
+			d->e[d->n].ino=e->d_ino;
+			d->n++;
+		}
+	}
+	if(n<0)
+		perror("getdents64");
+	free(buf);
+	return 0;
+
+nomem:
+	/* nothing half built is handed back: the caller gets -1 and no d */
+	perror("lsd_open");
+	free(buf);
+	lsd_close(d);
+	return -1;
+}
+
+void lsd_close(struct ls_dir *d)
+{
+	struct ls_arena *a;
+
+	while((a=d->arena))
+	{
+		d->arena=a->next;
+		free(a);
+	}
+	free(d->e);
+	if(d->fd>=0)
+		close(d->fd);
+	d->fd=-1;
+}
+
+void lsd_fill(struct ls_ent *p,const struct statx *x)
+{
+	p->ino=x->stx_ino;
+	p->size=x->stx_size;
+	p->blocks=x->stx_blocks;
+	p->mtime=x->stx_mtime.tv_sec;
+	p->uid=x->stx_uid;
+	p->gid=x->stx_gid;
+	p->nlink=x->stx_nlink;
+	p->mode=x->stx_mode;
+	p->stated=1;
+}
+
+int lsd_stat(struct ls_dir *d)
+{
+	struct statx x;
+	int i;
+
+	for(i=0;i<d->n;i++)
+	{
+		if(statx(d->fd,d->e[i].name,AT_SYMLINK_NOFOLLOW|AT_NO_AUTOMOUNT,
+			 STATX_BASIC_STATS,&x)<0)
+			continue;
+		lsd_fill(&d->e[i],&x);
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////// output
+static char out[OUT_BUF];
+static int olen;
+
+static void ob_flush(void)
+{
+	int n,off=0;
+
+	while(off<olen&&(n=write(1,out+off,olen-off))>0)
+		off+=n;
+	olen=0;
+}
+
+/* longest single line is well under this */
+static void ob_room(void)
+{
+	if(OUT_BUF-olen<8192)
+		ob_flush();
+}
+
+static void ob_putc(char c)
+{
+	out[olen++]=c;
+}
+
+static void ob_puts(const char *s)
+{
+	size_t l=strlen(s);
+
+	if(l>(size_t)(OUT_BUF-olen))
+	{
+		ob_flush();
+		write(1,s,l);
+		return;
+	}
+	memcpy(out+olen,s,l);
+	olen+=l;
+}
+
+static void ob_pad(const char *s,int width)
+{
+	int l=strlen(s);
+
+	ob_puts(s);
+	while(l++<width)
+		ob_putc(' ');
+}
+
+/* printf("%*d") / printf("%-*d") without printf */
+static void ob_num(long long v,int width,int left)
+{
+	char t[24];
+	int i=sizeof(t),neg=v<0;
+	unsigned long long u=neg ? -(unsigned long long)v : (unsigned long long)v;
+
+	t[--i]=0;
+	do
+		t[--i]='0'+u%10;
+	while(u/=10);
+	if(neg)
+		t[--i]='-';
+	if(left)
+		ob_pad(t+i,width);
+	else
+	{
+		width-=sizeof(t)-1-i;
+		while(width-->0)
+			ob_putc(' ');
+		ob_puts(t+i);
+	}
+}
+
+////////////////////////////////////////////////////////////// caches
+#define NAME_SLOTS	1024
+
+struct name_slot {
+	int used;
+	uint32_t id;
+	char name[33];
+};
+
+static struct name_slot users[NAME_SLOTS],groups[NAME_SLOTS];
+
+static const char *id_name(struct name_slot *tab,uint32_t id,int group)
+{
+	static char spill[33];
+	unsigned h=(id*2654435761u)%NAME_SLOTS;
+	struct passwd *pw=0;
+	struct group *gr=0;
+	char *t=spill;
+	int i;
+
+	for(i=0;i<NAME_SLOTS;i++,h=(h+1)%NAME_SLOTS)
+	{
+		if(!tab[h].used)
+			break;
+		if(tab[h].id==id)
+			return tab[h].name;
+	}
+	if(i<NAME_SLOTS)	/* else the table is full: stop caching */
+	{
+		tab[h].used=1;
+		tab[h].id=id;
+		t=tab[h].name;
+	}
+
+	if(group)
+		gr=getgrgid(id);
+	else
+		pw=getpwuid(id);
+	if(gr)
+		snprintf(t,33,"%s",gr->gr_name);
+	else if(pw)
+		snprintf(t,33,"%s",pw->pw_name);
+	else
+		snprintf(t,33,"%u",id);
+	return t;
+}
+
+/*
+ * ctime() style date.  Every UTC offset is a whole number of minutes, so
+ * all mtimes in one minute share "Www Mmm dd hh:mm:" and the year; only
+ * the seconds are filled in per entry.
+ */
+#define TIME_SLOTS	1024
+
+struct time_slot {
+	int64_t minute;
+	char head[20];		/* "Thu Oct 15 22:59:" */
+	char year[16];		/* " 2026" */
+};
+
+static struct time_slot times[TIME_SLOTS];
+
+static void ob_time(int64_t t)
+{
+	int64_t m=t>=0 ? t/60 : (t-59)/60;
+	struct time_slot *s=&times[(uint64_t)m%TIME_SLOTS];
+	int sec=t-m*60;
+	struct tm tm;
+	time_t tt;
+
+	if(s->head[0]==0||s->minute!=m)
+	{
+		tt=m*60;
+		localtime_r(&tt,&tm);
+		strftime(s->head,sizeof(s->head),"%a %b %e %H:%M:",&tm);
+		snprintf(s->year,sizeof(s->year)," %d",tm.tm_year+1900);
+		s->minute=m;
+	}
+	ob_puts(s->head);
+	ob_putc('0'+sec/10);
+	ob_putc('0'+sec%10);
+	ob_puts(s->year);
+}
+
+//////////////////////////////////////////////////////////////
+static void ob_mode(const struct ls_ent *p)
+{
+	static const char rwx[]="xwr";
+	int i;
+
+	if(!p->stated)
+	{
+		ob_puts("??????????");
+		return;
+	}
+	if(S_ISREG(p->mode))
+		ob_putc('-');
+	else if(S_ISDIR(p->mode))
+		ob_putc('d');
+	else if(S_ISCHR(p->mode))
+		ob_putc('c');
+	else if(S_ISBLK(p->mode))
+		ob_putc('b');
+	else if(S_ISLNK(p->mode))
+		ob_putc('l');
+	else if(S_ISFIFO(p->mode))
+		ob_putc('p');
+	else if(S_ISSOCK(p->mode))
+		ob_putc('s');
+
+	for(i=8;i>=0;i--)
+	{
+		if(p->mode>>i&1)
+			ob_putc(rwx[i%3]);
+		else
+			ob_puts("\x1b[0m-");
+	}
+}
+
+static void ob_name(const struct ls_ent *p,int width)
+{
+	if(S_ISDIR(p->mode)||(!p->stated&&p->type==DT_DIR))
+		ob_puts("\x1b[01;34m");
+	else if(p->mode&1)
+		ob_puts("\x1b[01;32m");
+	else
+		ob_puts("\x1b[0m");
+	if(width)
+	{
+		int l=strlen(p->name);
+		while(l++<width)
+			ob_putc(' ');
+	}
+	ob_puts(p->name);
+}
+
+void lsd_print(struct ls_dir *d,int fmt)
+{
+	struct ls_ent *p;
+	long long total=0;
+	int i;
+
+	if(fmt==LS_L)
+	{
+		for(i=0;i<d->n;i++)
+			total+=d->e[i].blocks;
+		ob_puts("total ");
+		ob_num(total,3,1);
+		ob_putc('\n');
+	}
+
+	for(i=0;i<d->n;i++)
+	{
+		p=&d->e[i];
+		ob_room();
+		switch(fmt)
+		{
+		case LS_NAMES:
+			ob_puts(p->name);
+			ob_putc(' ');
+			continue;
+		case LS_SHORT:
+			ob_name(p,15);
+			ob_putc('\t');
+			continue;
+		case LS_LS:
+			ob_num(p->blocks,3,1);
+			ob_mode(p);
+			ob_putc(' ');
+			ob_num(p->nlink,2,1);
+			ob_pad(id_name(users,p->uid,0),10);
+			ob_num(p->size,6,1);
+			break;
+		case LS_L:
+			ob_mode(p);
+			ob_putc(' ');
+			ob_num(p->nlink,2,1);
+			ob_pad(id_name(users,p->uid,0),10);
+			ob_num(p->size,6,1);
+			break;
+		case LS_LI:
+			ob_puts("\x1b[0m");
+			ob_num(p->ino,8,1);
+			ob_puts("  ");
+			ob_mode(p);
+			ob_putc(' ');
+			ob_num(p->nlink,3,0);
+			ob_puts("  ");
+			ob_puts(id_name(users,p->uid,0));
+			ob_puts("  ");
+			ob_puts(id_name(groups,p->gid,1));
+			ob_putc(' ');
+			ob_num(p->uid,0,1);
+			ob_puts("  ");
+			ob_num(p->size,6,1);
+			ob_puts("  ");
+			break;
+		}
+		ob_time(p->mtime);
+		ob_putc(' ');
+		ob_name(p,0);
+		ob_putc('\n');
+	}
+	if(fmt==LS_NAMES||fmt==LS_SHORT)
+		ob_putc('\n');
+	ob_flush();
+}
@@ -0,0 +1,57 @@
+#ifndef LSDIR_H
+#define LSDIR_H
+
+#include<stdint.h>
+#include<sys/types.h>
+
+/*
+ * Directory listing engine used by ls.c.
+ *
+ * lsd_open() reads the directory once with getdents64 into an array of
+ * entries whose names live in one arena.  lsd_stat() then fills the stat
+ * fields with one statx per entry relative to the directory fd, and
+ * lsd_print() formats everything through a single output buffer.
+ *
+ * lsd_stat_uring() does the same stats through io_uring, keeping up to qd
+ * statx requests in flight, and falls back to lsd_stat() when io_uring is
+ * not available (old kernel, seccomp, io_uring_disabled).  It returns 1
+ * when it had to fall back.  A qd above the kernel's ring limit is
+ * clamped to it.
+ *
+ * Only ls.c stats, so only ls.c uses it: fm/my_ls.c and open_dir.c print
+ * names straight from readdir() and make no stat call to batch.
+ */
+
+struct ls_ent {
+	char *name;
+	unsigned char type;	/* DT_* from getdents64 */
+	int stated;		/* stat fields below are valid */
+	uint64_t ino;
+	uint64_t size;
+	uint64_t blocks;
+	int64_t mtime;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t nlink;
+	uint16_t mode;
+};
+
+struct ls_dir {
+	int fd;
+	int n, cap;
+	struct ls_ent *e;
+	struct ls_arena *arena;
+};
+
+struct statx;
+
+enum { LS_SHORT, LS_NAMES, LS_L, LS_LS, LS_LI };
+
+int lsd_open(struct ls_dir *d, const char *path, int all);
+int lsd_stat(struct ls_dir *d);
+int lsd_stat_uring(struct ls_dir *d, unsigned qd);
+void lsd_fill(struct ls_ent *p, const struct statx *x);
+void lsd_print(struct ls_dir *d, int fmt);
+void lsd_close(struct ls_dir *d);
+
+#endif
@@ -0,0 +1,219 @@
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<unistd.h>
+#include<fcntl.h>
+#include<sys/stat.h>
+#include<sys/mman.h>
+#include<sys/syscall.h>
+#include<linux/io_uring.h>
+#include"lsdir.h"
+
+// io_uring statx backend for lsdir.c, raw syscalls so no liburing needed
+
+struct ring {
+	int fd;
+	unsigned *sq_head,*sq_tail,*sq_mask,*sq_array;
+	unsigned *cq_head,*cq_tail,*cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr,*cq_ptr;
+	size_t sq_sz,cq_sz,sqe_sz;
+	unsigned entries;
+};
+
+static int ring_init(struct ring *r,unsigned qd)
+{
+	struct io_uring_params p;
+
+	memset(&p,0,sizeof(p));
+	memset(r,0,sizeof(*r));
+	/* CLAMP: a queue depth past the kernel's limit gets the limit, not EINVAL */
+	p.flags=IORING_SETUP_CLAMP;
+	r->fd=syscall(__NR_io_uring_setup,qd,&p);
+	if(r->fd<0&&errno==EINVAL)
+	{
+		/* before 5.6 there is no CLAMP; 4096 was the limit then */
+		memset(&p,0,sizeof(p));
+		r->fd=syscall(__NR_io_uring_setup,qd<4096 ? qd : 4096,&p);
+	}
+	if(r->fd<0)
+		return -1;
+
+	r->entries=p.sq_entries;
+	r->sq_sz=p.sq_off.array+p.sq_entries*sizeof(unsigned);
+	r->cq_sz=p.cq_off.cqes+p.cq_entries*sizeof(struct io_uring_cqe);
+	if(p.features&IORING_FEAT_SINGLE_MMAP)
+	{
+		if(r->cq_sz>r->sq_sz)
+			r->sq_sz=r->cq_sz;
+		r->cq_sz=r->sq_sz;
+	}
+	r->sq_ptr=mmap(0,r->sq_sz,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,r->fd,IORING_OFF_SQ_RING);
+	if(r->sq_ptr==MAP_FAILED)
+		goto fail;
+	if(p.features&IORING_FEAT_SINGLE_MMAP)
+		r->cq_ptr=r->sq_ptr;
+	else
+	{
+		r->cq_ptr=mmap(0,r->cq_sz,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,r->fd,IORING_OFF_CQ_RING);
+		if(r->cq_ptr==MAP_FAILED)
+			goto fail;
+	}
+	r->sqe_sz=p.sq_entries*sizeof(struct io_uring_sqe);
+	r->sqes=mmap(0,r->sqe_sz,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,r->fd,IORING_OFF_SQES);
+	if(r->sqes==MAP_FAILED)
+		goto fail;
+
+	r->sq_head=(unsigned *)((char *)r->sq_ptr+p.sq_off.head);
+	r->sq_tail=(unsigned *)((char *)r->sq_ptr+p.sq_off.tail);
+	r->sq_mask=(unsigned *)((char *)r->sq_ptr+p.sq_off.ring_mask);
+	r->sq_array=(unsigned *)((char *)r->sq_ptr+p.sq_off.array);
+	r->cq_head=(unsigned *)((char *)r->cq_ptr+p.cq_off.head);
+	r->cq_tail=(unsigned *)((char *)r->cq_ptr+p.cq_off.tail);
+	r->cq_mask=(unsigned *)((char *)r->cq_ptr+p.cq_off.ring_mask);
+	r->cqes=(struct io_uring_cqe *)((char *)r->cq_ptr+p.cq_off.cqes);
+	return 0;
+fail:
+	if(r->sq_ptr&&r->sq_ptr!=MAP_FAILED)
+		munmap(r->sq_ptr,r->sq_sz);
+	if(r->cq_ptr&&r->cq_ptr!=MAP_FAILED&&r->cq_ptr!=r->sq_ptr)
+		munmap(r->cq_ptr,r->cq_sz);
+	close(r->fd);
+	return -1;
+}
+
+static void ring_exit(struct ring *r)
+{
+	munmap(r->sqes,r->sqe_sz);
+	if(r->cq_ptr!=r->sq_ptr)
+		munmap(r->cq_ptr,r->cq_sz);
+	munmap(r->sq_ptr,r->sq_sz);
+	close(r->fd);
+}
+
+//////////////////////////////////////////////////////////////
+/* take every completion that is there; the number taken */
+static int reap(struct ring *r,struct ls_dir *d,struct statx *bufs,unsigned *slots,unsigned *nfree)
+{
+	struct io_uring_cqe *cqe;
+	struct ls_ent *e;
+	struct statx x;
+	unsigned head,slot;
+	int n=0;
+
+	head=*r->cq_head;
+	while(head!=__atomic_load_n(r->cq_tail,__ATOMIC_ACQUIRE))
+	{
+		cqe=&r->cqes[head&*r->cq_mask];
+		slot=cqe->user_data&0xffffffff;
+		e=&d->e[cqe->user_data>>32];
+		if(cqe->res>=0)
+			lsd_fill(e,&bufs[slot]);
+		/* -EAGAIN, -EINTR...: ask once more the plain way, as lsd_stat() would */
+		else if(statx(d->fd,e->name,AT_SYMLINK_NOFOLLOW|AT_NO_AUTOMOUNT,STATX_BASIC_STATS,&x)==0)
+			lsd_fill(e,&x);
+		slots[(*nfree)++]=slot;
+		n++;
+		head++;
+	}
+	__atomic_store_n(r->cq_head,head,__ATOMIC_RELEASE);
+	return n;
+}
+
+int lsd_stat_uring(struct ls_dir *d,unsigned qd)
+{
+	struct io_uring_sqe *sqe;
+	struct statx *bufs;
+	unsigned *slots,nfree,tail,slot,queued=0;
+	int next=0,done=0,ret;
+	struct ring r;
+
+	if(qd<1)
+		qd=64;
+	if(d->n==0)
+		return 0;
+	if(ring_init(&r,qd)<0)
+	{
+		lsd_stat(d);
+		return 1;
+	}
+	qd=r.entries;
+
+	bufs=malloc(qd*sizeof(*bufs));
+	slots=malloc(qd*sizeof(*slots));
+	if(bufs==0||slots==0)
+	{
+		free(bufs);
+		free(slots);
+		ring_exit(&r);
+		lsd_stat(d);
+		return 1;
+	}
+	for(nfree=0;nfree<qd;nfree++)
+		slots[nfree]=nfree;
+
+	while(done<d->n)
+	{
+		/* keep the ring full */
+		tail=*r.sq_tail;
+		while(nfree&&next<d->n)
+		{
+			slot=slots[--nfree];
+			sqe=&r.sqes[tail&*r.sq_mask];
+			memset(sqe,0,sizeof(*sqe));
+			sqe->opcode=IORING_OP_STATX;
+			sqe->fd=d->fd;
+			sqe->addr=(unsigned long)d->e[next].name;
+			sqe->len=STATX_BASIC_STATS;
+			sqe->addr2=(unsigned long)&bufs[slot];
+			sqe->statx_flags=AT_SYMLINK_NOFOLLOW|AT_NO_AUTOMOUNT;
+			sqe->user_data=(unsigned long long)next<<32|slot;
+			r.sq_array[tail&*r.sq_mask]=tail&*r.sq_mask;
+			tail++;
+			next++;
+			queued++;
+		}
+		__atomic_store_n(r.sq_tail,tail,__ATOMIC_RELEASE);
+
+		ret=syscall(__NR_io_uring_enter,r.fd,queued,1,IORING_ENTER_GETEVENTS,0,0);
+		if(ret<0&&errno==EINTR)
+			continue;	/* nothing was submitted: try again */
+		if(ret<0)
+		{
+			perror("io_uring_enter");
+			break;
+		}
+		queued-=ret;
+		done+=reap(&r,d,bufs,slots,&nfree);
+	}
+
+	/*
+	 * Broken down half way: statx calls already submitted still write
+	 * into bufs.  Wait for all of them before the ring and bufs go; if
+	 * even that fails, leak bufs rather than have the kernel write into
+	 * freed memory.  (The "queued" SQEs the kernel never took just die
+	 * with the ring.)
+	 */
+	while(done+(int)queued<next)
+	{
+		ret=syscall(__NR_io_uring_enter,r.fd,0,next-done-queued,IORING_ENTER_GETEVENTS,0,0);
+		if(ret<0&&errno!=EINTR)
+		{
+			bufs=0;
+			break;
+		}
+		done+=reap(&r,d,bufs,slots,&nfree);
+	}
+	ring_exit(&r);
+	free(bufs);
+	free(slots);
+	if(done<d->n)		/* ring broke down half way */
+	{
+		lsd_stat(d);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,336 @@
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sched.h>
+#include<time.h>
+#include<stdint.h>
+#include<dirent.h>
+#include<sys/stat.h>
+#include<sys/syscall.h>
+#include<sys/resource.h>
+#include"pwalk.h"
+
+#define PW_BUFSZ	(64*1024)
+
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+struct pw_pool {
+	struct pw_worker *w;
+	int n;
+	const struct pw_ops *ops;
+	long outstanding;	/* queued + running jobs */
+};
+
+int pw_ncpu(void)
+{
+	long n=sysconf(_SC_NPROCESSORS_ONLN);
+	return n>0 ? (int)n : 1;
+}
+
+static int put_path(const struct pw_dir *d,char *buf,size_t len)
+{
+	size_t n=0,l;
+	int r;
+
+	if(d->parent)
+	{
+		r=put_path(d->parent,buf,len);
+		if(r<0)
+			return -1;
+		n=r;
+		if(n+1>=len)
+			return -1;
+		if(n==0||buf[n-1]!='/')
+			buf[n++]='/';
+	}
+	l=strlen(d->name);
+	if(n+l>=len)
+		return -1;
+	memcpy(buf+n,d->name,l+1);
+	return n+l;
+}
+
+/* full path of name inside d (or of d itself when name is NULL) */
+int pw_path(const struct pw_dir *d,const char *name,char *buf,size_t len)
+{
+	int n;
+	size_t l;
+
+	n=put_path(d,buf,len);
+	if(n<0||!name)
+		return n;
+	l=strlen(name);
+	if(n+l+2>len)
+		return -1;
+	if(n==0||buf[n-1]!='/')
+		buf[n++]='/';
+	memcpy(buf+n,name,l+1);
+	return n+l;
+}
+
+static struct pw_dir *new_dir(const struct pw_ops *ops,struct pw_dir *parent,const char *name)
+{
+	size_t l=strlen(name)+1;
+	size_t off=(sizeof(struct pw_dir)+l+15)&~(size_t)15;
+	struct pw_dir *d;
+
+	d=malloc(off+ops->dir_size);
+	if(d==0)
+		return 0;
+	d->parent=parent;
+	d->fd=-1;
+	d->fdref=1;
+	d->pending=1;
+	d->depth=parent ? parent->depth+1 : 0;
+	memcpy(d->name,name,l);
+	d->priv=0;
+	if(ops->dir_size)
+	{
+		d->priv=(char *)d+off;
+		memset(d->priv,0,ops->dir_size);
+	}
+	return d;
+}
+
+//////////////////////////////////////////////////////////////
+static void push(struct pw_worker *w,struct pw_dir *d)
+{
+	__atomic_add_fetch(&w->pool->outstanding,1,__ATOMIC_RELAXED);
+	pthread_mutex_lock(&w->lock);
+	if(w->tail-w->head==w->cap)
+	{
+		unsigned i,cap=w->cap*2;
+		struct pw_dir **q=malloc(cap*sizeof(*q));
+
+		for(i=w->head;i!=w->tail;i++)
+			q[i&(cap-1)]=w->q[i&(w->cap-1)];
+		free(w->q);
+		w->q=q;
+		w->cap=cap;
+	}
+	w->q[w->tail&(w->cap-1)]=d;
+	__atomic_store_n(&w->tail,w->tail+1,__ATOMIC_RELAXED);
+	pthread_mutex_unlock(&w->lock);
+}
+
+/* own jobs come off the tail (newest), stolen ones off the head */
+static struct pw_dir *take(struct pw_worker *w,int steal)
+{
+	struct pw_dir *d=0;
+
+	/* unlocked peek, rechecked under the lock */
+	if(__atomic_load_n(&w->head,__ATOMIC_RELAXED)==__atomic_load_n(&w->tail,__ATOMIC_RELAXED))
+		return 0;
+	pthread_mutex_lock(&w->lock);
+	if(w->head!=w->tail)
+	{
+		if(steal)
+		{
+			d=w->q[w->head&(w->cap-1)];
+			__atomic_store_n(&w->head,w->head+1,__ATOMIC_RELAXED);
+		}
+		else
+		{
+			__atomic_store_n(&w->tail,w->tail-1,__ATOMIC_RELAXED);
+			d=w->q[w->tail&(w->cap-1)];
+		}
+	}
+	pthread_mutex_unlock(&w->lock);
+	return d;
+}
+
+static void fd_put(struct pw_dir *d)
+{
+	if(__atomic_sub_fetch(&d->fdref,1,__ATOMIC_ACQ_REL)==0&&d->fd>=0)
+	{
+		close(d->fd);
+		d->fd=-1;
+	}
+}
+
+static void finish(struct pw_worker *w,struct pw_dir *d)
+{
+	const struct pw_ops *ops=w->pool->ops;
+	struct pw_dir *p;
+
+	while(d&&__atomic_sub_fetch(&d->pending,1,__ATOMIC_ACQ_REL)==0)
+	{
+		p=d->parent;
+		if(ops->dir_done)
+			ops->dir_done(w,d);
+		free(d);
+		d=p;
+	}
+}
+
+static void report(struct pw_dir *d,const char *what)
+{
+	char path[4096];
+	int e=errno;
+
+	if(pw_path(d,0,path,sizeof(path))<0)
+		strcpy(path,d->name);
+	fprintf(stderr,"%s: %s: %s\n",what,path,strerror(e));
+}
+
+static void scan(struct pw_worker *w,struct pw_dir *d)
+{
+	const struct pw_ops *ops=w->pool->ops;
+	struct linux_dirent64 *e;
+	struct pw_dir *c;
+	struct stat v;
+	unsigned char type;
+	long n,off;
+	int fd;
+
+	if(d->parent)
+	{
+		fd=openat(d->parent->fd,d->name,O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+		if(fd<0)
+			report(d,"openat");
+		fd_put(d->parent);
+		d->fd=fd;
+	}
+	fd=d->fd;
+	if(fd>=0&&ops->dir_enter)
+		ops->dir_enter(w,d,fd);
+
+	while(fd>=0&&(n=syscall(SYS_getdents64,fd,w->buf,PW_BUFSZ))>0)
+	{
+		for(off=0;off<n;off+=e->d_reclen)
+		{
+			e=(struct linux_dirent64 *)(w->buf+off);
+			if(e->d_name[0]=='.')
+			{
+				if(ops->skip_hidden)
+					continue;
+				if(e->d_name[1]==0||(e->d_name[1]=='.'&&e->d_name[2]==0))
+					continue;
+			}
+			type=e->d_type;
+			if(type==DT_UNKNOWN)
+			{
+				if(fstatat(fd,e->d_name,&v,AT_SYMLINK_NOFOLLOW)<0)
+					continue;
+				type=IFTODT(v.st_mode);
+			}
+			if(!ops->entry(w,d,fd,e->d_name,type)||type!=DT_DIR)
+				continue;
+			c=new_dir(ops,d,e->d_name);
+			if(c==0)
+			{
+				perror("malloc");
+				continue;
+			}
+			__atomic_add_fetch(&d->fdref,1,__ATOMIC_RELAXED);
+			__atomic_add_fetch(&d->pending,1,__ATOMIC_RELAXED);
+			push(w,c);
+		}
+	}
+	if(fd>=0&&n<0)
+		report(d,"getdents64");
+
+	fd_put(d);
+	finish(w,d);
+}
+
+static void *worker(void *arg)
+{
+	struct pw_worker *w=arg;
+	struct pw_pool *pool=w->pool;
+	struct timespec ts={0,100000};
+	struct pw_dir *d;
+	int i,spins=0;
+
+	for(;;)
+	{
+		d=take(w,0);
+		for(i=1;!d&&i<pool->n;i++)
+			d=take(&pool->w[(w->id+i)%pool->n],1);
+		if(d)
+		{
+			scan(w,d);
+			__atomic_sub_fetch(&pool->outstanding,1,__ATOMIC_RELEASE);
+			spins=0;
+			continue;
+		}
+		if(__atomic_load_n(&pool->outstanding,__ATOMIC_ACQUIRE)==0)
+			break;
+		if(++spins<64)
+			sched_yield();
+		else
+			nanosleep(&ts,0);
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////
+int pw_run(const char *root,int nthreads,const struct pw_ops *ops,void *arg)
+{
+	struct pw_pool pool;
+	struct pw_dir *d;
+	struct rlimit rl;
+	int i;
+
+	if(nthreads<1)
+		nthreads=pw_ncpu();
+
+	/* every queued directory may pin its parent's fd */
+	if(getrlimit(RLIMIT_NOFILE,&rl)==0&&rl.rlim_cur<rl.rlim_max)
+	{
+		rl.rlim_cur=rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE,&rl);
+	}
+
+	d=new_dir(ops,0,root);
+	if(d==0)
+		return -1;
+	d->fd=open(root,O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if(d->fd<0)
+	{
+		perror(root);
+		free(d);
+		return -1;
+	}
+
+	pool.n=nthreads;
+	pool.ops=ops;
+	pool.outstanding=0;
+	pool.w=calloc(nthreads,sizeof(*pool.w));
+	for(i=0;i<nthreads;i++)
+	{
+		pool.w[i].id=i;
+		pool.w[i].arg=arg;
+		pool.w[i].pool=&pool;
+		pool.w[i].cap=256;
+		pool.w[i].q=malloc(pool.w[i].cap*sizeof(struct pw_dir *));
+		pool.w[i].buf=malloc(PW_BUFSZ);
+		pthread_mutex_init(&pool.w[i].lock,0);
+	}
+	push(&pool.w[0],d);
+
+	for(i=1;i<nthreads;i++)
+		pthread_create(&pool.w[i].tid,0,worker,&pool.w[i]);
+	worker(&pool.w[0]);
+	for(i=1;i<nthreads;i++)
+		pthread_join(pool.w[i].tid,0);
+
+	for(i=0;i<nthreads;i++)
+	{
+		free(pool.w[i].q);
+		free(pool.w[i].buf);
+		pthread_mutex_destroy(&pool.w[i].lock);
+	}
+	free(pool.w);
+	return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef PWALK_H
+#define PWALK_H
+
+#include<pthread.h>
+#include<stddef.h>
+
+/*
+ * Parallel directory walker.
+ *
+ * Every directory is one job.  Each worker keeps its own deque of jobs,
+ * pops the newest one itself (depth first, keeps the frontier small) and
+ * steals the oldest one from another worker when it runs dry.  A job is
+ * opened with openat() relative to its parent's fd and read with
+ * getdents64(), so no full path is ever built while walking.
+ */
+
+struct pw_dir {
+	struct pw_dir *parent;
+	int fd;			/* open while children still need it */
+	int fdref;		/* scanner + children not yet opened */
+	int pending;		/* self + child dirs not yet finished */
+	int depth;
+	void *priv;		/* ops->dir_size bytes, zeroed */
+	char name[];
+};
+
+struct pw_worker {
+	int id;
+	void *arg;		/* pw_run() arg */
+	struct pw_pool *pool;
+	pthread_t tid;
+	pthread_mutex_t lock;
+	struct pw_dir **q;	/* ring buffer deque */
+	unsigned head, tail, cap;
+	char *buf;		/* getdents64 buffer */
+};
+
+struct pw_ops {
+	/*
+	 * Called for every entry except "." and "..".  dfd is the directory
+	 * being read.  For a directory, return non zero to descend into it.
+	 * type is a DT_* value, never DT_UNKNOWN.
+	 */
+	int (*entry)(struct pw_worker *w, struct pw_dir *d, int dfd,
+		     const char *name, unsigned char type);
+	/* Optional.  Called with the directory's own fd before it is read. */
+	void (*dir_enter)(struct pw_worker *w, struct pw_dir *d, int dfd);
+	/*
+	 * Optional.  Called once a directory and everything below it has been
+	 * walked, children before parents.  The node is freed afterwards.
+	 */
+	void (*dir_done)(struct pw_worker *w, struct pw_dir *d);
+	size_t dir_size;	/* bytes of per directory priv */
+	int skip_hidden;	/* ignore names starting with '.' */
+};
+
+int pw_run(const char *root, int nthreads, const struct pw_ops *ops, void *arg);
+int pw_path(const struct pw_dir *d, const char *name, char *buf, size_t len);
+int pw_ncpu(void);
+
+#endif
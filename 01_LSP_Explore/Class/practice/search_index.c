@@ -0,0 +1,630 @@
+// index mode for search.c
+//
+//   ./a.out -b path index     walk path once and write the index file
+//   ./a.out -w path index     build, then keep the index current with inotify
+//   ./a.out -q index filename look a name up in the mmap'd index
+//
+// The index is one file: a header, a node array {parent, name, next}, a
+// bucket array of name hash chains and a pool of interned name strings
+// (each distinct component is stored once).  A query hashes the name,
+// walks one chain and rebuilds each hit's path from the parent links.
+// The watcher rewrites the file to a temp name and rename()s it over the
+// old one, so a query always maps a complete snapshot.  A deletion only
+// marks the node dead; every snapshot, and a node array that has doubled
+// meanwhile, compacts the dead nodes and their names out of memory too.
+// A query checks the file against its size before following any offset.
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<dirent.h>
+#include<poll.h>
+#include<time.h>
+#include<sys/stat.h>
+#include<sys/mman.h>
+#include<sys/syscall.h>
+#include<sys/inotify.h>
+
+#define NONE		0xffffffffu
+#define IDX_MAGIC	"SRCHIDX1"
+#define IDX_VERSION	1
+
+#define N_DIR		1
+#define N_DEAD		2
+
+struct node {
+	uint32_t parent;
+	uint32_t name;		/* offset into the string pool */
+	uint32_t next;		/* next node in the same hash bucket */
+	uint32_t flags;
+};
+
+struct idx_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t nnodes;
+	uint32_t nbuckets;	/* power of two */
+	uint32_t pool_size;
+	uint64_t nodes_off;
+	uint64_t buckets_off;
+	uint64_t pool_off;
+};
+
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+static struct node *nodes;
+static uint32_t nn,ncap;
+static char *pool;
+static uint32_t plen,pcap;
+static uint32_t *itab,icap,icount;	/* interned strings, pool offset+1 */
+static uint32_t *bucket,nb;
+static uint32_t ndead,nlive;		/* N_DEAD marks, nn at the last compact() */
+
+static int ifd=-1;			/* inotify fd when watching */
+static uint32_t *wdmap;			/* watch descriptor -> node */
+static int wdcap;
+
+static uint32_t hash(const char *s)
+{
+	uint32_t h=2166136261u;
+
+	while(*s)
+		h=(h^(unsigned char)*s++)*16777619u;
+	return h;
+}
+
+static void *grow(void *p,uint32_t *cap,uint32_t need,size_t sz)
+{
+	uint32_t c=*cap ? *cap : 1024;
+
+	if(need<=*cap)
+		return p;
+	while(c<need)
+		c*=2;
+	p=realloc(p,(size_t)c*sz);
+	if(p==0)
+	{
+		perror("realloc");
+		exit(1);
+	}
+	*cap=c;
+	return p;
+}
+
+//////////////////////////////////////////////////////////////
+static uint32_t intern(const char *s)
+{
+	uint32_t h,i,l,*old,oldcap;
+
+	if(icount*2>=icap)
+	{
+		old=itab;
+		oldcap=icap;
+		icap=icap ? icap*2 : 4096;
+		itab=calloc(icap,sizeof(*itab));
+		for(i=0;i<oldcap;i++)
+		{
+			if(!old[i])
+				continue;
+			h=hash(pool+old[i]-1)&(icap-1);
+			while(itab[h])
+				h=(h+1)&(icap-1);
+			itab[h]=old[i];
+		}
+		free(old);
+	}
+
+	for(h=hash(s)&(icap-1);itab[h];h=(h+1)&(icap-1))
+		if(strcmp(pool+itab[h]-1,s)==0)
+			return itab[h]-1;
+
+	l=strlen(s)+1;
+	pool=grow(pool,&pcap,plen+l,1);
+	memcpy(pool+plen,s,l);
+	itab[h]=plen+1;
+	icount++;
+	plen+=l;
+	return plen-l;
+}
+
+static void rehash(void)
+{
+	uint32_t i,h;
+
+	free(bucket);
+	nb=nb ? nb*2 : 4096;
+	while(nb<nn)
+		nb*=2;
+	bucket=malloc(nb*sizeof(*bucket));
+	memset(bucket,0xff,nb*sizeof(*bucket));
+	for(i=0;i<nn;i++)
+	{
+		h=hash(pool+nodes[i].name)&(nb-1);
+		nodes[i].next=bucket[h];
+		bucket[h]=i;
+	}
+}
+
+static uint32_t add_node(uint32_t parent,const char *name,uint32_t flags)
+{
+	uint32_t h;
+
+	nodes=grow(nodes,&ncap,nn+1,sizeof(*nodes));
+	nodes[nn].parent=parent;
+	nodes[nn].name=intern(name);
+	nodes[nn].flags=flags;
+	nn++;
+	if(nn>nb)
+	{
+		rehash();
+		return nn-1;
+	}
+	h=hash(name)&(nb-1);
+	nodes[nn-1].next=bucket[h];
+	bucket[h]=nn-1;
+	return nn-1;
+}
+
+static int dead(uint32_t id)
+{
+	for(;id!=NONE;id=nodes[id].parent)
+		if(nodes[id].flags&N_DEAD)
+			return 1;
+	return 0;
+}
+
+static uint32_t find_child(uint32_t parent,const char *name)
+{
+	uint32_t i;
+
+	for(i=bucket[hash(name)&(nb-1)];i!=NONE;i=nodes[i].next)
+		if(nodes[i].parent==parent&&!(nodes[i].flags&N_DEAD)&&
+		   strcmp(pool+nodes[i].name,name)==0)
+			return i;
+	return NONE;
+}
+
+static int node_path(const char *pl,const struct node *nd,uint32_t id,char *buf,int len)
+{
+	int n=0,l;
+
+	if(nd[id].parent!=NONE)
+	{
+		n=node_path(pl,nd,nd[id].parent,buf,len);
+		if(n<0||n+1>=len)
+			return -1;
+		if(n==0||buf[n-1]!='/')
+			buf[n++]='/';
+	}
+	l=strlen(pl+nd[id].name);
+	if(n+l>=len)
+		return -1;
+	memcpy(buf+n,pl+nd[id].name,l+1);
+	return n+l;
+}
+
+//////////////////////////////////////////////////////////////
+static void watch(uint32_t id,int dfd)
+{
+	char proc[64];
+	int wd;
+
+	if(ifd<0)
+		return;
+	/* the magic link lets inotify resolve the dir without a full path */
+	snprintf(proc,sizeof(proc),"/proc/self/fd/%d",dfd);
+	wd=inotify_add_watch(ifd,proc,IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|
+			     IN_DELETE_SELF|IN_ONLYDIR);
+	if(wd<0)
+	{
+		static int warned;
+		if(!warned++)
+			perror("inotify_add_watch");
+		return;
+	}
+	if(wd>=wdcap)
+	{
+		int c=wdcap ? wdcap : 1024;
+		while(c<=wd)
+			c*=2;
+		wdmap=realloc(wdmap,c*sizeof(*wdmap));
+		memset(wdmap+wdcap,0xff,(c-wdcap)*sizeof(*wdmap));
+		wdcap=c;
+	}
+	wdmap[wd]=id;
+}
+
+static void scan(uint32_t id,int dfd)
+{
+	char *buf=malloc(65536);
+	struct linux_dirent64 *e;
+	struct stat v;
+	uint32_t c;
+	long n,off;
+	int fd,isdir;
+
+	watch(id,dfd);
+	while((n=syscall(SYS_getdents64,dfd,buf,65536))>0)
+	{
+		for(off=0;off<n;off+=e->d_reclen)
+		{
+			e=(struct linux_dirent64 *)(buf+off);
+			if(e->d_name[0]=='.')
+				continue;
+			isdir=e->d_type==DT_DIR;
+			if(e->d_type==DT_UNKNOWN&&fstatat(dfd,e->d_name,&v,AT_SYMLINK_NOFOLLOW)==0)
+				isdir=S_ISDIR(v.st_mode);
+			c=add_node(id,e->d_name,isdir ? N_DIR : 0);
+			if(!isdir)
+				continue;
+			fd=openat(dfd,e->d_name,O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+			if(fd<0)
+				continue;
+			scan(c,fd);
+			close(fd);
+		}
+	}
+	free(buf);
+}
+
+static int build(const char *root)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	nn=0;
+	plen=0;
+	icount=0;
+	ndead=0;
+	if(itab)
+		memset(itab,0,icap*sizeof(*itab));
+	if(wdmap)
+		memset(wdmap,0xff,wdcap*sizeof(*wdmap));
+	if(bucket)
+		memset(bucket,0xff,nb*sizeof(*bucket));
+
+	if(realpath(root,path)==0)
+	{
+		perror(root);
+		return -1;
+	}
+	fd=open(path,O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if(fd<0)
+	{
+		perror(path);
+		return -1;
+	}
+	add_node(NONE,path,N_DIR);
+	scan(0,fd);
+	close(fd);
+	nlive=nn;
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////
+// drop dead nodes and the names only they used: renumber the live ones,
+// intern into a fresh pool, rebuild the chains and the watch map
+static void compact(void)
+{
+	struct node *out;
+	uint32_t *map,i,k=0;
+	char *opool=pool;
+	uint32_t *oitab=itab;
+	int w;
+
+	if(ndead==0)
+		return;
+	map=malloc(nn*sizeof(*map));
+	out=malloc(nn*sizeof(*out));
+	if(map==0||out==0)
+	{
+		perror("malloc");
+		exit(1);
+	}
+	pool=0;
+	plen=pcap=0;
+	itab=0;
+	icap=icount=0;
+	for(i=0;i<nn;i++)
+	{
+		map[i]=NONE;
+		if(nodes[i].flags&N_DEAD)
+			continue;
+		if(nodes[i].parent!=NONE&&map[nodes[i].parent]==NONE)
+			continue;	/* parents always precede children */
+		out[k].parent=nodes[i].parent==NONE ? NONE : map[nodes[i].parent];
+		out[k].name=intern(opool+nodes[i].name);
+		out[k].flags=nodes[i].flags&N_DIR;
+		map[i]=k++;
+	}
+	/* a directory moved out of the tree is still watched: stop that */
+	for(w=0;w<wdcap;w++)
+		if(wdmap[w]!=NONE&&(wdmap[w]=map[wdmap[w]])==NONE)
+			inotify_rm_watch(ifd,w);
+	free(opool);
+	free(oitab);
+	free(nodes);
+	free(map);
+	nodes=out;
+	ncap=nn;
+	nn=nlive=k;
+	ndead=0;
+	nb=0;
+	rehash();
+}
+
+// the in-memory index, compacted, as one file
+static int save(const char *file)
+{
+	struct idx_hdr h;
+	char tmp[PATH_MAX];
+	int fd;
+	FILE *fp;
+
+	compact();
+	memset(&h,0,sizeof(h));
+	memcpy(h.magic,IDX_MAGIC,8);
+	h.version=IDX_VERSION;
+	h.nnodes=nn;
+	h.nbuckets=nb;
+	h.pool_size=plen;
+	h.nodes_off=sizeof(h);
+	h.buckets_off=h.nodes_off+(uint64_t)nn*sizeof(*nodes);
+	h.pool_off=h.buckets_off+(uint64_t)nb*sizeof(*bucket);
+
+	snprintf(tmp,sizeof(tmp),"%s.tmp",file);
+	fd=open(tmp,O_WRONLY|O_CREAT|O_TRUNC,0644);
+	fp=fd<0 ? 0 : fdopen(fd,"w");
+	if(fp==0)
+	{
+		perror(tmp);
+		return -1;
+	}
+	/* a short tmp file must never replace the good index (ENOSPC, EIO) */
+	if(fwrite(&h,sizeof(h),1,fp)!=1||
+	   fwrite(nodes,sizeof(*nodes),nn,fp)!=nn||
+	   fwrite(bucket,sizeof(*bucket),nb,fp)!=nb||
+	   fwrite(pool,1,plen,fp)!=plen||
+	   fflush(fp)!=0||fsync(fd)<0)
+	{
+		perror(tmp);
+		fclose(fp);
+		unlink(tmp);
+		return -1;
+	}
+	if(fclose(fp)!=0)
+	{
+		perror(tmp);
+		unlink(tmp);
+		return -1;
+	}
+	if(rename(tmp,file)<0)
+	{
+		perror("rename");
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////
+static void event(const struct inotify_event *ev,const char *root)
+{
+	char path[PATH_MAX];
+	uint32_t id,c;
+	int fd;
+
+	if(ev->mask&IN_Q_OVERFLOW)
+	{
+		fprintf(stderr,"inotify queue overflow, rebuilding\n");
+		build(root);
+		return;
+	}
+	if(ev->wd<0||ev->wd>=wdcap||(id=wdmap[ev->wd])==NONE)
+		return;
+	if(ev->mask&(IN_DELETE_SELF|IN_IGNORED))
+	{
+		wdmap[ev->wd]=NONE;
+		return;
+	}
+	if(!ev->len||ev->name[0]=='.'||dead(id))
+		return;
+
+	if(ev->mask&(IN_DELETE|IN_MOVED_FROM))
+	{
+		c=find_child(id,ev->name);
+		if(c!=NONE)
+		{
+			nodes[c].flags|=N_DEAD;	/* hides the whole subtree */
+			ndead++;
+		}
+	}
+	else if(ev->mask&(IN_CREATE|IN_MOVED_TO))
+	{
+		if(find_child(id,ev->name)!=NONE)
+			return;
+		c=add_node(id,ev->name,ev->mask&IN_ISDIR ? N_DIR : 0);
+		if(!(ev->mask&IN_ISDIR)||node_path(pool,nodes,c,path,sizeof(path))<0)
+			return;
+		/* entries may have landed before the watch did */
+		fd=open(path,O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+		if(fd<0)
+			return;
+		scan(c,fd);
+		close(fd);
+	}
+}
+
+static int watch_loop(const char *root,const char *file)
+{
+	char buf[64*1024] __attribute__((aligned(8)));
+	struct inotify_event *ev;
+	struct pollfd p;
+	int dirty=0;
+	long n,off;
+
+	ifd=inotify_init1(IN_CLOEXEC);
+	if(ifd<0)
+	{
+		perror("inotify_init1");
+		return -1;
+	}
+	if(build(root)<0||save(file)<0)
+		return -1;
+	printf("indexed %u names, watching...\n",nn);
+	fflush(stdout);
+
+	p.fd=ifd;
+	p.events=POLLIN;
+	for(;;)
+	{
+		/* write a snapshot once events have been quiet for a second */
+		if(poll(&p,1,dirty ? 1000 : -1)==0)
+		{
+			/* a failed save keeps the old index: try again later */
+			if(save(file)==0)
+				dirty=0;
+			continue;
+		}
+		n=read(ifd,buf,sizeof(buf));
+		if(n<0)
+		{
+			if(errno==EINTR)
+				continue;
+			perror("read");
+			return -1;
+		}
+		for(off=0;off<n;off+=sizeof(*ev)+ev->len)
+		{
+			ev=(struct inotify_event *)(buf+off);
+			event(ev,root);
+		}
+		/* events that never pause: reclaim once the array has doubled */
+		if(nn>2*nlive)
+			compact();
+		dirty=1;
+	}
+}
+
+//////////////////////////////////////////////////////////////
+// the file is trusted no further than its size: every section inside it,
+// a string pool that ends in a NUL
+static int idx_ok(const struct idx_hdr *h,uint64_t size)
+{
+	if(size<sizeof(*h)||memcmp(h->magic,IDX_MAGIC,8)||h->version!=IDX_VERSION)
+		return 0;
+	if(h->nbuckets==0||(h->nbuckets&(h->nbuckets-1)))
+		return 0;
+	if(h->nodes_off%4||h->buckets_off%4)
+		return 0;
+	if(h->nodes_off>size||(uint64_t)h->nnodes*sizeof(struct node)>size-h->nodes_off)
+		return 0;
+	if(h->buckets_off>size||(uint64_t)h->nbuckets*sizeof(uint32_t)>size-h->buckets_off)
+		return 0;
+	if(h->pool_off>size||h->pool_size>size-h->pool_off)
+		return 0;
+	return h->pool_size>0 ? ((const char *)h)[h->pool_off+h->pool_size-1]==0 : h->nnodes==0;
+}
+
+// node i and its ancestors point inside the file, parents before children
+static int node_ok(const struct idx_hdr *h,const struct node *nd,uint32_t i)
+{
+	for(;i!=NONE;i=nd[i].parent)
+		if(i>=h->nnodes||nd[i].name>=h->pool_size||
+		   (nd[i].parent!=NONE&&nd[i].parent>=i))
+			return 0;
+	return 1;
+}
+
+static int query(const char *file,const char *name)
+{
+	const struct idx_hdr *h;
+	const struct node *nd;
+	const uint32_t *bk;
+	const char *pl;
+	struct timespec t0,t1;
+	char path[PATH_MAX];
+	struct stat v;
+	uint32_t i,steps=0;
+	void *m;
+	int fd,c=0;
+
+	fd=open(file,O_RDONLY);
+	if(fd<0||fstat(fd,&v)<0)
+	{
+		perror(file);
+		return -1;
+	}
+	m=mmap(0,v.st_size,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(m==MAP_FAILED)
+	{
+		perror("mmap");
+		return -1;
+	}
+	h=m;
+	if(!idx_ok(h,v.st_size))
+	{
+		fprintf(stderr,"%s: not a version %d index\n",file,IDX_VERSION);
+		munmap(m,v.st_size);
+		return -1;
+	}
+	nd=(const struct node *)((char *)m+h->nodes_off);
+	bk=(const uint32_t *)((char *)m+h->buckets_off);
+	pl=(const char *)m+h->pool_off;
+
+	clock_gettime(CLOCK_MONOTONIC,&t0);
+	for(i=bk[hash(name)&(h->nbuckets-1)];i!=NONE;i=nd[i].next)
+	{
+		if(!node_ok(h,nd,i)||++steps>h->nnodes)
+		{
+			fprintf(stderr,"%s: corrupt index\n",file);
+			munmap(m,v.st_size);
+			return -1;
+		}
+		if(strcmp(pl+nd[i].name,name))
+			continue;
+		c++;
+		if(node_path(pl,nd,i,path,sizeof(path))>=0)
+			printf("%s\n",path);
+	}
+	clock_gettime(CLOCK_MONOTONIC,&t1);
+
+	printf("in main c=%d (%.1f us, %u names indexed)\n",c,
+	       (t1.tv_sec-t0.tv_sec)*1e6+(t1.tv_nsec-t0.tv_nsec)/1e3,h->nnodes);
+	munmap(m,v.st_size);
+	return 0;
+}
+
+int main(int argc,char **argv)
+{
+	if(argc!=4||argv[1][0]!='-')
+	{
+		printf("usage:./a.out -b path index | -w path index | -q index filename\n");
+		return 1;
+	}
+	switch(argv[1][1])
+	{
+	case 'b':
+		if(build(argv[2])<0||save(argv[3])<0)
+			return 1;
+		printf("indexed %u names\n",nn);
+		return 0;
+	case 'w':
+		return watch_loop(argv[2],argv[3])<0;
+	case 'q':
+		return query(argv[2],argv[3])<0;
+	}
+	printf("usage:./a.out -b path index | -w path index | -q index filename\n");
+	return 1;
+}
@@ -0,0 +1,93 @@
+// multi threaded version of search.c
+// cc -O2 -pthread search_mt.c pwalk.c -o search_mt
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<unistd.h>
+#include<dirent.h>
+#include"pwalk.h"
+
+#define OUTSZ	(64*1024)
+
+struct out {
+	char buf[OUTSZ];
+	int len;
+} __attribute__((aligned(64)));
+
+static const char *key;
+static long c;			/* matches, shared by all workers */
+static int quiet;
+static struct out *out;		/* one per worker */
+
+static void flush(struct out *o)
+{
+	if(o->len)
+		write(1,o->buf,o->len);
+	o->len=0;
+}
+
+static int entry(struct pw_worker *w,struct pw_dir *d,int dfd,const char *name,unsigned char type)
+{
+	struct out *o=&out[w->id];
+	int n;
+
+	(void)dfd;
+	(void)type;
+	if(strcmp(key,name)==0)
+	{
+		__atomic_add_fetch(&c,1,__ATOMIC_RELAXED);
+		if(!quiet)
+		{
+			if(OUTSZ-o->len<4096)
+				flush(o);
+			n=pw_path(d,name,o->buf+o->len,OUTSZ-o->len-1);
+			if(n>=0)
+			{
+				o->len+=n;
+				o->buf[o->len++]='\n';
+			}
+		}
+	}
+	return 1;
+}
+
+int main(int argc,char **argv)
+{
+	struct pw_ops ops={0};
+	int opt,i,nthreads=0;
+
+	while((opt=getopt(argc,argv,"j:q"))!=-1)
+	{
+		if(opt=='j')
+			nthreads=atoi(optarg);
+		else if(opt=='q')
+			quiet=1;
+		else
+		{
+			printf("usage:./a.out [-j threads] [-q] path filename\n");
+			return 1;
+		}
+	}
+	if(argc-optind!=2)
+	{
+		printf("usage:./a.out [-j threads] [-q] path filename\n");
+		return 1;
+	}
+	if(nthreads<1)
+		nthreads=pw_ncpu();
+
+	key=argv[optind+1];
+	out=aligned_alloc(64,nthreads*sizeof(*out));
+	for(i=0;i<nthreads;i++)
+		out[i].len=0;
+
+	ops.entry=entry;
+	ops.skip_hidden=1;
+	if(pw_run(argv[optind],nthreads,&ops,0)<0)
+		return 1;
+
+	for(i=0;i<nthreads;i++)
+		flush(&out[i]);
+	printf("in main c=%ld\n",c);
+	return 0;
+}
@@ -0,0 +1,331 @@
+// synthetic directory trees + cold/warm timing of the listing tools
+// cc -O2 treebench.c -o treebench
+//
+//   ./a.out [-f fanout] [-d depth] [-n files] [-l namelen] [-s seed]
+//           [-r runs] [-w] dir "cmd %s" ...
+//
+// dir is filled with a tree that depends only on the options: every
+// directory holds `files` empty files and, above `depth`, `fanout`
+// subdirectories, all with `namelen` character names.  The tree is kept and
+// reused while dir/.treebench matches the options.
+//
+// Each cmd is split on blanks and %s is replaced by dir, e.g.
+//   ./treebench /tmp/tree "1:./ls -l %s" "1:../fm/my_ls %s" "./search %s f0zz"
+// A cmd starting with "1:" only reads dir itself (ls, my_ls, open_dir), so it
+// is charged for the entries of the top level instead of the whole tree.
+//
+// Every run prints one JSON line.  Cold runs write /proc/sys/vm/drop_caches
+// first and need root; without it only warm runs are made (-w forces that).
+// rw_syscalls are the child's syscr+syscw from /proc/<pid>/io, read while it
+// is still a zombie: read/write class calls only, getdents64 and statx are
+// not in there, so compare it between versions of a tool, not across tools.
+#define _GNU_SOURCE
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<stdint.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<time.h>
+#include<errno.h>
+#include<sys/stat.h>
+#include<sys/wait.h>
+#include<sys/resource.h>
+
+#define MAXARGS	32
+
+struct shape {
+	int fanout,depth,files,namelen;
+	unsigned seed;
+};
+
+static struct shape sh={8,3,32,12,1};
+static uint64_t rng;
+static long ndirs,nfiles;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+static int drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd=open("/proc/sys/vm/drop_caches",O_WRONLY);
+	if(fd<0)
+		return -1;
+	if(write(fd,"3",1)!=1)
+	{
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////
+static uint64_t next(void)
+{
+	rng^=rng<<13;
+	rng^=rng>>7;
+	rng^=rng<<17;
+	return rng;
+}
+
+/* index in base 36 up front keeps names unique, the rest is random */
+static void name(char *s,char kind,long idx)
+{
+	static const char set[]="abcdefghijklmnopqrstuvwxyz0123456789";
+	int i=0,j;
+
+	s[i++]=kind;
+	do {
+		s[i++]=set[idx%36];
+		idx/=36;
+	} while(idx);
+	for(j=i;j<sh.namelen;j++)
+		s[j]=set[next()%36];
+	s[j]=0;
+}
+
+static int build(int dfd,int level)
+{
+	char s[300];
+	int i,fd;
+
+	for(i=0;i<sh.files;i++)
+	{
+		name(s,'f',i);
+		fd=openat(dfd,s,O_WRONLY|O_CREAT|O_EXCL,0644);
+		if(fd<0)
+			return -1;
+		close(fd);
+		nfiles++;
+	}
+	if(level==sh.depth)
+		return 0;
+	for(i=0;i<sh.fanout;i++)
+	{
+		name(s,'d',i);
+		if(mkdirat(dfd,s,0755)<0)
+			return -1;
+		fd=openat(dfd,s,O_RDONLY|O_DIRECTORY);
+		if(fd<0)
+			return -1;
+		ndirs++;
+		if(build(fd,level+1)<0)
+		{
+			close(fd);
+			return -1;
+		}
+		close(fd);
+	}
+	return 0;
+}
+
+static int tree(const char *dir)
+{
+	char want[128],have[128]={0};
+	double t;
+	int dfd,fd,n;
+
+	snprintf(want,sizeof(want),"fanout=%d depth=%d files=%d namelen=%d seed=%u\n",
+		 sh.fanout,sh.depth,sh.files,sh.namelen,sh.seed);
+	rng=sh.seed*0x9e3779b97f4a7c15ull|1;
+	mkdir(dir,0755);
+	dfd=open(dir,O_RDONLY|O_DIRECTORY);
+	if(dfd<0)
+		return -1;
+	fd=openat(dfd,".treebench",O_RDONLY);
+	if(fd>=0)
+	{
+		n=read(fd,have,sizeof(have)-1);
+		close(fd);
+		if(n>0&&strcmp(have,want)==0)
+		{
+			/* same shape: just count it */
+			long d=1,l;
+
+			for(l=0;l<sh.depth;l++)
+			{
+				d*=sh.fanout;
+				ndirs+=d;
+			}
+			nfiles=(ndirs+1)*sh.files;
+			close(dfd);
+			return 0;
+		}
+		fprintf(stderr,"%s holds a different tree, remove it first\n",dir);
+		close(dfd);
+		return -1;
+	}
+	t=now();
+	if(build(dfd,0)<0)
+	{
+		perror("build");
+		close(dfd);
+		return -1;
+	}
+	fd=openat(dfd,".treebench",O_WRONLY|O_CREAT|O_TRUNC,0644);
+	write(fd,want,strlen(want));
+	close(fd);
+	close(dfd);
+	fprintf(stderr,"built %ld dirs %ld files in %.2fs\n",ndirs,nfiles,now()-t);
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////
+static long proc_io(pid_t pid)
+{
+	char path[64],line[64];
+	long r=0,w=0;
+	FILE *fp;
+
+	snprintf(path,sizeof(path),"/proc/%d/io",pid);
+	fp=fopen(path,"r");
+	if(fp==0)
+		return -1;
+	while(fgets(line,sizeof(line),fp))
+	{
+		sscanf(line,"syscr: %ld",&r);
+		sscanf(line,"syscw: %ld",&w);
+	}
+	fclose(fp);
+	return r+w;
+}
+
+static int split(char *cmd,const char *dir,char **av)
+{
+	char *tok;
+	int n=0;
+
+	for(tok=strtok(cmd," \t");tok&&n<MAXARGS-1;tok=strtok(0," \t"))
+		av[n++]=strcmp(tok,"%s")==0 ? (char *)dir : tok;
+	av[n]=0;
+	return n;
+}
+
+static void json(const char *s)
+{
+	putchar('"');
+	for(;*s;s++)
+	{
+		if(*s=='"'||*s=='\\')
+			putchar('\\');
+		putchar(*s);
+	}
+	putchar('"');
+}
+
+static int run(const char *cmd,const char *dir,int cold,int nrun)
+{
+	char buf[1024],*av[MAXARGS];
+	struct rusage ru;
+	siginfo_t si;
+	long entries=ndirs+nfiles,io;
+	double t;
+	pid_t pid;
+	int status,null;
+
+	snprintf(buf,sizeof(buf),"%s",cmd);
+	if(strncmp(buf,"1:",2)==0)
+	{
+		memmove(buf,buf+2,strlen(buf+2)+1);
+		entries=(sh.depth ? sh.fanout : 0)+sh.files;
+	}
+	if(split(buf,dir,av)==0)
+		return -1;
+	if(cold&&drop_caches()<0)
+		return -1;
+
+	t=now();
+	pid=fork();
+	if(pid==0)
+	{
+		null=open("/dev/null",O_WRONLY);
+		dup2(null,1);
+		execvp(av[0],av);
+		perror(av[0]);
+		_exit(127);
+	}
+	if(pid<0)
+	{
+		perror("fork");
+		return -1;
+	}
+	/* leave it a zombie so /proc/<pid>/io still has the final counts */
+	while(waitid(P_PID,pid,&si,WEXITED|WNOWAIT)<0&&errno==EINTR)
+		;
+	t=now()-t;
+	io=proc_io(pid);
+	wait4(pid,&status,0,&ru);
+	if(nrun==0)
+		return 0;
+
+	printf("{\"cmd\":");
+	json(cmd);
+	printf(",\"cache\":\"%s\",\"run\":%d,\"status\":%d,\"entries\":%ld,"
+	       "\"wall_ms\":%.3f,\"user_ms\":%.3f,\"sys_ms\":%.3f,"
+	       "\"rw_syscalls\":%ld,\"rw_syscalls_per_entry\":%.4f,"
+	       "\"maxrss_kb\":%ld,\"minflt\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld}\n",
+	       cold ? "cold" : "warm",nrun,WIFEXITED(status) ? WEXITSTATUS(status) : -1,entries,
+	       t*1e3,ru.ru_utime.tv_sec*1e3+ru.ru_utime.tv_usec/1e3,
+	       ru.ru_stime.tv_sec*1e3+ru.ru_stime.tv_usec/1e3,
+	       io,entries ? (double)io/entries : 0,
+	       ru.ru_maxrss,ru.ru_minflt,ru.ru_nvcsw,ru.ru_nivcsw);
+	fflush(stdout);
+	return 0;
+}
+
+int main(int argc,char **argv)
+{
+	int opt,i,r,runs=3,warm_only=0;
+
+	while((opt=getopt(argc,argv,"f:d:n:l:s:r:w"))!=-1)
+	{
+		switch(opt)
+		{
+		case 'f': sh.fanout=atoi(optarg); break;
+		case 'd': sh.depth=atoi(optarg); break;
+		case 'n': sh.files=atoi(optarg); break;
+		case 'l': sh.namelen=atoi(optarg); break;
+		case 's': sh.seed=strtoul(optarg,0,0); break;
+		case 'r': runs=atoi(optarg); break;
+		case 'w': warm_only=1; break;
+		default:
+			goto usage;
+		}
+	}
+	if(argc-optind<2||sh.fanout<0||sh.depth<0||sh.files<0||
+	   sh.namelen<2||sh.namelen>255||runs<1)
+		goto usage;
+
+	if(tree(argv[optind])<0)
+		return 1;
+	if(!warm_only&&drop_caches()<0)
+	{
+		fprintf(stderr,"drop_caches: %s, warm runs only\n",strerror(errno));
+		warm_only=1;
+	}
+
+	for(i=optind+1;i<argc;i++)
+	{
+		for(r=1;!warm_only&&r<=runs;r++)
+			run(argv[i],argv[optind],1,r);
+		/* one untimed pass to get everything into the cache */
+		if(warm_only)
+			run(argv[i],argv[optind],0,0);
+		for(r=1;r<=runs;r++)
+			run(argv[i],argv[optind],0,r);
+	}
+	return 0;
+
+usage:
+	printf("usage:./a.out [-f fanout] [-d depth] [-n files] [-l namelen] [-s seed] [-r runs] [-w] dir \"cmd %%s\" ...\n");
+	return 1;
+}
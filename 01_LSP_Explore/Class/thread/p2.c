@@ -40,7 +40,9 @@ main()
 	pthread_create(&t1,NULL,thread_1,NULL);
 	pthread_create(&t2,NULL,thread_2,NULL);
 
-	while(1);
+	/* sleep here, not while(1): that burnt a whole core doing nothing */
+	pthread_join(t1,NULL);
+	pthread_join(t2,NULL);
 
 
 }